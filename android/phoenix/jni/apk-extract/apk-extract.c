@@ -20,23 +20,22 @@ struct userdata
    const char *dest;
 };
 
-static bool zlib_cb(const char *name, const char *valid_exts,
-      const uint8_t *cdata,
-      unsigned cmode, uint32_t csize, uint32_t size,
-      uint32_t crc32, void *userdata)
+static bool zlib_cb(const char *name, char *path, size_t path_size,
+      void *userdata)
 {
-   char path[PATH_MAX];
    char path_dir[PATH_MAX];
    struct userdata *user = userdata;
    const char *subdir = user->subdir;
    const char *dest   = user->dest;
 
+   *path = '\0';
+
    if (strstr(name, subdir) != name)
       return true;
 
    name += strlen(subdir) + 1;
 
-   fill_pathname_join(path, dest, name, sizeof(path));
+   fill_pathname_join(path, dest, name, path_size);
    fill_pathname_basedir(path_dir, path, sizeof(path_dir));
 
    if (!path_mkdir(path_dir))
@@ -45,30 +44,11 @@ static bool zlib_cb(const char *name, const char *valid_exts,
       return false;
    }
 
-   RARCH_LOG("Extracting %s -> %s ...\n", name, path);
-
-   switch (cmode)
-   {
-      case 0: /* Uncompressed */
-         if (!write_file(path, cdata, size))
-         {
-            RARCH_ERR("Failed to write file: %s.\n", path);
-            return false;
-         }
-         break;
-
-      case 8: /* Deflate */
-         if (!zlib_inflate_data_to_file(path, valid_exts, cdata,
-                  csize, size, crc32))
-         {
-            RARCH_ERR("Failed to deflate to: %s.\n", path);
-            return false;
-         }
-         break;
-
-      default:
-         return false;
-   }
+   /* Ignore directories. */
+   if (!*name || name[strlen(name) - 1] == '/')
+      *path = '\0';
+   else
+      RARCH_LOG("Extracting %s -> %s ...\n", name, path);
 
    return true;
 }
@@ -87,7 +67,7 @@ JNIEXPORT jboolean JNICALL Java_com_retroarch_browser_NativeInterface_extractArc
       .dest = dest_c,
    };
 
-   if (!zlib_parse_file(archive_c, NULL, zlib_cb, &data))
+   if (!zlib_extract_archive(archive_c, zlib_cb, &data))
    {
       RARCH_ERR("Failed to parse APK: %s.\n", archive_c);
       ret = JNI_FALSE;
@@ -22,6 +22,8 @@
 #endif
 
 #include "general.h"
+#include "retroarch.h"
+#include "movie.h"
 #include "compat/strl.h"
 #include "compat/posix_string.h"
 #include <file/file_path.h>
@@ -239,8 +241,54 @@ static bool cmd_set_shader(const char *arg)
    return driver.video->set_shader(driver.video_data, type, arg);
 }
 
+#if defined(HAVE_NETWORK_CMD) && defined(HAVE_NETPLAY)
+static bool cmd_netplay_stats(const char *arg)
+{
+   char msg[512];
+
+   (void)arg;
+
+   if (!netplay_get_stats((netplay_t*)driver.netplay_data, msg, sizeof(msg)))
+      return false;
+
+   msg_queue_clear(g_extern.msg_queue);
+   msg_queue_push(g_extern.msg_queue, msg, 1, 300);
+   RARCH_LOG("%s.\n", msg);
+
+   return true;
+}
+#endif
+
+static bool cmd_bsv_seek(const char *arg)
+{
+   char msg[256];
+   uint32_t frame = strtoul(arg, NULL, 0);
+
+   if (!g_extern.bsv.movie || !g_extern.bsv.movie_playback)
+      return false;
+
+   if (!bsv_movie_seek(g_extern.bsv.movie, frame))
+      return false;
+
+   /* States recorded before the seek are no longer valid. */
+   rarch_main_command(RARCH_CMD_REWIND_DEINIT);
+   rarch_main_command(RARCH_CMD_REWIND_INIT);
+
+   snprintf(msg, sizeof(msg), "Movie seeked to frame %u.", frame);
+   msg_queue_clear(g_extern.msg_queue);
+   msg_queue_push(g_extern.msg_queue, msg, 1, 120);
+   RARCH_LOG("%s\n", msg);
+
+   return true;
+}
+
+/* Actions without argument description take no argument. */
 static const struct cmd_action_map action_map[] = {
    { "SET_SHADER", cmd_set_shader, "<shader path>" },
+   { "BSV_SEEK",   cmd_bsv_seek,   "<frame>" },
+#if defined(HAVE_NETWORK_CMD) && defined(HAVE_NETPLAY)
+   { "NETPLAY_STATS", cmd_netplay_stats, NULL },
+#endif
 };
 
 static bool command_get_arg(const char *tok,
@@ -268,11 +316,19 @@ static bool command_get_arg(const char *tok,
       if (str == tok)
       {
          const char *argument = str + strlen(action_map[i].str);
-         if (*argument != ' ')
+
+         if (!action_map[i].arg_desc)
+         {
+            if (*argument != '\0')
+               return false;
+         }
+         else if (*argument != ' ')
             return false;
+         else
+            argument++;
 
          if (arg)
-            *arg = argument + 1;
+            *arg = argument;
 
          if (index)
             *index = i;
@@ -591,7 +647,8 @@ static bool verify_command(const char *cmd)
       RARCH_ERR("\t\t%s\n", map[i].str);
 
    for (i = 0; i < sizeof(action_map) / sizeof(action_map[0]); i++)
-      RARCH_ERR("\t\t%s %s\n", action_map[i].str, action_map[i].arg_desc);
+      RARCH_ERR("\t\t%s %s\n", action_map[i].str,
+            action_map[i].arg_desc ? action_map[i].arg_desc : "");
 
    return false;
 }
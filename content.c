@@ -29,6 +29,17 @@
 #include "hash.h"
 #include "file_extract.h"
 
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #ifdef _WIN32
 #ifdef _XBOX
 #include <xtl.h>
@@ -62,6 +73,7 @@ static void patch_content(uint8_t **buf, ssize_t *size)
    const char *patch_path = NULL;
    patch_error_t err = PATCH_UNKNOWN;
    patch_func_t func = NULL;
+   patch_size_func_t size_func = NULL;
 
    ssize_t patch_size = 0;
    void *patch_data = NULL;
@@ -83,6 +95,7 @@ static void patch_content(uint8_t **buf, ssize_t *size)
       patch_desc = "UPS";
       patch_path = g_extern.ups_name;
       func = ups_apply_patch;
+      size_func = ups_get_target_size;
    }
    else if (allow_bps && *g_extern.bps_name
          && (patch_size = read_file(g_extern.bps_name, &patch_data)) >= 0)
@@ -90,6 +103,7 @@ static void patch_content(uint8_t **buf, ssize_t *size)
       patch_desc = "BPS";
       patch_path = g_extern.bps_name;
       func = bps_apply_patch;
+      size_func = bps_get_target_size;
    }
    else if (allow_ips && *g_extern.ips_name
          && (patch_size = read_file(g_extern.ips_name, &patch_data)) >= 0)
@@ -97,6 +111,7 @@ static void patch_content(uint8_t **buf, ssize_t *size)
       patch_desc = "IPS";
       patch_path = g_extern.ips_name;
       func = ips_apply_patch;
+      size_func = ips_get_target_size;
    }
    else
    {
@@ -107,9 +122,17 @@ static void patch_content(uint8_t **buf, ssize_t *size)
    RARCH_LOG("Found %s file in \"%s\", attempting to patch ...\n",
          patch_desc, patch_path);
 
-   target_size = ret_size * 4; /* Just to be sure. */
+   err = size_func((const uint8_t*)patch_data, patch_size,
+         ret_size, &target_size);
+   if (err != PATCH_SUCCESS)
+   {
+      RARCH_ERR("Failed to patch %s: Error #%u\n", patch_desc,
+            (unsigned)err);
+      goto error;
+   }
 
-   patched_content = (uint8_t*)malloc(target_size);
+   /* One spare byte, to keep the NUL terminator read_file adds. */
+   patched_content = (uint8_t*)malloc(target_size + 1);
 
    if (!patched_content)
    {
@@ -132,9 +155,12 @@ static void patch_content(uint8_t **buf, ssize_t *size)
    if (success)
    {
       free(ret_buf);
+      patched_content[target_size] = '\0';
       *buf = patched_content;
       *size = target_size;
    }
+   else
+      free(patched_content);
 
    free(patch_data);
    return;
@@ -145,24 +171,223 @@ error:
    free(patch_data);
 }
 
+/**
+ * content_has_patch:
+ *
+ * Checks whether patch_content would find a patch to apply,
+ * following the same preferences.
+ *
+ * Returns: true if a patch file exists, otherwise false.
+ **/
+static bool content_has_patch(void)
+{
+   bool allow_bps = !g_extern.ups_pref && !g_extern.ips_pref;
+   bool allow_ups = !g_extern.bps_pref && !g_extern.ips_pref;
+   bool allow_ips = !g_extern.ups_pref && !g_extern.bps_pref;
+
+   if (g_extern.block_patch)
+      return false;
+   if (g_extern.ups_pref + g_extern.bps_pref + g_extern.ips_pref > 1)
+      return false;
+
+   return (allow_ups && *g_extern.ups_name
+         && path_file_exists(g_extern.ups_name))
+      || (allow_bps && *g_extern.bps_name
+         && path_file_exists(g_extern.bps_name))
+      || (allow_ips && *g_extern.ips_name
+         && path_file_exists(g_extern.ips_name));
+}
+
+#ifdef HAVE_MMAP
+/**
+ * content_map_file:
+ * @path         : path of the content file.
+ * @buf          : mapping of the content file.
+ *
+ * Maps the content file copy-on-write instead of reading it, so
+ * that only the pages the core touches are read from disk. Like
+ * with read_file, the data is followed by a NUL byte.
+ *
+ * Returns: size of the content file, -1 if it can't be mapped.
+ **/
+static ssize_t content_map_file(const char *path, void **buf)
+{
+   struct stat st;
+   size_t size;
+   void *base = NULL;
+   void *data = NULL;
+   int fd     = open(path, O_RDONLY);
+
+   if (fd < 0)
+      return -1;
+
+   if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size <= 0
+         || (uint64_t)st.st_size >= SSIZE_MAX)
+      goto error;
+
+   size = st.st_size;
+
+   /* Reserve one zeroed byte more than the file, which stays
+    * anonymous memory when the size is a multiple of the page size. */
+   base = mmap(NULL, size + 1, PROT_READ | PROT_WRITE,
+         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (base == MAP_FAILED)
+      goto error;
+
+   data = mmap(base, size, PROT_READ | PROT_WRITE,
+         MAP_PRIVATE | MAP_FIXED, fd, 0);
+   if (data == MAP_FAILED)
+   {
+      munmap(base, size + 1);
+      goto error;
+   }
+
+   /* Cores mostly copy the content once from start to end. */
+   madvise(data, size, MADV_SEQUENTIAL);
+
+   close(fd);
+   *buf = data;
+   return size;
+
+error:
+   close(fd);
+   return -1;
+}
+#endif
+
+/**
+ * content_read_file:
+ * @path         : path of the content file.
+ * @buf          : buffer of the content file.
+ * @mapped       : set to true when @buf is a mapping of the file.
+ *
+ * Reads a content file into memory, by mapping it where possible.
+ * Release @buf with content_free_file.
+ *
+ * Returns: size of the content file, -1 on error.
+ **/
+static ssize_t content_read_file(const char *path, void **buf,
+      bool *mapped)
+{
+   *mapped = false;
+
+#ifdef HAVE_MMAP
+   if (!path_contains_compressed_file(path))
+   {
+      ssize_t ret = content_map_file(path, buf);
+
+      if (ret >= 0)
+      {
+         *mapped = true;
+         return ret;
+      }
+   }
+#endif
+
+   return read_file(path, buf);
+}
+
+/**
+ * content_free_file:
+ * @buf          : buffer of the content file.
+ * @size         : size   of the content file.
+ * @mapped       : whether @buf is a mapping of the file.
+ *
+ * Releases content read by content_read_file.
+ **/
+static void content_free_file(void *buf, size_t size, bool mapped)
+{
+#ifdef HAVE_MMAP
+   if (mapped)
+   {
+      munmap(buf, size + 1);
+      return;
+   }
+#endif
+   (void)size;
+   (void)mapped;
+   free(buf);
+}
+
+/* Unpatched content whose CRC32 has not been computed yet,
+ * see content_get_crc. */
+static char content_crc_path[PATH_MAX_LENGTH];
+static bool content_crc_pending;
+
+/**
+ * content_get_crc:
+ *
+ * Computes the CRC32 of unpatched, mapped content the first
+ * time it is needed, so that loading does not have to read the
+ * whole file.
+ *
+ * Returns: CRC32 of the loaded content.
+ **/
+uint32_t content_get_crc(void)
+{
+   void *buf   = NULL;
+   bool mapped = false;
+   ssize_t size;
+
+   if (!content_crc_pending)
+      return g_extern.content_crc;
+
+   content_crc_pending = false;
+   size = content_read_file(content_crc_path, &buf, &mapped);
+
+   if (size < 0)
+   {
+      RARCH_ERR("Could not read content file \"%s\" for CRC32.\n",
+            content_crc_path);
+      return g_extern.content_crc;
+   }
+
+   g_extern.content_crc = crc32_calculate((const uint8_t*)buf, size);
+   RARCH_LOG("CRC32: 0x%x .\n", (unsigned)g_extern.content_crc);
+
+   content_free_file(buf, size, mapped);
+   return g_extern.content_crc;
+}
+
 /**
  * read_content_file:
- * @path         : buffer of the content file.
- * @buf          : size   of the content file.
+ * @path         : path   of the content file.
+ * @buf          : buffer of the content file.
+ * @mapped       : set to true when @buf is a mapping of the file.
  *
  * Read the content file into memory. Also performs soft patching
  * (see patch_content function) in case soft patching has not been
- * blocked by the enduser.
+ * blocked by the enduser. Content without a patch is mapped where
+ * possible, and its CRC32 is left to content_get_crc.
  *
  * Returns: size of the content file that has been read from.
  **/
-static ssize_t read_content_file(const char *path, void **buf)
+static ssize_t read_content_file(const char *path, void **buf,
+      bool *mapped)
 {
    uint8_t *ret_buf = NULL;
    ssize_t ret = -1;
 
    RARCH_LOG("Loading content file: %s.\n", path);
-   ret = read_file(path, (void**) &ret_buf);
+
+   content_crc_pending = false;
+   *mapped             = false;
+
+   if (!content_has_patch())
+   {
+      ret = content_read_file(path, (void**)&ret_buf, mapped);
+
+      if (ret > 0 && *mapped)
+      {
+         strlcpy(content_crc_path, path, sizeof(content_crc_path));
+         content_crc_pending  = true;
+         g_extern.content_crc = 0;
+         *buf = ret_buf;
+         return ret;
+      }
+   }
+   else
+      ret = read_file(path, (void**) &ret_buf);
 
    if (ret <= 0)
       return ret;
@@ -178,6 +403,250 @@ static ssize_t read_content_file(const char *path, void **buf)
    return ret;
 }
 
+/* At most this many worker threads read content and SRAM files
+ * while load_content sets up the rest. */
+#define CONTENT_LOAD_MAX_THREADS 4
+
+enum content_job_type
+{
+   CONTENT_JOB_CONTENT = 0,
+   CONTENT_JOB_FIRST_CONTENT,
+   CONTENT_JOB_RAM
+};
+
+struct content_job
+{
+   char path[PATH_MAX_LENGTH];
+   unsigned type;
+   void *data;
+   ssize_t size;
+   bool mapped;
+   bool done;
+};
+
+struct content_pipeline
+{
+   struct content_job **jobs;
+   unsigned count;
+   unsigned next;
+#ifdef HAVE_THREADS
+   slock_t *lock;
+   sthread_t *threads[CONTENT_LOAD_MAX_THREADS];
+   unsigned num_threads;
+#endif
+};
+
+/* SRAM files read ahead by load_content, see load_ram_file. */
+static struct content_job *content_ram_jobs;
+static unsigned content_ram_count;
+
+static void content_job_run(struct content_job *job)
+{
+   switch (job->type)
+   {
+      case CONTENT_JOB_FIRST_CONTENT:
+         /* First content file is significant, attempt to do patching,
+          * CRC checking, etc. */
+         job->size = read_content_file(job->path, &job->data, &job->mapped);
+         break;
+      case CONTENT_JOB_CONTENT:
+         job->size = content_read_file(job->path, &job->data, &job->mapped);
+         break;
+      case CONTENT_JOB_RAM:
+         job->size = read_file(job->path, &job->data);
+         break;
+   }
+
+   job->done = true;
+}
+
+/**
+ * content_pipeline_work:
+ * @data         : content pipeline.
+ *
+ * Runs queued jobs until the queue is empty. Runs on the
+ * worker threads, and on the caller of content_pipeline_finish.
+ **/
+static void content_pipeline_work(void *data)
+{
+   struct content_pipeline *pipeline = (struct content_pipeline*)data;
+
+   for (;;)
+   {
+      unsigned index;
+
+#ifdef HAVE_THREADS
+      if (pipeline->lock)
+         slock_lock(pipeline->lock);
+#endif
+      index = pipeline->next;
+      if (index < pipeline->count)
+         pipeline->next++;
+#ifdef HAVE_THREADS
+      if (pipeline->lock)
+         slock_unlock(pipeline->lock);
+#endif
+
+      if (index >= pipeline->count)
+         break;
+
+      content_job_run(pipeline->jobs[index]);
+   }
+}
+
+/**
+ * content_pipeline_start:
+ * @pipeline     : content pipeline with its jobs queued.
+ *
+ * Starts reading the queued files in the background. Without
+ * threads, the jobs all run in content_pipeline_finish.
+ **/
+static void content_pipeline_start(struct content_pipeline *pipeline)
+{
+#ifdef HAVE_THREADS
+   unsigned i, count = pipeline->count;
+
+   if (!count)
+      return;
+
+   if (!(pipeline->lock = slock_new()))
+      return;
+
+   if (count > CONTENT_LOAD_MAX_THREADS)
+      count = CONTENT_LOAD_MAX_THREADS;
+
+   for (i = 0; i < count; i++)
+   {
+      pipeline->threads[pipeline->num_threads] =
+         sthread_create(content_pipeline_work, pipeline);
+      if (!pipeline->threads[pipeline->num_threads])
+         break;
+      pipeline->num_threads++;
+   }
+#else
+   (void)pipeline;
+#endif
+}
+
+/**
+ * content_pipeline_finish:
+ * @pipeline     : content pipeline.
+ *
+ * Helps running the jobs left in the queue, then waits for
+ * the worker threads to finish theirs.
+ **/
+static void content_pipeline_finish(struct content_pipeline *pipeline)
+{
+#ifdef HAVE_THREADS
+   unsigned i;
+#endif
+
+   content_pipeline_work(pipeline);
+
+#ifdef HAVE_THREADS
+   for (i = 0; i < pipeline->num_threads; i++)
+      sthread_join(pipeline->threads[i]);
+   pipeline->num_threads = 0;
+
+   if (pipeline->lock)
+      slock_free(pipeline->lock);
+   pipeline->lock = NULL;
+#endif
+}
+
+static void content_pipeline_push(struct content_pipeline *pipeline,
+      struct content_job *job, const char *path, unsigned type)
+{
+   strlcpy(job->path, path, sizeof(job->path));
+   job->type = type;
+   job->size = -1;
+   pipeline->jobs[pipeline->count++] = job;
+}
+
+/**
+ * content_free_ram_jobs:
+ *
+ * Frees SRAM files read ahead that were not loaded.
+ **/
+static void content_free_ram_jobs(void)
+{
+   unsigned i;
+
+   for (i = 0; i < content_ram_count; i++)
+      free(content_ram_jobs[i].data);
+
+   free(content_ram_jobs);
+   content_ram_jobs  = NULL;
+   content_ram_count = 0;
+}
+
+/**
+ * content_queue_ram_jobs:
+ * @pipeline     : content pipeline.
+ *
+ * Queues reading the SRAM files load_ram_file will
+ * ask for once the content is loaded.
+ **/
+static void content_queue_ram_jobs(struct content_pipeline *pipeline)
+{
+   unsigned i;
+   const struct string_list *savefiles = g_extern.savefiles;
+
+   content_free_ram_jobs();
+
+   if (!savefiles || !savefiles->size || g_extern.sram_load_disable
+         || g_extern.libretro_no_content)
+      return;
+
+   content_ram_jobs = (struct content_job*)
+      calloc(savefiles->size, sizeof(*content_ram_jobs));
+   if (!content_ram_jobs)
+      return;
+
+   content_ram_count = savefiles->size;
+
+   for (i = 0; i < content_ram_count; i++)
+      content_pipeline_push(pipeline, &content_ram_jobs[i],
+            savefiles->elems[i].data, CONTENT_JOB_RAM);
+}
+
+/**
+ * content_take_ram_file:
+ * @path             : path of the SRAM file.
+ * @buf              : contents of the file, to be freed by the caller.
+ *
+ * Hands over an SRAM file read ahead by load_content.
+ *
+ * Returns: true if @path was read ahead, its size is in @size.
+ **/
+static bool content_take_ram_file(const char *path, void **buf,
+      ssize_t *size)
+{
+   unsigned i;
+
+   for (i = 0; i < content_ram_count; i++)
+   {
+      struct content_job *job = &content_ram_jobs[i];
+
+      if (!job->done || strcmp(job->path, path) != 0)
+         continue;
+
+      *buf      = job->data;
+      *size     = job->size;
+      job->data = NULL;
+      job->done = false;
+
+      for (i = 0; i < content_ram_count; i++)
+         if (content_ram_jobs[i].done)
+            return true;
+
+      content_free_ram_jobs();
+      return true;
+   }
+
+   return false;
+}
+
 /**
  * dump_to_file_desperate:
  * @data         : pointer to data buffer.
@@ -364,9 +833,14 @@ void load_ram_file(const char *path, int type)
    void *data  = pretro_get_memory_data(type);
 
    if (size == 0 || !data)
+   {
+      if (content_take_ram_file(path, &buf, &rc))
+         free(buf);
       return;
+   }
 
-   rc = read_file(path, &buf);
+   if (!content_take_ram_file(path, &buf, &rc))
+      rc = read_file(path, &buf);
 
    if (rc > 0)
    {
@@ -419,7 +893,8 @@ void save_ram_file(const char *path, int type)
  * @special          : subsystem of content to be loaded. Can be NULL.
  * content           : 
  *
- * Load content file (for libretro core).
+ * Load content file (for libretro core). Content loaded into
+ * memory and the SRAM files are read on worker threads.
  *
  * Returns : true if successful, otherwise false.
  **/
@@ -428,12 +903,22 @@ static bool load_content(const struct retro_subsystem_info *special,
 {
    unsigned i;
    bool ret = true;
+   struct content_pipeline pipeline = {0};
    struct string_list* additional_path_allocs = string_list_new();
    struct retro_game_info *info = (struct retro_game_info*)
       calloc(content->size, sizeof(*info));
+   struct content_job *jobs = (struct content_job*)
+      calloc(content->size, sizeof(*jobs));
+
+   pipeline.jobs = (struct content_job**)calloc(content->size +
+         (g_extern.savefiles ? g_extern.savefiles->size : 0),
+         sizeof(*pipeline.jobs));
 
-   if (!info)
+   if (!info || !jobs || !pipeline.jobs)
    {
+      free(info);
+      free(jobs);
+      free(pipeline.jobs);
       string_list_free(additional_path_allocs);
       return false;
    }
@@ -453,28 +938,29 @@ static bool load_content(const struct retro_subsystem_info *special,
          goto end;
       }
 
-      info[i].path = *path ? path : NULL;
-
+      /* Load the content into memory. */
       if (!need_fullpath && *path)
-      {
-         /* Load the content into memory. */
+         content_pipeline_push(&pipeline, &jobs[i], path, (i == 0) ?
+               CONTENT_JOB_FIRST_CONTENT : CONTENT_JOB_CONTENT);
+   }
 
-         /* First content file is significant, attempt to do patching,
-          * CRC checking, etc. */
-         long size = (i == 0) ?
-            read_content_file(path, (void**)&info[i].data) :
-            read_file(path, (void**)&info[i].data);
+   /* The content files and the SRAM files are read in the
+    * background while compressed content is extracted here. */
+   content_queue_ram_jobs(&pipeline);
+   content_pipeline_start(&pipeline);
 
-         if (size < 0)
-         {
-            RARCH_ERR("Could not read content file \"%s\".\n", path);
-            ret = false;
-            goto end;
-         }
+   for (i = 0; i < content->size; i++)
+   {
+      const char *path = content->elems[i].data;
+      int         attr = content->elems[i].attr.i;
 
-         info[i].size = size;
-      }
-      else
+      bool need_fullpath   = attr & 2;
+
+      /* For content loaded into memory, this may be an
+       * "archive.zip#member" path (see init_content_file()). */
+      info[i].path = *path ? path : NULL;
+
+      if (need_fullpath || !*path)
       {
          RARCH_LOG("Content loading skipped. Implementation will"
                " load it on its own.\n");
@@ -526,6 +1012,24 @@ static bool load_content(const struct retro_subsystem_info *special,
       }
    }
 
+   content_pipeline_finish(&pipeline);
+
+   for (i = 0; i < content->size; i++)
+   {
+      if (!jobs[i].done)
+         continue;
+
+      if (jobs[i].size < 0)
+      {
+         RARCH_ERR("Could not read content file \"%s\".\n", jobs[i].path);
+         ret = false;
+         goto end;
+      }
+
+      info[i].data = jobs[i].data;
+      info[i].size = jobs[i].size;
+   }
+
    if (special)
       ret = pretro_load_game_special(special->id, info, content->size);
    else
@@ -535,10 +1039,18 @@ static bool load_content(const struct retro_subsystem_info *special,
       RARCH_ERR("Failed to load content.\n");
 
 end:
+   if (!ret)
+      content_free_ram_jobs();
+
    for (i = 0; i < content->size; i++)
-      free((void*)info[i].data);
+   {
+      if (jobs[i].data)
+         content_free_file(jobs[i].data, jobs[i].size, jobs[i].mapped);
+   }
 
    string_list_free(additional_path_allocs);
+   free(pipeline.jobs);
+   free(jobs);
    if (info)
       free(info);
    return ret;
@@ -563,6 +1075,7 @@ bool init_content_file(void)
    struct string_list *content = NULL;
    const struct retro_subsystem_info *special = NULL;
 
+   content_crc_pending = false;
    g_extern.temporary_content = string_list_new();
 
    if (!g_extern.temporary_content)
@@ -653,6 +1166,27 @@ bool init_content_file(void)
          strlcpy(temporary_content, content->elems[i].data,
                sizeof(temporary_content));
 
+         /* Content loaded into memory is decompressed straight
+          * into the buffer handed to the core by load_content().
+          *
+          * The core's retro_game_info.path is then "archive.zip#member",
+          * which doesn't exist on disk, just like when that path is
+          * given on the command line. Such cores get the data itself;
+          * cores that need a real file set need_fullpath and still
+          * have the member extracted below. */
+         if (!(content->elems[i].attr.i & 2))
+         {
+            if (!zlib_find_first_content_file(temporary_content,
+                     sizeof(temporary_content), valid_ext))
+            {
+               RARCH_ERR("Failed to find content in zipped file: %s.\n",
+                     temporary_content);
+               goto error;
+            }
+            string_list_set(content, i, temporary_content);
+            continue;
+         }
+
          if (!zlib_extract_first_content_file(temporary_content,
                   sizeof(temporary_content), valid_ext,
                   *g_settings.extraction_directory ?
@@ -83,6 +83,17 @@ void save_ram_file(const char *path, int type);
  **/
 bool init_content_file(void);
 
+/**
+ * content_get_crc:
+ *
+ * Computes the CRC32 of unpatched, mapped content the first
+ * time it is needed, so that loading does not have to read the
+ * whole file.
+ *
+ * Returns: CRC32 of the loaded content.
+ **/
+uint32_t content_get_crc(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -20,13 +20,580 @@
 #include <file/file_path.h>
 #include "file_ext.h"
 #include "file_extract.h"
+#include "file_ops.h"
 #include <file/dir_list.h>
 #include "config.def.h"
 
+#include <ctype.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* Parsed .info files of every core, stored in the menu config
+ * directory, or else next to the config file. A core whose .info
+ * file has the same path, size and mtime as in the cache is not
+ * parsed again. */
+#define CORE_INFO_CACHE_FILE    "core_info.cache"
+#define CORE_INFO_CACHE_MAGIC   0x49434152 /* RACI */
+#define CORE_INFO_CACHE_VERSION 1
+
+enum core_info_cache_flags
+{
+   CORE_INFO_CACHE_HAS_INFO         = (1 << 0),
+   CORE_INFO_CACHE_SUPPORTS_NO_GAME = (1 << 1)
+};
+
+/* .info keys of the string fields, in record order. */
+static const char *core_info_string_keys[] = {
+   "display_name",
+   "corename",
+   "systemname",
+   "manufacturer",
+   "supported_extensions",
+   "authors",
+   "permissions",
+   "license",
+   "categories",
+   "database",
+   "notes",
+};
+
+static const size_t core_info_string_fields[] = {
+   offsetof(core_info_t, display_name),
+   offsetof(core_info_t, core_name),
+   offsetof(core_info_t, systemname),
+   offsetof(core_info_t, system_manufacturer),
+   offsetof(core_info_t, supported_extensions),
+   offsetof(core_info_t, authors),
+   offsetof(core_info_t, permissions),
+   offsetof(core_info_t, licenses),
+   offsetof(core_info_t, categories),
+   offsetof(core_info_t, databases),
+   offsetof(core_info_t, notes),
+};
+
+#define CORE_INFO_CACHE_STRINGS \
+   (sizeof(core_info_string_keys) / sizeof(core_info_string_keys[0]))
+
+#define CORE_INFO_STRING(info, i) \
+   (*(char**)((char*)(info) + core_info_string_fields[i]))
+
+/* On-disk layout: header, records, firmware records, then the
+ * string pool. Strings are offsets into the pool, 0 being NULL. */
+typedef struct core_info_cache_header
+{
+   uint32_t magic;
+   uint32_t version;
+   uint32_t count;
+   uint32_t firmware_count;
+   uint32_t strings_size;
+   /* Keeps the records 8-byte aligned. */
+   uint32_t padding;
+} core_info_cache_header_t;
+
+typedef struct core_info_cache_record
+{
+   uint64_t info_size;
+   int64_t info_mtime;
+   uint32_t path;
+   uint32_t info_path;
+   uint32_t strings[CORE_INFO_CACHE_STRINGS];
+   uint32_t firmware;
+   uint32_t firmware_count;
+   uint32_t flags;
+} core_info_cache_record_t;
+
+typedef struct core_info_cache_firmware
+{
+   uint32_t path;
+   uint32_t desc;
+   uint32_t optional;
+} core_info_cache_firmware_t;
+
+typedef struct core_info_cache
+{
+   char *data;
+   size_t size;
+   bool mapped;
+   const core_info_cache_record_t *records;
+   const core_info_cache_firmware_t *firmware;
+   const char *strings;
+   size_t count;
+   /* Open-addressed table of record index plus one, by core path. */
+   uint32_t *buckets;
+   size_t bucket_mask;
+} core_info_cache_t;
+
+static uint32_t core_info_hash(const char *path)
+{
+   uint32_t hash = 2166136261u;
+
+   while (*path)
+      hash = (hash ^ (uint8_t)*path++) * 16777619u;
+
+   return hash;
+}
+
+static void core_info_cache_free(core_info_cache_t *cache)
+{
+#ifdef HAVE_MMAP
+   if (cache->mapped)
+      munmap(cache->data, cache->size);
+   else
+#endif
+      free(cache->data);
+
+   free(cache->buckets);
+   memset(cache, 0, sizeof(*cache));
+}
+
+static bool core_info_cache_read(core_info_cache_t *cache, const char *path)
+{
+#ifdef HAVE_MMAP
+   struct stat st;
+   int fd = open(path, O_RDONLY);
+
+   if (fd >= 0)
+   {
+      if (fstat(fd, &st) == 0 && st.st_size > 0)
+      {
+         /* Private and writable, since core_info_t hands out
+          * char pointers into it. */
+         void *data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE, fd, 0);
+
+         if (data != MAP_FAILED)
+         {
+            cache->data   = (char*)data;
+            cache->size   = st.st_size;
+            cache->mapped = true;
+         }
+      }
+      close(fd);
+      if (cache->mapped)
+         return true;
+   }
+#endif
+
+   {
+      void *buf = NULL;
+      long len  = read_file(path, &buf);
+
+      if (len <= 0)
+      {
+         free(buf);
+         return false;
+      }
+
+      cache->data = (char*)buf;
+      cache->size = len;
+   }
+
+   return true;
+}
+
+static bool core_info_cache_string_valid(
+      const core_info_cache_header_t *header, uint32_t offset)
+{
+   return offset < header->strings_size;
+}
+
+/**
+ * core_info_cache_load:
+ * @cache               : Cache to fill.
+ * @path                : Path to the cache file.
+ *
+ * Maps the cache written by a previous core_info_list_new. An
+ * empty @path or a missing or malformed cache leaves @cache empty,
+ * so every .info file gets parsed.
+ **/
+static void core_info_cache_load(core_info_cache_t *cache, const char *path)
+{
+   size_t i, j, pos, buckets = 1;
+   core_info_cache_header_t header;
+
+   memset(cache, 0, sizeof(*cache));
+
+   if (!*path || !core_info_cache_read(cache, path))
+      return;
+
+   if (cache->size < sizeof(header))
+      goto error;
+
+   memcpy(&header, cache->data, sizeof(header));
+
+   if (header.magic != CORE_INFO_CACHE_MAGIC ||
+         header.version != CORE_INFO_CACHE_VERSION)
+      goto error;
+
+   pos = sizeof(header);
+   if ((cache->size - pos) / sizeof(*cache->records) < header.count)
+      goto error;
+   cache->records = (const core_info_cache_record_t*)(cache->data + pos);
+   pos           += header.count * sizeof(*cache->records);
+
+   if ((cache->size - pos) / sizeof(*cache->firmware) < header.firmware_count)
+      goto error;
+   cache->firmware = (const core_info_cache_firmware_t*)(cache->data + pos);
+   pos            += header.firmware_count * sizeof(*cache->firmware);
+
+   /* Every string ends before the terminating NUL of the pool. */
+   if (cache->size - pos != header.strings_size || !header.strings_size ||
+         cache->data[pos] != '\0' ||
+         cache->data[pos + header.strings_size - 1] != '\0')
+      goto error;
+   cache->strings = cache->data + pos;
+
+   for (i = 0; i < header.count; i++)
+   {
+      const core_info_cache_record_t *rec = &cache->records[i];
+
+      if (!rec->path || !core_info_cache_string_valid(&header, rec->path) ||
+            !core_info_cache_string_valid(&header, rec->info_path) ||
+            rec->firmware > header.firmware_count ||
+            header.firmware_count - rec->firmware < rec->firmware_count)
+         goto error;
+
+      for (j = 0; j < CORE_INFO_CACHE_STRINGS; j++)
+         if (!core_info_cache_string_valid(&header, rec->strings[j]))
+            goto error;
+   }
+
+   for (i = 0; i < header.firmware_count; i++)
+      if (!core_info_cache_string_valid(&header,
+               cache->firmware[i].path) ||
+            !core_info_cache_string_valid(&header,
+               cache->firmware[i].desc))
+         goto error;
+
+   cache->count = header.count;
+
+   while (buckets < cache->count * 2)
+      buckets <<= 1;
+
+   cache->buckets = (uint32_t*)calloc(buckets, sizeof(uint32_t));
+   if (!cache->buckets)
+      goto error;
+   cache->bucket_mask = buckets - 1;
+
+   for (i = 0; i < cache->count; i++)
+   {
+      uint32_t slot = core_info_hash(
+            cache->strings + cache->records[i].path);
+
+      while (cache->buckets[slot & cache->bucket_mask])
+         slot++;
+      cache->buckets[slot & cache->bucket_mask] = i + 1;
+   }
+
+   return;
+
+error:
+   RARCH_WARN("Ignoring invalid core info cache %s.\n", path);
+   core_info_cache_free(cache);
+}
+
+static const core_info_cache_record_t *core_info_cache_find(
+      const core_info_cache_t *cache, const char *path)
+{
+   uint32_t slot, index;
+
+   if (!cache->buckets)
+      return NULL;
+
+   slot = core_info_hash(path);
+   while ((index = cache->buckets[slot & cache->bucket_mask]))
+   {
+      const core_info_cache_record_t *rec = &cache->records[index - 1];
+
+      if (!strcmp(cache->strings + rec->path, path))
+         return rec;
+      slot++;
+   }
+
+   return NULL;
+}
+
+static char *core_info_cache_string(const core_info_cache_t *cache,
+      uint32_t offset)
+{
+   return offset ? (char*)cache->strings + offset : NULL;
+}
+
+/**
+ * core_info_from_cache:
+ * @info                : Core info to fill.
+ * @cache               : Loaded cache.
+ * @rec                 : Record of the core in @cache.
+ *
+ * Fills @info with strings pointing into @cache. The string lists
+ * are left to core_info_expand.
+ *
+ * Returns: true (1) on success, otherwise false (0).
+ **/
+static bool core_info_from_cache(core_info_t *info,
+      const core_info_cache_t *cache, const core_info_cache_record_t *rec)
+{
+   size_t i;
+
+   if (rec->firmware_count)
+   {
+      info->firmware = (core_info_firmware_t*)
+         calloc(rec->firmware_count, sizeof(*info->firmware));
+      if (!info->firmware)
+         return false;
+      info->firmware_count = rec->firmware_count;
+   }
+
+   for (i = 0; i < rec->firmware_count; i++)
+   {
+      const core_info_cache_firmware_t *fw =
+         &cache->firmware[rec->firmware + i];
+
+      info->firmware[i].path     = core_info_cache_string(cache, fw->path);
+      info->firmware[i].desc     = core_info_cache_string(cache, fw->desc);
+      info->firmware[i].optional = fw->optional;
+   }
+
+   for (i = 0; i < CORE_INFO_CACHE_STRINGS; i++)
+      CORE_INFO_STRING(info, i) = core_info_cache_string(cache,
+            rec->strings[i]);
+
+   info->cached           = true;
+   info->has_info         = rec->flags & CORE_INFO_CACHE_HAS_INFO;
+   info->supports_no_game = rec->flags & CORE_INFO_CACHE_SUPPORTS_NO_GAME;
+
+   return true;
+}
+
+/**
+ * core_info_from_file:
+ * @info                : Core info to fill.
+ * @info_path           : Path to the .info file of the core.
+ *
+ * Parses the .info file of a core. The string lists are left
+ * to core_info_expand.
+ **/
+static void core_info_from_file(core_info_t *info, const char *info_path)
+{
+   size_t i;
+   unsigned count = 0;
+   config_file_t *conf = config_file_new(info_path);
+
+   if (!conf)
+      return;
+
+   info->has_info = true;
+
+   for (i = 0; i < CORE_INFO_CACHE_STRINGS; i++)
+      config_get_string(conf, core_info_string_keys[i],
+            &CORE_INFO_STRING(info, i));
+
+   config_get_bool(conf, "supports_no_game", &info->supports_no_game);
+
+   if (config_get_uint(conf, "firmware_count", &count) && count)
+   {
+      info->firmware = (core_info_firmware_t*)
+         calloc(count, sizeof(*info->firmware));
+
+      if (info->firmware)
+      {
+         unsigned c;
+
+         info->firmware_count = count;
+
+         for (c = 0; c < count; c++)
+         {
+            char path_key[64], desc_key[64], opt_key[64];
+
+            snprintf(path_key, sizeof(path_key), "firmware%u_path", c);
+            snprintf(desc_key, sizeof(desc_key), "firmware%u_desc", c);
+            snprintf(opt_key, sizeof(opt_key), "firmware%u_opt", c);
+
+            config_get_string(conf, path_key, &info->firmware[c].path);
+            config_get_string(conf, desc_key, &info->firmware[c].desc);
+            config_get_bool(conf, opt_key , &info->firmware[c].optional);
+         }
+      }
+   }
+
+   config_file_free(conf);
+}
+
+typedef struct core_info_cache_writer
+{
+   char *strings;
+   size_t strings_size;
+   size_t strings_cap;
+   bool failed;
+} core_info_cache_writer_t;
+
+static uint32_t core_info_cache_add_string(core_info_cache_writer_t *writer,
+      const char *str)
+{
+   size_t len, offset;
+
+   if (!str)
+      return 0;
+
+   len = strlen(str) + 1;
+
+   if (writer->strings_size + len > writer->strings_cap)
+   {
+      size_t cap    = writer->strings_cap ? writer->strings_cap : 4096;
+      char *strings = NULL;
+
+      while (cap < writer->strings_size + len)
+         cap *= 2;
+
+      strings = (char*)realloc(writer->strings, cap);
+      if (!strings)
+      {
+         writer->failed = true;
+         return 0;
+      }
+      writer->strings     = strings;
+      writer->strings_cap = cap;
+   }
+
+   offset = writer->strings_size;
+   memcpy(writer->strings + offset, str, len);
+   writer->strings_size += len;
+   return offset;
+}
+
+/**
+ * core_info_cache_save:
+ * @list                : Core info list.
+ * @info_paths          : Path to the .info file of every core.
+ * @stats               : Stat of every .info file, NULL if it is missing.
+ * @path                : Path to the cache file.
+ *
+ * Writes the cache for @list. The file is replaced rather than
+ * rewritten, since a live core info list may still map it. The
+ * cache is only an optimization, so failing to write it is not
+ * treated as an error.
+ **/
+static void core_info_cache_save(const core_info_list_t *list,
+      char **info_paths, const struct stat **stats, const char *path)
+{
+   size_t i, j, fw_count = 0, fw_pos = 0;
+   char tmp_path[PATH_MAX_LENGTH + 4];
+   core_info_cache_header_t header;
+   core_info_cache_writer_t writer  = {0};
+   core_info_cache_record_t *records = NULL;
+   core_info_cache_firmware_t *fws  = NULL;
+   FILE *file                       = NULL;
+
+   for (i = 0; i < list->count; i++)
+      fw_count += list->list[i].firmware_count;
+
+   records = (core_info_cache_record_t*)calloc(list->count + 1,
+         sizeof(*records));
+   fws     = (core_info_cache_firmware_t*)calloc(fw_count + 1,
+         sizeof(*fws));
+
+   /* Offset 0 is the empty string, read back as NULL. */
+   core_info_cache_add_string(&writer, "");
+   if (!records || !fws)
+      goto error;
+
+   for (i = 0; i < list->count; i++)
+   {
+      const core_info_t *info       = &list->list[i];
+      core_info_cache_record_t *rec = &records[i];
+
+      rec->path      = core_info_cache_add_string(&writer, info->path);
+      rec->info_path = core_info_cache_add_string(&writer, info_paths[i]);
+
+      if (stats[i])
+      {
+         rec->info_size  = stats[i]->st_size;
+         rec->info_mtime = stats[i]->st_mtime;
+      }
+
+      for (j = 0; j < CORE_INFO_CACHE_STRINGS; j++)
+         rec->strings[j] = core_info_cache_add_string(&writer,
+               CORE_INFO_STRING(info, j));
+
+      rec->firmware       = fw_pos;
+      rec->firmware_count = info->firmware_count;
+      rec->flags          =
+         (info->has_info ? CORE_INFO_CACHE_HAS_INFO : 0) |
+         (info->supports_no_game ? CORE_INFO_CACHE_SUPPORTS_NO_GAME : 0);
+
+      for (j = 0; j < info->firmware_count; j++, fw_pos++)
+      {
+         fws[fw_pos].path     = core_info_cache_add_string(&writer,
+               info->firmware[j].path);
+         fws[fw_pos].desc     = core_info_cache_add_string(&writer,
+               info->firmware[j].desc);
+         fws[fw_pos].optional = info->firmware[j].optional;
+      }
+
+   }
+
+   if (writer.failed)
+      goto error;
+
+   header.magic          = CORE_INFO_CACHE_MAGIC;
+   header.version        = CORE_INFO_CACHE_VERSION;
+   header.count          = list->count;
+   header.firmware_count = fw_count;
+   header.strings_size   = writer.strings_size;
+   header.padding        = 0;
+
+   if ((size_t)snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path)
+         >= sizeof(tmp_path))
+      goto error;
+
+   if (!(file = fopen(tmp_path, "wb")))
+      goto error;
+
+   if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+         fwrite(records, sizeof(*records), list->count, file) != list->count ||
+         fwrite(fws, sizeof(*fws), fw_count, file) != fw_count ||
+         fwrite(writer.strings, 1, writer.strings_size, file)
+         != writer.strings_size)
+   {
+      fclose(file);
+      remove(tmp_path);
+      goto error;
+   }
+
+   fclose(file);
+
+#ifdef _WIN32
+   remove(path);
+#endif
+   if (rename(tmp_path, path) != 0)
+   {
+      remove(tmp_path);
+      goto error;
+   }
+
+   free(writer.strings);
+   free(records);
+   free(fws);
+   return;
+
+error:
+   RARCH_LOG("Could not write core info cache %s.\n", path);
+   free(writer.strings);
+   free(records);
+   free(fws);
+}
+
 static void core_info_list_resolve_all_extensions(
       core_info_list_t *core_info_list)
 {
@@ -59,64 +626,297 @@ static void core_info_list_resolve_all_extensions(
    }
 }
 
-static void core_info_list_resolve_all_firmware(
+/* Extension index: a hash table from lowercase extension to the
+ * range of cores supporting it in core_info_ext_index.ranks. Cores
+ * are numbered by rank, their position when sorted by display name,
+ * so every range comes out sorted. */
+typedef struct core_info_ext_bucket
+{
+   const char *ext;
+   uint32_t first;
+   uint32_t count;
+   /* Rank plus one of the last core added, while building. */
+   uint32_t last;
+} core_info_ext_bucket_t;
+
+struct core_info_ext_index
+{
+   char *exts;
+   core_info_ext_bucket_t *buckets;
+   size_t bucket_mask;
+   uint32_t *ranks;
+   /* Core index by rank. */
+   uint32_t *order;
+   /* Lookup state, see core_info_ext_index_collect. */
+   uint32_t *scratch;
+   uint8_t *marks;
+};
+
+static void core_info_ext_index_free(core_info_ext_index_t *index)
+{
+   if (!index)
+      return;
+
+   free(index->exts);
+   free(index->buckets);
+   free(index->ranks);
+   free(index->order);
+   free(index->scratch);
+   free(index->marks);
+   free(index);
+}
+
+static core_info_ext_bucket_t *core_info_ext_index_find(
+      core_info_ext_index_t *index, const char *ext, bool insert)
+{
+   uint32_t slot = core_info_hash(ext);
+
+   for (;; slot++)
+   {
+      core_info_ext_bucket_t *bucket =
+         &index->buckets[slot & index->bucket_mask];
+
+      if (!bucket->ext)
+         return insert ? bucket : NULL;
+      if (!strcmp(bucket->ext, ext))
+         return bucket;
+   }
+}
+
+/* Lowercases the next extension of @exts into @out, without a
+ * leading dot. Returns the rest of @exts, NULL at the end. */
+static const char *core_info_next_ext(const char *exts,
+      char *out, size_t size)
+{
+   size_t len = 0;
+
+   if (*exts == '.')
+      exts++;
+
+   for (; *exts && *exts != '|'; exts++)
+      if (len + 1 < size)
+         out[len++] = tolower((unsigned char)*exts);
+   out[len] = '\0';
+
+   return *exts ? exts + 1 : NULL;
+}
+
+/* qsort_r() is not in standard C, sadly. */
+static const core_info_t *core_info_sort_list;
+
+static int core_info_display_name_cmp(const void *a_, const void *b_)
+{
+   const core_info_t *a = &core_info_sort_list[*(const uint32_t*)a_];
+   const core_info_t *b = &core_info_sort_list[*(const uint32_t*)b_];
+
+   return strcasecmp(a->display_name, b->display_name);
+}
+
+static int core_info_rank_cmp(const void *a_, const void *b_)
+{
+   uint32_t a = *(const uint32_t*)a_;
+   uint32_t b = *(const uint32_t*)b_;
+
+   return (a > b) - (a < b);
+}
+
+/**
+ * core_info_list_resolve_ext_index:
+ * @core_info_list      : Core info list.
+ *
+ * Builds the extension index used by
+ * core_info_list_get_supported_cores.
+ **/
+static void core_info_list_resolve_ext_index(
       core_info_list_t *core_info_list)
 {
-   size_t i;
-   unsigned c;
+   size_t i, pass, exts_size = 0, exts_pos = 0, buckets = 1;
+   size_t count = core_info_list->count;
+   uint32_t total = 0;
+   core_info_ext_index_t *index = (core_info_ext_index_t*)
+      calloc(1, sizeof(*index));
 
-   if (!core_info_list)
+   if (!index)
       return;
 
-   for (i = 0; i < core_info_list->count; i++)
-   {
-      unsigned count = 0;
-      core_info_t *info = (core_info_t*)&core_info_list->list[i];
+   for (i = 0; i < count; i++)
+      if (core_info_list->list[i].supported_extensions)
+         exts_size += strlen(core_info_list->list[i].supported_extensions) + 1;
+
+   while (buckets < exts_size + 1)
+      buckets <<= 1;
+
+   index->exts        = (char*)malloc(exts_size + 1);
+   index->buckets     = (core_info_ext_bucket_t*)
+      calloc(buckets, sizeof(*index->buckets));
+   index->bucket_mask = buckets - 1;
+   index->order       = (uint32_t*)malloc((count + 1) * sizeof(uint32_t));
+   index->scratch     = (uint32_t*)malloc((count + 1) * sizeof(uint32_t));
+   index->marks       = (uint8_t*)calloc(count + 1, 1);
+   core_info_list->supported = (core_info_t*)
+      calloc(count + 1, sizeof(core_info_t));
+
+   if (!index->exts || !index->buckets || !index->order ||
+         !index->scratch || !index->marks || !core_info_list->supported)
+      goto error;
 
-      if (!info->data)
-         continue;
+   for (i = 0; i < count; i++)
+      index->order[i] = i;
 
-      if (!config_get_uint(info->data, "firmware_count", &count))
-         continue;
+   core_info_sort_list = core_info_list->list;
+   qsort(index->order, count, sizeof(*index->order),
+         core_info_display_name_cmp);
 
-      info->firmware = (core_info_firmware_t*)
-         calloc(count, sizeof(*info->firmware));
+   /* Count the cores of every extension, then lay out the ranges
+    * and fill them in rank order. */
+   for (pass = 0; pass < 2; pass++)
+   {
+      uint32_t rank;
 
-      if (!info->firmware)
-         continue;
+      if (pass == 1)
+      {
+         index->ranks = (uint32_t*)malloc((total + 1) * sizeof(uint32_t));
+         if (!index->ranks)
+            goto error;
+
+         for (i = 0, total = 0; i <= index->bucket_mask; i++)
+         {
+            core_info_ext_bucket_t *bucket = &index->buckets[i];
+
+            if (!bucket->ext)
+               continue;
+            bucket->first = total;
+            total        += bucket->count;
+            bucket->count = 0;
+            bucket->last  = 0;
+         }
+      }
 
-      for (c = 0; c < count; c++)
+      for (rank = 0; rank < count; rank++)
       {
-         char path_key[64], desc_key[64], opt_key[64];
+         const char *exts = core_info_list->list[
+            index->order[rank]].supported_extensions;
+
+         while (exts)
+         {
+            char ext[64];
+            core_info_ext_bucket_t *bucket = NULL;
+
+            exts = core_info_next_ext(exts, ext, sizeof(ext));
+            if (!*ext)
+               continue;
+
+            bucket = core_info_ext_index_find(index, ext, pass == 0);
+
+            if (!bucket->ext)
+            {
+               size_t len = strlen(ext) + 1;
+
+               bucket->ext = index->exts + exts_pos;
+               memcpy(index->exts + exts_pos, ext, len);
+               exts_pos += len;
+            }
+
+            /* The same extension listed twice by one core. */
+            if (bucket->last == rank + 1)
+               continue;
+            bucket->last = rank + 1;
+
+            if (pass == 1)
+               index->ranks[bucket->first + bucket->count] = rank;
+            else
+               total++;
+            bucket->count++;
+         }
+      }
+   }
 
-         snprintf(path_key, sizeof(path_key), "firmware%u_path", c);
-         snprintf(desc_key, sizeof(desc_key), "firmware%u_desc", c);
-         snprintf(opt_key, sizeof(opt_key), "firmware%u_opt", c);
+   core_info_list->ext_index = index;
+   return;
 
-         config_get_string(info->data, path_key, &info->firmware[c].path);
-         config_get_string(info->data, desc_key, &info->firmware[c].desc);
-         config_get_bool(info->data, opt_key , &info->firmware[c].optional);
-      }
+error:
+   free(core_info_list->supported);
+   core_info_list->supported = NULL;
+   core_info_ext_index_free(index);
+}
+
+/**
+ * core_info_ext_index_collect:
+ * @index               : Extension index.
+ * @ext                 : Extension of a file.
+ * @count               : Number of ranks already in index->scratch.
+ *
+ * Adds the ranks of the cores supporting @ext to index->scratch,
+ * skipping those already there.
+ *
+ * Returns: new number of ranks in index->scratch.
+ **/
+static size_t core_info_ext_index_collect(core_info_ext_index_t *index,
+      const char *ext, size_t count)
+{
+   uint32_t i;
+   char lower[64];
+   const core_info_ext_bucket_t *bucket = NULL;
+
+   if (!ext || strlen(ext) >= sizeof(lower))
+      return count;
+
+   core_info_next_ext(ext, lower, sizeof(lower));
+   if (!*lower || !(bucket = core_info_ext_index_find(index, lower, false)))
+      return count;
+
+   for (i = 0; i < bucket->count; i++)
+   {
+      uint32_t rank = index->ranks[bucket->first + i];
+
+      if (index->marks[rank])
+         continue;
+      index->marks[rank]     = 1;
+      index->scratch[count++] = rank;
    }
+
+   return count;
 }
 
 core_info_list_t *core_info_list_new(const char *modules_path)
 {
-   size_t i;
+   size_t i, misses = 0;
+   char cache_path[PATH_MAX_LENGTH];
+   core_info_cache_t cache;
    core_info_t *core_info = NULL;
    core_info_list_t *core_info_list = NULL;
+   char **info_paths = NULL;
+   struct stat *stats = NULL;
+   const struct stat **stats_ptrs = NULL;
+   const char *info_dir = (*g_settings.libretro_info_path) ?
+            g_settings.libretro_info_path : modules_path;
    struct string_list *contents = (struct string_list*)
       dir_list_new(modules_path, EXT_EXECUTABLES, false);
 
    if (!contents)
       return NULL;
 
+   /* The info directory is often read-only, so the cache lives
+    * next to the config instead. Without either, there is no cache. */
+   *cache_path = '\0';
+   if (*g_settings.menu_config_directory)
+      fill_pathname_join(cache_path, g_settings.menu_config_directory,
+            CORE_INFO_CACHE_FILE, sizeof(cache_path));
+   else if (*g_extern.config_path)
+      fill_pathname_resolve_relative(cache_path, g_extern.config_path,
+            CORE_INFO_CACHE_FILE, sizeof(cache_path));
+   core_info_cache_load(&cache, cache_path);
+
    core_info_list = (core_info_list_t*)calloc(1, sizeof(*core_info_list));
    if (!core_info_list)
       goto error;
 
    core_info = (core_info_t*)calloc(contents->size, sizeof(*core_info));
-   if (!core_info)
+   info_paths = (char**)calloc(contents->size + 1, sizeof(*info_paths));
+   stats = (struct stat*)calloc(contents->size + 1, sizeof(*stats));
+   stats_ptrs = (const struct stat**)calloc(contents->size + 1,
+         sizeof(*stats_ptrs));
+   if (!core_info || !info_paths || !stats || !stats_ptrs)
       goto error;
 
    core_info_list->list = core_info;
@@ -125,6 +925,7 @@ core_info_list_t *core_info_list_new(const char *modules_path)
    for (i = 0; i < contents->size; i++)
    {
       char info_path_base[PATH_MAX_LENGTH], info_path[PATH_MAX_LENGTH];
+      const core_info_cache_record_t *rec = NULL;
       core_info[i].path = strdup(contents->elems[i].data);
 
       if (!core_info[i].path)
@@ -142,87 +943,110 @@ core_info_list_t *core_info_list_new(const char *modules_path)
 
       strlcat(info_path_base, ".info", sizeof(info_path_base));
 
-      fill_pathname_join(info_path, (*g_settings.libretro_info_path) ?
-            g_settings.libretro_info_path : modules_path,
+      fill_pathname_join(info_path, info_dir,
             info_path_base, sizeof(info_path));
 
-      core_info[i].data = config_file_new(info_path);
+      info_paths[i] = strdup(info_path);
+      if (!info_paths[i])
+         break;
+
+      if (stat(info_path, &stats[i]) == 0)
+         stats_ptrs[i] = &stats[i];
 
-      if (core_info[i].data)
-      {
-         unsigned count = 0;
-         config_get_string(core_info[i].data, "display_name",
-               &core_info[i].display_name);
-         config_get_string(core_info[i].data, "corename",
-               &core_info[i].core_name);
-         config_get_string(core_info[i].data, "systemname",
-               &core_info[i].systemname);
-         config_get_string(core_info[i].data, "manufacturer",
-               &core_info[i].system_manufacturer);
-         config_get_uint(core_info[i].data, "firmware_count", &count);
-         core_info[i].firmware_count = count;
-         if (config_get_string(core_info[i].data, "supported_extensions",
-                  &core_info[i].supported_extensions) &&
-               core_info[i].supported_extensions)
-            core_info[i].supported_extensions_list =
-               string_split(core_info[i].supported_extensions, "|");
-
-         if (config_get_string(core_info[i].data, "authors",
-                  &core_info[i].authors) &&
-               core_info[i].authors)
-            core_info[i].authors_list =
-               string_split(core_info[i].authors, "|");
-
-         if (config_get_string(core_info[i].data, "permissions",
-                  &core_info[i].permissions) &&
-               core_info[i].permissions)
-            core_info[i].permissions_list =
-               string_split(core_info[i].permissions, "|");
-
-         if (config_get_string(core_info[i].data, "license",
-                  &core_info[i].licenses) &&
-               core_info[i].licenses)
-            core_info[i].licenses_list =
-               string_split(core_info[i].licenses, "|");
-
-         if (config_get_string(core_info[i].data, "categories",
-                  &core_info[i].categories) &&
-               core_info[i].categories)
-            core_info[i].categories_list =
-               string_split(core_info[i].categories, "|");
-
-         if (config_get_string(core_info[i].data, "database",
-                  &core_info[i].databases) &&
-               core_info[i].databases)
-            core_info[i].databases_list =
-               string_split(core_info[i].databases, "|");
-
-         if (config_get_string(core_info[i].data, "notes",
-                  &core_info[i].notes) &&
-               core_info[i].notes)
-            core_info[i].note_list = string_split(core_info[i].notes, "|");
-
-         config_get_bool(core_info[i].data, "supports_no_game",
-               &core_info[i].supports_no_game);
-      }
+      rec = core_info_cache_find(&cache, core_info[i].path);
+
+      if (rec && !strcmp(cache.strings + rec->info_path, info_path) &&
+            (stats_ptrs[i] ?
+             (rec->flags & CORE_INFO_CACHE_HAS_INFO) &&
+             rec->info_size == (uint64_t)stats[i].st_size &&
+             rec->info_mtime == (int64_t)stats[i].st_mtime :
+             !(rec->flags & CORE_INFO_CACHE_HAS_INFO)) &&
+            core_info_from_cache(&core_info[i], &cache, rec))
+         continue;
+
+      misses++;
+
+      if (stats_ptrs[i])
+         core_info_from_file(&core_info[i], info_path);
 
       if (!core_info[i].display_name)
          core_info[i].display_name = strdup(path_basename(core_info[i].path));
    }
 
    core_info_list_resolve_all_extensions(core_info_list);
-   core_info_list_resolve_all_firmware(core_info_list);
+   core_info_list_resolve_ext_index(core_info_list);
+
+   if (*cache_path && i == contents->size &&
+         (misses || cache.count != contents->size))
+      core_info_cache_save(core_info_list, info_paths, stats_ptrs,
+            cache_path);
+
+   /* The cached entries point into the cache. */
+   if (misses < contents->size)
+   {
+      core_info_list->cache      = cache.data;
+      core_info_list->cache_size = cache.size;
+      core_info_list->cache_mapped = cache.mapped;
+      cache.data = NULL;
+   }
+   core_info_cache_free(&cache);
 
+   for (i = 0; i < contents->size; i++)
+      free(info_paths[i]);
+   free(info_paths);
+   free(stats);
+   free(stats_ptrs);
    dir_list_free(contents);
    return core_info_list;
 
 error:
+   if (info_paths)
+   {
+      for (i = 0; i < contents->size; i++)
+         free(info_paths[i]);
+      free(info_paths);
+   }
+   free(stats);
+   free(stats_ptrs);
    if (contents)
       dir_list_free(contents);
    core_info_list_free(core_info_list);
+   core_info_cache_free(&cache);
    return NULL;
 }
 
+/**
+ * core_info_expand:
+ * @info                : Core info.
+ *
+ * Splits the '|' separated fields of @info into string lists.
+ * Core info lists only do this for the cores that get shown
+ * in detail.
+ **/
+void core_info_expand(core_info_t *info)
+{
+   if (!info || info->expanded)
+      return;
+
+   info->expanded = true;
+
+   if (info->supported_extensions)
+      info->supported_extensions_list =
+         string_split(info->supported_extensions, "|");
+   if (info->authors)
+      info->authors_list = string_split(info->authors, "|");
+   if (info->permissions)
+      info->permissions_list = string_split(info->permissions, "|");
+   if (info->licenses)
+      info->licenses_list = string_split(info->licenses, "|");
+   if (info->categories)
+      info->categories_list = string_split(info->categories, "|");
+   if (info->databases)
+      info->databases_list = string_split(info->databases, "|");
+   if (info->notes)
+      info->note_list = string_split(info->notes, "|");
+}
+
 void core_info_list_free(core_info_list_t *core_info_list)
 {
    size_t i, j;
@@ -238,34 +1062,38 @@ void core_info_list_free(core_info_list_t *core_info_list)
          continue;
 
       free(info->path);
-      free(info->systemname);
-      free(info->system_manufacturer);
-      free(info->display_name);
-      free(info->supported_extensions);
-      free(info->authors);
-      free(info->permissions);
-      free(info->licenses);
-      free(info->categories);
-      free(info->databases);
-      free(info->notes);
-      if (info->supported_extensions_list)
-         string_list_free(info->supported_extensions_list);
+      string_list_free(info->supported_extensions_list);
       string_list_free(info->authors_list);
       string_list_free(info->note_list);
       string_list_free(info->permissions_list);
       string_list_free(info->licenses_list);
       string_list_free(info->categories_list);
       string_list_free(info->databases_list);
-      config_file_free(info->data);
 
-      for (j = 0; j < info->firmware_count; j++)
+      /* Cached strings belong to the cache. */
+      if (!info->cached)
       {
-         free(info->firmware[j].path);
-         free(info->firmware[j].desc);
+         for (j = 0; j < CORE_INFO_CACHE_STRINGS; j++)
+            free(CORE_INFO_STRING(info, j));
+
+         for (j = 0; j < info->firmware_count; j++)
+         {
+            free(info->firmware[j].path);
+            free(info->firmware[j].desc);
+         }
       }
       free(info->firmware);
    }
 
+#ifdef HAVE_MMAP
+   if (core_info_list->cache_mapped)
+      munmap(core_info_list->cache, core_info_list->cache_size);
+   else
+#endif
+      free(core_info_list->cache);
+
+   core_info_ext_index_free(core_info_list->ext_index);
+   free(core_info_list->supported);
    free(core_info_list->all_ext);
    free(core_info_list->list);
    free(core_info_list);
@@ -279,7 +1107,7 @@ size_t core_info_list_num_info_files(core_info_list_t *core_info_list)
       return 0;
 
    for (i = 0; i < core_info_list->count; i++)
-      num += !!core_info_list->list[i].data;
+      num += core_info_list->list[i].has_info;
 
    return num;
 }
@@ -317,9 +1145,10 @@ bool core_info_list_get_info(core_info_list_t *core_info_list,
 
    for (i = 0; i < core_info_list->count; i++)
    {
-      const core_info_t *info = &core_info_list->list[i];
+      core_info_t *info = &core_info_list->list[i];
       if (!strcmp(path_basename(info->path), path_basename(path)))
       {
+         core_info_expand(info);
          *out_info = *info;
          return true;
       }
@@ -328,26 +1157,63 @@ bool core_info_list_get_info(core_info_list_t *core_info_list,
    return false;
 }
 
+/**
+ * core_info_find_ext:
+ * @exts                : '|' separated list of extensions.
+ * @ext                 : extension to look for.
+ *
+ * Matches like string_list_find_elem_prefix(list, ".", ext) on the
+ * split list, without having to split it.
+ *
+ * Returns: true (1) if @exts lists @ext, otherwise false (0).
+ **/
+static bool core_info_find_ext(const char *exts, const char *ext)
+{
+   size_t ext_len = strlen(ext);
+
+   while (*exts)
+   {
+      const char *end = strchr(exts, '|');
+      size_t len      = end ? (size_t)(end - exts) : strlen(exts);
+      const char *elem = exts;
+
+      if (len && *elem == '.' && len - 1 == ext_len)
+      {
+         elem++;
+         len--;
+      }
+
+      if (len == ext_len && !strncasecmp(elem, ext, len))
+         return true;
+
+      if (!end)
+         break;
+      exts = end + 1;
+   }
+
+   return false;
+}
+
 bool core_info_does_support_any_file(const core_info_t *core,
       const struct string_list *list)
 {
    size_t i;
-   if (!list || !core || !core->supported_extensions_list)
+   if (!list || !core || !core->supported_extensions)
       return false;
 
    for (i = 0; i < list->size; i++)
-      if (string_list_find_elem_prefix(core->supported_extensions_list,
-               ".", path_get_extension(list->elems[i].data)))
+      if (core_info_find_ext(core->supported_extensions,
+               path_get_extension(list->elems[i].data)))
          return true;
    return false;
 }
 
 bool core_info_does_support_file(const core_info_t *core, const char *path)
 {
-   if (!path || !core || !core->supported_extensions_list)
+   if (!path || !core || !core->supported_extensions)
       return false;
-   return string_list_find_elem_prefix(
-         core->supported_extensions_list, ".", path_get_extension(path));
+   return core_info_find_ext(core->supported_extensions,
+         path_get_extension(path));
 }
 
 const char *core_info_list_get_all_extensions(core_info_list_t *core_info_list)
@@ -357,72 +1223,51 @@ const char *core_info_list_get_all_extensions(core_info_list_t *core_info_list)
    return core_info_list->all_ext;
 }
 
-/* qsort_r() is not in standard C, sadly. */
-static const char *core_info_tmp_path;
-static const struct string_list *core_info_tmp_list;
-
-static int core_info_qsort_cmp(const void *a_, const void *b_)
-{
-   const core_info_t *a = (const core_info_t*)a_;
-   const core_info_t *b = (const core_info_t*)b_;
-   int support_a        = core_info_does_support_any_file(a, core_info_tmp_list) ||
-      core_info_does_support_file(a, core_info_tmp_path);
-   int support_b        = core_info_does_support_any_file(b, core_info_tmp_list) ||
-      core_info_does_support_file(b, core_info_tmp_path);
-
-   if (support_a != support_b)
-      return support_b - support_a;
-   return strcasecmp(a->display_name, b->display_name);
-}
-
 void core_info_list_get_supported_cores(core_info_list_t *core_info_list,
       const char *path, const core_info_t **infos, size_t *num_infos)
 {
-   struct string_list *list = NULL;
-   size_t supported = 0, i;
+   size_t i, supported = 0;
+   core_info_ext_index_t *index = NULL;
 
    if (!core_info_list)
       return;
 
-   (void)list;
-
-   core_info_tmp_path = path;
+   index = core_info_list->ext_index;
 
-#ifdef HAVE_ZLIB
-   if (!strcasecmp(path_get_extension(path), "zip"))
-      list = zlib_get_file_list(path, NULL);
-   core_info_tmp_list = list;
-#endif
+   if (index)
+   {
+      const char *ext = path_get_extension(path);
 
-   /* Let supported core come first in list so we can return 
-    * a pointer to them. */
-   qsort(core_info_list->list, core_info_list->count,
-         sizeof(core_info_t), core_info_qsort_cmp);
+      supported = core_info_ext_index_collect(index, ext, 0);
 
-   for (i = 0; i < core_info_list->count; i++, supported++)
-   {
-      const core_info_t *core = &core_info_list->list[i];
+#ifdef HAVE_ZLIB
+      /* Cores supporting any file in the archive come along. */
+      if (!strcasecmp(ext, "zip"))
+      {
+         struct string_list *list = zlib_get_file_list(path, NULL);
 
-      if (!core)
-         continue;
+         for (i = 0; list && i < list->size; i++)
+            supported = core_info_ext_index_collect(index,
+                  path_get_extension(list->elems[i].data), supported);
 
-      if (core_info_does_support_file(core, path))
-         continue;
+         string_list_free(list);
 
-#ifdef HAVE_ZLIB
-      if (core_info_does_support_any_file(core, list))
-         continue;
+         qsort(index->scratch, supported, sizeof(*index->scratch),
+               core_info_rank_cmp);
+      }
 #endif
 
-      break;
-   }
+      for (i = 0; i < supported; i++)
+      {
+         uint32_t rank = index->scratch[i];
 
-#ifdef HAVE_ZLIB
-   if (list)
-      string_list_free(list);
-#endif
+         index->marks[rank] = 0;
+         core_info_list->supported[i] =
+            core_info_list->list[index->order[rank]];
+      }
+   }
 
-   *infos = core_info_list->list;
+   *infos     = supported ? core_info_list->supported : core_info_list->list;
    *num_infos = supported;
 }
 
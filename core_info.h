@@ -38,7 +38,6 @@ typedef struct
 typedef struct
 {
    char *path;
-   config_file_t *data;
    char *display_name;
    char *core_name;
    char *system_manufacturer;
@@ -61,19 +60,38 @@ typedef struct
    core_info_firmware_t *firmware;
    size_t firmware_count;
    bool supports_no_game;
+   /* Whether the core has a .info file. */
+   bool has_info;
+   /* Strings point into the core info cache. */
+   bool cached;
+   /* The string lists are only set once expanded,
+    * see core_info_expand. */
+   bool expanded;
    void *userdata;
 } core_info_t;
 
+typedef struct core_info_ext_index core_info_ext_index_t;
+
 typedef struct
 {
    core_info_t *list;
    size_t count;
    char *all_ext;
+   /* Extension to supported cores, and the last result of
+    * core_info_list_get_supported_cores. */
+   core_info_ext_index_t *ext_index;
+   core_info_t *supported;
+   /* Core info cache the cached entries point into. */
+   char *cache;
+   size_t cache_size;
+   bool cache_mapped;
 } core_info_list_t;
 
 core_info_list_t *core_info_list_new(const char *modules_path);
 void core_info_list_free(core_info_list_t *list);
 
+void core_info_expand(core_info_t *info);
+
 size_t core_info_list_num_info_files(core_info_list_t *list);
 
 bool core_info_does_support_file(const core_info_t *info,
@@ -82,7 +100,8 @@ bool core_info_does_support_file(const core_info_t *info,
 bool core_info_does_support_any_file(const core_info_t *info,
       const struct string_list *list);
 
-/* Non-reentrant, does not allocate. Returns pointer to internal state. */
+/* Non-reentrant, does not allocate. Returns pointer to internal state,
+ * the cores supporting @path sorted by display name. */
 void core_info_list_get_supported_cores(core_info_list_t *list,
       const char *path, const core_info_t **infos, size_t *num_infos);
 
@@ -23,6 +23,14 @@
 #include <file/file_path.h>
 #include "file_ext.h"
 #include <file/dir_list.h>
+#include "performance.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -41,255 +49,990 @@ int database_open_cursor(libretrodb_t *db,
    if (error)
       return -1;
    if ((libretrodb_cursor_open(db, cur, q)) != 0)
+   {
+      if (q)
+         libretrodb_query_free(q);
       return -1;
+   }
+
+   /* The cursor holds its own reference. */
+   if (q)
+      libretrodb_query_free(q);
 
    return 0;
 }
 
-#ifdef HAVE_ZLIB
-static bool zlib_compare_crc32(const char *name, const char *valid_exts,
-      const uint8_t *cdata, unsigned cmode, uint32_t csize, uint32_t size,
+/* Files are hashed in chunks of this size so memory use
+ * does not depend on the size of the content. */
+#define DATABASE_SCAN_CHUNK_SIZE (256 * 1024)
+
+/* Results of previous scans, stored next to the databases.
+ * A file whose path, size, mtime and inode are unchanged is
+ * not hashed again. */
+#define DATABASE_SCAN_CACHE_FILE    "content_scan.cache"
+#define DATABASE_SCAN_CACHE_MAGIC   0x43534152 /* RASC */
+#define DATABASE_SCAN_CACHE_VERSION 1
+
+typedef struct database_scan_entry
+{
+   const char *path;
+   uint64_t size;
+   int64_t mtime;
+   uint64_t inode;
+   /* One CRC32 for plain files, one per member for archives. */
+   uint32_t *crcs;
+   uint32_t crc_count;
+   bool owns_crcs;
+   /* Set once the entry has been carried over to a new scan. */
+   bool used;
+} database_scan_entry_t;
+
+/* On-disk record, followed by the NUL-terminated path and the CRCs. */
+typedef struct database_scan_record
+{
+   uint32_t path_len;
+   uint32_t crc_count;
+   uint64_t size;
+   int64_t mtime;
+   uint64_t inode;
+} database_scan_record_t;
+
+typedef struct database_scan_cache
+{
+   char *data;
+   database_scan_entry_t *entries;
+   size_t count;
+   /* Open-addressed table of entry index plus one, by path. */
+   uint32_t *buckets;
+   size_t bucket_mask;
+} database_scan_cache_t;
+
+typedef struct database_scan
+{
+   struct string_list *list;
+   database_scan_entry_t *results;
+   database_scan_cache_t cache;
+   size_t next;
+   size_t done;
+#ifdef HAVE_THREADS
+   slock_t *lock;
+   scond_t *cond;
+#endif
+} database_scan_t;
+
+static uint32_t database_scan_hash(const char *path)
+{
+   uint32_t hash = 2166136261u;
+
+   while (*path)
+      hash = (hash ^ (uint8_t)*path++) * 16777619u;
+
+   return hash;
+}
+
+/**
+ * database_scan_cache_load:
+ * @cache               : Cache to fill.
+ * @path                : Path to the cache file.
+ *
+ * Reads the results of the previous scan. A missing or malformed
+ * cache leaves @cache empty, so every file gets hashed.
+ **/
+static void database_scan_cache_load(database_scan_cache_t *cache,
+      const char *path)
+{
+   size_t i, pos, size, count = 0, buckets = 1;
+   uint32_t header[3];
+   void *buf = NULL;
+   long len  = read_file(path, &buf);
+
+   memset(cache, 0, sizeof(*cache));
+
+   if (len < (long)sizeof(header))
+      goto error;
+
+   size        = len;
+   cache->data = (char*)buf;
+   memcpy(header, buf, sizeof(header));
+
+   if (header[0] != DATABASE_SCAN_CACHE_MAGIC ||
+         header[1] != DATABASE_SCAN_CACHE_VERSION ||
+         header[2] > size / sizeof(database_scan_record_t))
+      goto error;
+
+   count           = header[2];
+   cache->entries  = (database_scan_entry_t*)
+      calloc(count + 1, sizeof(*cache->entries));
+   if (!cache->entries)
+      goto error;
+
+   for (i = 0, pos = sizeof(header); i < count; i++)
+   {
+      database_scan_record_t rec;
+      database_scan_entry_t *entry = &cache->entries[i];
+
+      if (size - pos < sizeof(rec))
+         goto error;
+      memcpy(&rec, cache->data + pos, sizeof(rec));
+      pos += sizeof(rec);
+
+      if (!rec.path_len || size - pos < rec.path_len ||
+            cache->data[pos + rec.path_len - 1] != '\0')
+         goto error;
+      entry->path = cache->data + pos;
+      pos        += rec.path_len;
+
+      if ((size - pos) / sizeof(uint32_t) < rec.crc_count)
+         goto error;
+
+      entry->size      = rec.size;
+      entry->mtime     = rec.mtime;
+      entry->inode     = rec.inode;
+      entry->crc_count = rec.crc_count;
+
+      if (rec.crc_count)
+      {
+         entry->crcs = (uint32_t*)malloc(rec.crc_count * sizeof(uint32_t));
+         if (!entry->crcs)
+            goto error;
+         entry->owns_crcs = true;
+         memcpy(entry->crcs, cache->data + pos,
+               rec.crc_count * sizeof(uint32_t));
+         pos += rec.crc_count * sizeof(uint32_t);
+      }
+   }
+
+   cache->count = count;
+
+   while (buckets < count * 2)
+      buckets <<= 1;
+
+   cache->buckets = (uint32_t*)calloc(buckets, sizeof(uint32_t));
+   if (!cache->buckets)
+      goto error;
+   cache->bucket_mask = buckets - 1;
+
+   for (i = 0; i < count; i++)
+   {
+      uint32_t slot = database_scan_hash(cache->entries[i].path);
+
+      while (cache->buckets[slot & cache->bucket_mask])
+         slot++;
+      cache->buckets[slot & cache->bucket_mask] = i + 1;
+   }
+
+   RARCH_LOG("Loaded %u cached scan results.\n", (unsigned)count);
+   return;
+
+error:
+   if (cache->entries)
+   {
+      for (i = 0; i < count; i++)
+         if (cache->entries[i].owns_crcs)
+            free(cache->entries[i].crcs);
+   }
+   free(cache->entries);
+   free(buf);
+   if (len >= 0)
+      RARCH_WARN("Ignoring invalid scan cache %s.\n", path);
+   memset(cache, 0, sizeof(*cache));
+}
+
+static database_scan_entry_t *database_scan_cache_find(
+      database_scan_cache_t *cache, const char *path)
+{
+   uint32_t slot, index;
+
+   if (!cache->buckets)
+      return NULL;
+
+   slot = database_scan_hash(path);
+   while ((index = cache->buckets[slot & cache->bucket_mask]))
+   {
+      if (!strcmp(cache->entries[index - 1].path, path))
+         return &cache->entries[index - 1];
+      slot++;
+   }
+
+   return NULL;
+}
+
+static void database_scan_cache_free(database_scan_cache_t *cache)
+{
+   size_t i;
+
+   for (i = 0; i < cache->count; i++)
+      if (cache->entries[i].owns_crcs)
+         free(cache->entries[i].crcs);
+
+   free(cache->entries);
+   free(cache->buckets);
+   free(cache->data);
+   memset(cache, 0, sizeof(*cache));
+}
+
+static bool database_scan_cache_write_entry(FILE *file,
+      const database_scan_entry_t *entry)
+{
+   database_scan_record_t rec;
+
+   rec.path_len  = strlen(entry->path) + 1;
+   rec.crc_count = entry->crc_count;
+   rec.size      = entry->size;
+   rec.mtime     = entry->mtime;
+   rec.inode     = entry->inode;
+
+   return fwrite(&rec, sizeof(rec), 1, file) == 1 &&
+      fwrite(entry->path, rec.path_len, 1, file) == 1 &&
+      fwrite(entry->crcs, sizeof(uint32_t), rec.crc_count, file)
+      == rec.crc_count;
+}
+
+static bool database_scan_char_is_slash(char c)
+{
+#ifdef _WIN32
+   return (c == '/') || (c == '\\');
+#else
+   return (c == '/');
+#endif
+}
+
+/**
+ * database_scan_path_in_dir:
+ * @path                : Path of a cached file.
+ * @dir                 : Scanned directory.
+ * @dir_len             : Length of @dir.
+ *
+ * Checks whether @path names a file directly inside @dir, which
+ * is what a (non-recursive) scan of @dir lists. Siblings sharing
+ * a prefix, such as /roms/snes2 for /roms/snes, and files in
+ * subdirectories don't match.
+ *
+ * Returns: true (1) if @path is in @dir, otherwise false (0).
+ **/
+static bool database_scan_path_in_dir(const char *path,
+      const char *dir, size_t dir_len)
+{
+   if (strncmp(path, dir, dir_len) != 0)
+      return false;
+
+   path += dir_len;
+   if (!dir_len || !database_scan_char_is_slash(dir[dir_len - 1]))
+   {
+      if (!database_scan_char_is_slash(*path))
+         return false;
+      path++;
+   }
+
+   for (; *path; path++)
+      if (database_scan_char_is_slash(*path))
+         return false;
+
+   return true;
+}
+
+/**
+ * database_scan_cache_save:
+ * @scan                : Finished scan.
+ * @dir                 : Directory that was scanned.
+ * @path                : Path to the cache file.
+ *
+ * Writes the results of @scan, together with the cached results of
+ * files outside @dir. Cached files under @dir that were not part of
+ * the scan no longer exist and are dropped.
+ **/
+static void database_scan_cache_save(database_scan_t *scan,
+      const char *dir, const char *path)
+{
+   size_t i;
+   uint32_t header[3];
+   size_t dir_len = strlen(dir);
+   FILE *file     = fopen(path, "wb");
+
+   if (!file)
+   {
+      RARCH_WARN("Could not write scan cache %s.\n", path);
+      return;
+   }
+
+   header[0] = DATABASE_SCAN_CACHE_MAGIC;
+   header[1] = DATABASE_SCAN_CACHE_VERSION;
+   header[2] = 0;
+
+   if (fwrite(header, sizeof(header), 1, file) != 1)
+      goto error;
+
+   for (i = 0; i < scan->list->size; i++)
+   {
+      if (!scan->results[i].path)
+         continue;
+      if (!database_scan_cache_write_entry(file, &scan->results[i]))
+         goto error;
+      header[2]++;
+   }
+
+   for (i = 0; i < scan->cache.count; i++)
+   {
+      const database_scan_entry_t *entry = &scan->cache.entries[i];
+
+      if (entry->used ||
+            database_scan_path_in_dir(entry->path, dir, dir_len))
+         continue;
+      if (!database_scan_cache_write_entry(file, entry))
+         goto error;
+      header[2]++;
+   }
+
+   if (fseek(file, 0, SEEK_SET) != 0 ||
+         fwrite(header, sizeof(header), 1, file) != 1)
+      goto error;
+
+   fclose(file);
+   return;
+
+error:
+   RARCH_WARN("Could not write scan cache %s.\n", path);
+   fclose(file);
+   remove(path);
+}
+
+#ifdef HAVE_COMPRESSION
+static bool database_info_archive_crc32(const char *name, uint64_t size,
       uint32_t crc32, void *userdata)
 {
-   RARCH_LOG("CRC32: 0x%x\n", crc32);
+   database_scan_entry_t *entry = (database_scan_entry_t*)userdata;
+   uint32_t *crcs = (uint32_t*)realloc(entry->crcs,
+         (entry->crc_count + 1) * sizeof(uint32_t));
+
+   RARCH_LOG("[Archive]: member: %s, CRC32: 0x%x\n", name, (unsigned)crc32);
+
+   if (!crcs)
+      return false;
+
+   entry->crcs = crcs;
+   entry->crcs[entry->crc_count++] = crc32;
+   return true;
+}
+#endif
+
+/**
+ * database_info_crc_file:
+ * @path                : Path to file.
+ * @buf                 : Scratch buffer of DATABASE_SCAN_CHUNK_SIZE bytes.
+ * @crc                 : CRC32 of the file.
+ *
+ * Streams @path through crc32_update() in fixed-size chunks.
+ *
+ * Returns: true (1) if successful, otherwise false (0).
+ **/
+static bool database_info_crc_file(const char *path, uint8_t *buf,
+      uint32_t *crc)
+{
+   size_t len;
+   FILE *file = fopen(path, "rb");
+
+   if (!file)
+      return false;
+
+   *crc = 0;
+   while ((len = fread(buf, 1, DATABASE_SCAN_CHUNK_SIZE, file)) > 0)
+      *crc = crc32_update(*crc, buf, len);
+
+   if (ferror(file))
+   {
+      fclose(file);
+      return false;
+   }
+
+   fclose(file);
+   return true;
+}
+
+static bool database_info_stat(const char *path,
+      database_scan_entry_t *entry)
+{
+   struct stat st;
+
+   if (stat(path, &st) != 0)
+      return false;
 
+   entry->size  = st.st_size;
+   entry->mtime = st.st_mtime;
+   entry->inode = st.st_ino;
    return true;
 }
+
+/**
+ * database_info_scan_entry:
+ * @scan                : Scan state.
+ * @i                   : Index of the file in the scan list.
+ * @buf                 : Scratch buffer of DATABASE_SCAN_CHUNK_SIZE bytes.
+ *
+ * Hashes one file of the scan, or takes its CRCs from the cache
+ * if the file is unchanged since they were computed.
+ **/
+static void database_info_scan_entry(database_scan_t *scan, size_t i,
+      uint8_t *buf)
+{
+   const char *name               = scan->list->elems[i].data;
+   database_scan_entry_t *result  = &scan->results[i];
+   database_scan_entry_t *cached  = NULL;
+
+   if (!database_info_stat(name, result))
+      return;
+
+   cached = database_scan_cache_find(&scan->cache, name);
+   if (cached && cached->size == result->size &&
+         cached->mtime == result->mtime && cached->inode == result->inode)
+   {
+      /* Paths are unique within a scan, so no other thread
+       * touches this entry. */
+      cached->used      = true;
+      result->crcs      = cached->crcs;
+      result->crc_count = cached->crc_count;
+      result->path      = name;
+
+      if (result->crc_count)
+         RARCH_LOG("name: %s, CRC32: 0x%x (cached).\n", name,
+               (unsigned)result->crcs[0]);
+      return;
+   }
+
+   result->owns_crcs = true;
+
+#ifdef HAVE_COMPRESSION
+   if (path_is_compressed_file(name))
+   {
+      RARCH_LOG("[Archive]: name: %s\n", name);
+
+      /* Archive members are identified by the CRCs in the
+       * archive headers, without decompressing them. */
+      if (!compressed_file_get_crc32s(name,
+               database_info_archive_crc32, result))
+      {
+         RARCH_LOG("Could not process archive.\n");
+         return;
+      }
+   }
+   else
 #endif
+   {
+      uint32_t crc;
+
+      if (!database_info_crc_file(name, buf, &crc))
+         return;
 
+      RARCH_LOG("name: %s, CRC32: 0x%x .\n", name, (unsigned)crc);
+
+      result->crcs = (uint32_t*)malloc(sizeof(uint32_t));
+      if (!result->crcs)
+         return;
+      result->crcs[0]   = crc;
+      result->crc_count = 1;
+   }
+
+   result->path = name;
+}
+
+/**
+ * database_info_scan_worker:
+ * @data                : Scan state.
+ *
+ * Hashes entries of the scan list until none are left. Runs on
+ * every thread of the scan pool.
+ **/
+static void database_info_scan_worker(void *data)
+{
+   database_scan_t *scan = (database_scan_t*)data;
+   uint8_t *buf = (uint8_t*)malloc(DATABASE_SCAN_CHUNK_SIZE);
+
+   for (;;)
+   {
+      size_t i;
+      const char *name = NULL;
+
+#ifdef HAVE_THREADS
+      slock_lock(scan->lock);
+#endif
+      i = scan->next++;
+#ifdef HAVE_THREADS
+      slock_unlock(scan->lock);
+#endif
+
+      if (i >= scan->list->size)
+         break;
+
+      name = scan->list->elems[i].data;
+      if (name && buf)
+         database_info_scan_entry(scan, i, buf);
+
+#ifdef HAVE_THREADS
+      slock_lock(scan->lock);
+      scan->done++;
+      scond_signal(scan->cond);
+      slock_unlock(scan->lock);
+#else
+      scan->done++;
+#endif
+   }
+
+   free(buf);
+}
+
+/**
+ * database_info_scan_progress:
+ * @scan                : Scan state.
+ *
+ * Logs how many files of @scan have been hashed. The scan blocks
+ * the main loop, so nothing would draw an OSD message before it
+ * ends; progress is only reported to the log.
+ **/
+static void database_info_scan_progress(database_scan_t *scan)
+{
+   RARCH_LOG("Scanning content: %u/%u\n",
+         (unsigned)scan->done, (unsigned)scan->list->size);
+}
+
+/**
+ * database_info_write_rdl:
+ * @dir                 : Content directory to scan.
+ *
+ * Hashes the content in @dir on a thread pool, reusing the scan
+ * cache for files that did not change. Runs synchronously on the
+ * calling thread, reporting progress to the log.
+ *
+ * Returns: 0 if successful, otherwise -1.
+ **/
 int database_info_write_rdl(const char *dir)
 {
-   size_t i;
-   const char *exts = "";
-   struct string_list *str_list = NULL;
+   database_scan_t scan;
+   size_t j;
+   const char *exts = NULL;
+   char cache_path[PATH_MAX_LENGTH] = {0};
+#ifdef HAVE_THREADS
+   unsigned i, threads;
+   sthread_t **pool = NULL;
+   retro_time_t last_progress = 0;
+#endif
 
    if (g_extern.core_info)
       exts = core_info_list_get_all_extensions(g_extern.core_info);
-   
-   str_list = (struct string_list*)dir_list_new(dir, exts, false);
 
-   if (!str_list)
+   memset(&scan, 0, sizeof(scan));
+   scan.list = (struct string_list*)dir_list_new(dir, exts, false);
+
+   if (!scan.list)
       return -1;
 
-   for (i = 0; i < str_list->size; i++)
+   scan.results = (database_scan_entry_t*)
+      calloc(scan.list->size + 1, sizeof(*scan.results));
+   if (!scan.results)
    {
-      char parent_dir[PATH_MAX_LENGTH];
-      const char *name = str_list->elems[i].data;
-      if (!name)
-         continue;
+      string_list_free(scan.list);
+      return -1;
+   }
 
-      path_parent_dir(parent_dir);
+   if (*g_settings.content_database)
+   {
+      fill_pathname_join(cache_path, g_settings.content_database,
+            DATABASE_SCAN_CACHE_FILE, sizeof(cache_path));
+      database_scan_cache_load(&scan.cache, cache_path);
+   }
 
-#ifdef HAVE_ZLIB
-      if (!strcmp(path_get_extension(name), "zip"))
-      {
-         RARCH_LOG("[ZIP]: name: %s\n", name);
+#ifdef HAVE_THREADS
+   threads = rarch_get_cpu_cores();
+   if (threads > scan.list->size)
+      threads = scan.list->size;
+   if (threads < 1)
+      threads = 1;
 
-         if (!zlib_parse_file(name, NULL, zlib_compare_crc32,
-                  (void*)parent_dir))
-            RARCH_LOG("Could not process ZIP file.\n");
-      }
-      else
-#endif
-      {
-         ssize_t ret;
-         uint32_t crc, target_crc = 0;
-         uint8_t *ret_buf = NULL;
+   scan.lock = slock_new();
+   scan.cond = scond_new();
+   pool      = (sthread_t**)calloc(threads, sizeof(*pool));
 
-         (void)target_crc;
+   if (scan.lock && scan.cond && pool)
+   {
+      RARCH_LOG("Scanning %u files on %u threads.\n",
+            (unsigned)scan.list->size, threads);
 
-         RARCH_LOG("name: %s\n", name);
-         ret = read_file(name, (void**)&ret_buf);
+      for (i = 0; i < threads; i++)
+         pool[i] = sthread_create(database_info_scan_worker, &scan);
 
-         if (ret <= 0)
-            continue;
+      slock_lock(scan.lock);
+      while (scan.done < scan.list->size)
+      {
+         retro_time_t now;
 
-         crc = crc32_calculate(ret_buf, ret);
+         if (!pool[0])
+         {
+            /* No worker could be started, hash on this thread. */
+            slock_unlock(scan.lock);
+            database_info_scan_worker(&scan);
+            slock_lock(scan.lock);
+            break;
+         }
 
-         RARCH_LOG("CRC32: 0x%x .\n", (unsigned)crc);
+         scond_wait(scan.cond, scan.lock);
 
-         if (ret_buf)
-            free(ret_buf);
+         now = rarch_get_time_usec();
+         if (now - last_progress >= 1000000)
+         {
+            last_progress = now;
+            database_info_scan_progress(&scan);
+         }
       }
+      slock_unlock(scan.lock);
+
+      for (i = 0; i < threads; i++)
+         if (pool[i])
+            sthread_join(pool[i]);
    }
+   else
+      database_info_scan_worker(&scan);
+
+   free(pool);
+   if (scan.cond)
+      scond_free(scan.cond);
+   if (scan.lock)
+      slock_free(scan.lock);
+#else
+   database_info_scan_worker(&scan);
+#endif
+
+   database_info_scan_progress(&scan);
 
-   string_list_free(str_list);
+   if (*cache_path)
+      database_scan_cache_save(&scan, dir, cache_path);
+
+   for (j = 0; j < scan.list->size; j++)
+      if (scan.results[j].owns_crcs)
+         free(scan.results[j].crcs);
+   free(scan.results);
+   database_scan_cache_free(&scan.cache);
+   string_list_free(scan.list);
 
    return 0;
 }
 
-database_info_list_t *database_info_list_new(const char *rdb_path, const char *query)
+enum database_info_column_type
 {
-   libretrodb_t db;
-   libretrodb_cursor_t cur;
-   struct rmsgpack_dom_value item;
-   size_t i = 0, j;
-   database_info_t *database_info = NULL;
-   database_info_list_t *database_info_list = NULL;
+   DATABASE_INFO_TYPE_STRING = 0,
+   DATABASE_INFO_TYPE_HEX,
+   DATABASE_INFO_TYPE_UINT,
+   DATABASE_INFO_TYPE_INT
+};
 
-   if ((libretrodb_open(rdb_path, &db)) != 0)
-      return NULL;
-   if ((database_open_cursor(&db, &cur, query) != 0))
-      return NULL;
+struct database_info_column_desc
+{
+   const char *key;
+   unsigned type;
+   size_t offset;
+};
+
+/* Indexed by enum database_info_column. */
+static const struct database_info_column_desc database_info_columns[] = {
+   { "name",           DATABASE_INFO_TYPE_STRING, offsetof(database_info_t, name) },
+   { "description",    DATABASE_INFO_TYPE_STRING, offsetof(database_info_t, description) },
+   { "publisher",      DATABASE_INFO_TYPE_STRING, offsetof(database_info_t, publisher) },
+   { "developer",      DATABASE_INFO_TYPE_STRING, offsetof(database_info_t, developer) },
+   { "origin",         DATABASE_INFO_TYPE_STRING, offsetof(database_info_t, origin) },
+   { "franchise",      DATABASE_INFO_TYPE_STRING, offsetof(database_info_t, franchise) },
+   { "edge_review",    DATABASE_INFO_TYPE_STRING, offsetof(database_info_t, edge_magazine_review) },
+   { "bbfc_rating",    DATABASE_INFO_TYPE_STRING, offsetof(database_info_t, bbfc_rating) },
+   { "elspa_rating",   DATABASE_INFO_TYPE_STRING, offsetof(database_info_t, elspa_rating) },
+   { "esrb_rating",    DATABASE_INFO_TYPE_STRING, offsetof(database_info_t, esrb_rating) },
+   { "pegi_rating",    DATABASE_INFO_TYPE_STRING, offsetof(database_info_t, pegi_rating) },
+   { "cero_rating",    DATABASE_INFO_TYPE_STRING, offsetof(database_info_t, cero_rating) },
+   { "enhancement_hw", DATABASE_INFO_TYPE_STRING, offsetof(database_info_t, enhancement_hw) },
+   { "crc",            DATABASE_INFO_TYPE_HEX,    offsetof(database_info_t, crc32) },
+   { "sha1",           DATABASE_INFO_TYPE_HEX,    offsetof(database_info_t, sha1) },
+   { "md5",            DATABASE_INFO_TYPE_HEX,    offsetof(database_info_t, md5) },
+   { "famitsu_rating", DATABASE_INFO_TYPE_UINT,   offsetof(database_info_t, famitsu_magazine_rating) },
+   { "edge_rating",    DATABASE_INFO_TYPE_UINT,   offsetof(database_info_t, edge_magazine_rating) },
+   { "edge_issue",     DATABASE_INFO_TYPE_UINT,   offsetof(database_info_t, edge_magazine_issue) },
+   { "users",          DATABASE_INFO_TYPE_UINT,   offsetof(database_info_t, max_users) },
+   { "releasemonth",   DATABASE_INFO_TYPE_UINT,   offsetof(database_info_t, releasemonth) },
+   { "releaseyear",    DATABASE_INFO_TYPE_UINT,   offsetof(database_info_t, releaseyear) },
+   { "analog",         DATABASE_INFO_TYPE_INT,    offsetof(database_info_t, analog_supported) },
+   { "rumble",         DATABASE_INFO_TYPE_INT,    offsetof(database_info_t, rumble_supported) },
+};
+
+/* Open-addressed table from key name to column, holding only the
+ * requested columns so that every other key misses after a probe. */
+#define DATABASE_INFO_KEY_SLOTS 64
+
+struct database_info_keys
+{
+   uint8_t slots[DATABASE_INFO_KEY_SLOTS];
+};
 
-   database_info_list = (database_info_list_t*)calloc(1, sizeof(*database_info_list));
-   if (!database_info_list)
-      goto error;
+static uint32_t database_info_key_hash(const char *str, size_t len)
+{
+   uint32_t hash = 2166136261u;
+   size_t i;
+
+   for (i = 0; i < len; i++)
+      hash = (hash ^ (uint8_t)str[i]) * 16777619u;
+
+   return hash;
+}
+
+static void database_info_keys_init(struct database_info_keys *keys,
+      uint32_t columns)
+{
+   unsigned col;
 
-   while (libretrodb_cursor_read_item(&cur, &item) == 0)
+   memset(keys, 0, sizeof(*keys));
+
+   for (col = 0; col < DATABASE_INFO_COLUMN_LAST; col++)
    {
-      database_info_t *db_info = NULL;
-      if (item.type != RDT_MAP)
+      const char *key = database_info_columns[col].key;
+      uint32_t slot;
+
+      if (!(columns & DATABASE_INFO_COLUMN(col)))
          continue;
 
-      database_info = (database_info_t*)realloc(database_info, (i+1) * sizeof(database_info_t));
+      slot = database_info_key_hash(key, strlen(key));
+      while (keys->slots[slot % DATABASE_INFO_KEY_SLOTS])
+         slot++;
+      /* Slots store the column plus one, zero meaning empty. */
+      keys->slots[slot % DATABASE_INFO_KEY_SLOTS] = col + 1;
+   }
+}
 
-      if (!database_info)
-         goto error;
+/* Returns the column for @key, or -1 if it was not requested. */
+static int database_info_keys_find(const struct database_info_keys *keys,
+      const struct rmsgpack_dom_value *key)
+{
+   uint32_t slot = database_info_key_hash(key->string.buff, key->string.len);
+   unsigned col;
 
-      db_info = (database_info_t*)&database_info[i];
+   while ((col = keys->slots[slot % DATABASE_INFO_KEY_SLOTS]))
+   {
+      const char *name = database_info_columns[col - 1].key;
 
-      db_info->name                   = NULL;
-      db_info->description            = NULL;
-      db_info->publisher              = NULL;
-      db_info->developer              = NULL;
-      db_info->origin                 = NULL;
-      db_info->franchise              = NULL;
-      db_info->bbfc_rating            = NULL;
-      db_info->elspa_rating           = NULL;
-      db_info->esrb_rating            = NULL;
-      db_info->pegi_rating            = NULL;
-      db_info->cero_rating            = NULL;
-      db_info->edge_magazine_review   = NULL;
-      db_info->enhancement_hw         = NULL;
-      db_info->crc32                  = NULL;
-      db_info->sha1                   = NULL;
-      db_info->md5                    = NULL;
-      db_info->famitsu_magazine_rating= 0;
-      db_info->edge_magazine_rating   = 0;
-      db_info->edge_magazine_issue    = 0;
-      db_info->max_users              = 0;
-      db_info->releasemonth           = 0;
-      db_info->releaseyear            = 0;
-      db_info->analog_supported       = -1;
-      db_info->rumble_supported       = -1;
+      if (strlen(name) == key->string.len
+            && !memcmp(name, key->string.buff, key->string.len))
+         return col - 1;
+      slot++;
+   }
 
-      for (j = 0; j < item.map.len; j++)
-      {
-         struct rmsgpack_dom_value *key = &item.map.items[j].key;
-         struct rmsgpack_dom_value *val = &item.map.items[j].value;
+   return -1;
+}
 
-         if (!strcmp(key->string.buff, "name"))
-            db_info->name = strdup(val->string.buff);
+/* Strings of a list are bump-allocated from a chain of blocks
+ * that is released at once by database_info_list_free(). */
+#define DATABASE_INFO_ARENA_BLOCK (64 * 1024)
 
-         if (!strcmp(key->string.buff, "description"))
-            db_info->description = strdup(val->string.buff);
+struct database_info_arena
+{
+   struct database_info_arena *next;
+   size_t used;
+   size_t size;
+};
 
-         if (!strcmp(key->string.buff, "publisher"))
-            db_info->publisher = strdup(val->string.buff);
+static char *database_info_arena_alloc(database_info_list_t *list,
+      size_t len)
+{
+   struct database_info_arena *block =
+      (struct database_info_arena*)list->arena;
 
-         if (!strcmp(key->string.buff, "developer"))
-            db_info->developer = strdup(val->string.buff);
+   if (!block || block->size - block->used < len)
+   {
+      size_t size = len > DATABASE_INFO_ARENA_BLOCK ?
+         len : DATABASE_INFO_ARENA_BLOCK;
 
-         if (!strcmp(key->string.buff, "origin"))
-            db_info->origin = strdup(val->string.buff);
+      block = (struct database_info_arena*)malloc(sizeof(*block) + size);
+      if (!block)
+         return NULL;
 
-         if (!strcmp(key->string.buff, "franchise"))
-            db_info->franchise = strdup(val->string.buff);
+      block->next = (struct database_info_arena*)list->arena;
+      block->used = 0;
+      block->size = size;
+      list->arena = block;
+   }
 
-         if (!strcmp(key->string.buff, "bbfc_rating"))
-            db_info->bbfc_rating = strdup(val->string.buff);
+   block->used += len;
+   return (char*)(block + 1) + block->used - len;
+}
 
-         if (!strcmp(key->string.buff, "esrb_rating"))
-            db_info->esrb_rating = strdup(val->string.buff);
+/* Strings of mapped items point into the database and are
+ * not NUL-terminated, so copy them out by length. */
+static char *database_info_strdup(database_info_list_t *list,
+      const struct rmsgpack_dom_value *val)
+{
+   char *str;
 
-         if (!strcmp(key->string.buff, "elspa_rating"))
-            db_info->elspa_rating = strdup(val->string.buff);
+   if (val->type != RDT_STRING)
+      return NULL;
 
-         if (!strcmp(key->string.buff, "cero_rating"))
-            db_info->cero_rating = strdup(val->string.buff);
+   str = database_info_arena_alloc(list, val->string.len + 1);
+   if (!str)
+      return NULL;
 
-         if (!strcmp(key->string.buff, "pegi_rating"))
-            db_info->pegi_rating = strdup(val->string.buff);
+   memcpy(str, val->string.buff, val->string.len);
+   str[val->string.len] = '\0';
+   return str;
+}
 
-         if (!strcmp(key->string.buff, "enhancement_hw"))
-            db_info->enhancement_hw = strdup(val->string.buff);
+static char *database_info_hexdup(database_info_list_t *list,
+      const struct rmsgpack_dom_value *val)
+{
+   static const char hex[] = "0123456789ABCDEF";
+   unsigned i;
+   char *str;
 
-         if (!strcmp(key->string.buff, "edge_review"))
-            db_info->edge_magazine_review = strdup(val->string.buff);
+   if (val->type != RDT_BINARY)
+      return NULL;
 
-         if (!strcmp(key->string.buff, "edge_rating"))
-            db_info->edge_magazine_rating = val->uint_;
+   str = database_info_arena_alloc(list, val->binary.len * 2 + 1);
+   if (!str)
+      return NULL;
 
-         if (!strcmp(key->string.buff, "edge_issue"))
-            db_info->edge_magazine_issue = val->uint_;
+   for (i = 0; i < val->binary.len; i++)
+   {
+      str[i * 2]     = hex[((uint8_t)val->binary.buff[i]) >> 4];
+      str[i * 2 + 1] = hex[((uint8_t)val->binary.buff[i]) & 0xf];
+   }
+   str[i * 2] = '\0';
+   return str;
+}
 
-         if (!strcmp(key->string.buff, "famitsu_rating"))
-            db_info->famitsu_magazine_rating = val->uint_;
+/**
+ * database_info_fill:
+ * @list                : List owning the entry's strings.
+ * @db_info             : Entry to fill.
+ * @keys                : Requested columns, by key name.
+ * @item                : Item read from the database.
+ *
+ * Materializes the requested fields of @item;
+ * everything else is skipped without being copied.
+ **/
+static void database_info_fill(database_info_list_t *list,
+      database_info_t *db_info, const struct database_info_keys *keys,
+      const struct rmsgpack_dom_value *item)
+{
+   size_t j;
 
-         if (!strcmp(key->string.buff, "users"))
-            db_info->max_users = val->uint_;
+   for (j = 0; j < item->map.len; j++)
+   {
+      const struct rmsgpack_dom_value *key = &item->map.items[j].key;
+      const struct rmsgpack_dom_value *val = &item->map.items[j].value;
+      const struct database_info_column_desc *desc;
+      char *field;
+      int col;
 
-         if (!strcmp(key->string.buff, "releasemonth"))
-            db_info->releasemonth = val->uint_;
+      if (key->type != RDT_STRING)
+         continue;
 
-         if (!strcmp(key->string.buff, "releaseyear"))
-            db_info->releaseyear = val->uint_;
+      if ((col = database_info_keys_find(keys, key)) < 0)
+         continue;
 
-         if (!strcmp(key->string.buff, "rumble"))
-            db_info->rumble_supported = val->uint_;
+      desc  = &database_info_columns[col];
+      field = (char*)db_info + desc->offset;
 
-         if (!strcmp(key->string.buff, "analog"))
-            db_info->analog_supported = val->uint_;
+      switch (desc->type)
+      {
+         case DATABASE_INFO_TYPE_STRING:
+            *(char**)field = database_info_strdup(list, val);
+            break;
+         case DATABASE_INFO_TYPE_HEX:
+            *(char**)field = database_info_hexdup(list, val);
+            break;
+         case DATABASE_INFO_TYPE_UINT:
+            *(unsigned*)field = val->uint_;
+            break;
+         case DATABASE_INFO_TYPE_INT:
+            *(int*)field = val->uint_;
+            break;
+      }
+   }
+}
 
-         if (!strcmp(key->string.buff, "crc"))
-         {
-            unsigned i;
-            char crc32[PATH_MAX_LENGTH];
-
-            for (i = 0; i < val->binary.len; i++)
-            {
-               char crc32_cat[PATH_MAX_LENGTH];
-               snprintf(crc32_cat, sizeof(crc32_cat), "%02X", (unsigned char)val->binary.buff[i]);
-               strlcat(crc32, crc32_cat, sizeof(crc32));
-            }
-            db_info->crc32 = strdup(crc32);
-         }
+database_info_list_t *database_info_list_new(const char *rdb_path, const char *query)
+{
+   return database_info_list_new_columns(rdb_path, query,
+         DATABASE_INFO_COLUMNS_ALL);
+}
 
-         if (!strcmp(key->string.buff, "sha1"))
-         {
-            unsigned i;
-            char sha1[PATH_MAX_LENGTH];
-
-            for (i = 0; i < val->binary.len; i++)
-            {
-               char sha1_cat[PATH_MAX_LENGTH];
-               snprintf(sha1_cat, sizeof(sha1_cat), "%02X", (unsigned char)val->binary.buff[i]);
-               strlcat(sha1, sha1_cat, sizeof(sha1));
-            }
-            db_info->sha1 = strdup(sha1);
-         }
+/**
+ * database_info_list_new_columns:
+ * @rdb_path            : Path to the database.
+ * @query               : Query selecting the entries, or NULL for all.
+ * @columns             : Mask of DATABASE_INFO_COLUMN() bits to fill.
+ *
+ * Lists the entries of a database matching @query. Only the
+ * requested columns are decoded; the others are left zeroed
+ * (-1 for analog_supported and rumble_supported).
+ *
+ * Returns: list of entries, or NULL on error. Free it with
+ * database_info_list_free().
+ **/
+database_info_list_t *database_info_list_new_columns(const char *rdb_path,
+      const char *query, uint32_t columns)
+{
+   libretrodb_t db;
+   libretrodb_cursor_t cur;
+   struct rmsgpack_dom_value item;
+   struct database_info_keys keys;
+   size_t i = 0, cap = 0;
+   database_info_t *database_info = NULL;
+   database_info_list_t *database_info_list = NULL;
 
-         if (!strcmp(key->string.buff, "md5"))
-         {
-            unsigned i;
-            char md5[PATH_MAX_LENGTH];
-
-            for (i = 0; i < val->binary.len; i++)
-            {
-               char md5_cat[PATH_MAX_LENGTH];
-               snprintf(md5_cat, sizeof(md5_cat), "%02X", (unsigned char)val->binary.buff[i]);
-               strlcat(md5, md5_cat, sizeof(md5));
-            }
-            db_info->md5 = strdup(md5);
-         }
+   if ((libretrodb_open(rdb_path, &db)) != 0)
+      return NULL;
+   if ((database_open_cursor(&db, &cur, query) != 0))
+   {
+      libretrodb_close(&db);
+      return NULL;
+   }
+
+   database_info_list = (database_info_list_t*)calloc(1, sizeof(*database_info_list));
+   if (!database_info_list)
+      goto error;
+
+   database_info_keys_init(&keys, columns);
+
+   /* Items are decoded in place from the mapped database and only
+    * the requested fields of matching items are copied out. */
+   while (libretrodb_cursor_read_item_view(&cur, &item) == 0)
+   {
+      database_info_t *db_info = NULL;
+      if (item.type != RDT_MAP)
+         continue;
+
+      if (i == cap)
+      {
+         database_info_t *tmp = NULL;
+
+         cap = cap ? cap * 2 : 16;
+         tmp = (database_info_t*)realloc(database_info,
+               cap * sizeof(database_info_t));
+
+         if (!tmp)
+            goto error;
+
+         database_info            = tmp;
+         database_info_list->list = database_info;
       }
-      i++;
+
+      db_info = (database_info_t*)&database_info[i];
+
+      memset(db_info, 0, sizeof(*db_info));
+      db_info->analog_supported       = -1;
+      db_info->rumble_supported       = -1;
+
+      database_info_fill(database_info_list, db_info, &keys, &item);
+
+      database_info_list->count = ++i;
    }
 
    database_info_list->list  = database_info;
    database_info_list->count = i;
 
+   libretrodb_cursor_close(&cur);
+   libretrodb_close(&db);
+
    return database_info_list;
 
 error:
@@ -301,51 +1044,17 @@ error:
 
 void database_info_list_free(database_info_list_t *database_info_list)
 {
-   size_t i;
+   struct database_info_arena *block;
 
    if (!database_info_list)
       return;
 
-   for (i = 0; i < database_info_list->count; i++)
+   block = (struct database_info_arena*)database_info_list->arena;
+   while (block)
    {
-      database_info_t *info = (database_info_t*)&database_info_list->list[i];
-
-      if (!info)
-         continue;
-
-      if (info->name)
-         free(info->name);
-      if (info->description)
-         free(info->description);
-      if (info->publisher)
-         free(info->publisher);
-      if (info->developer)
-         free(info->developer);
-      if (info->origin)
-         free(info->origin);
-      if (info->franchise)
-         free(info->franchise);
-      if (info->edge_magazine_review)
-         free(info->edge_magazine_review);
-
-      if (info->cero_rating)
-         free(info->cero_rating);
-      if (info->pegi_rating)
-         free(info->pegi_rating);
-      if (info->enhancement_hw)
-         free(info->enhancement_hw);
-      if (info->elspa_rating)
-         free(info->elspa_rating);
-      if (info->esrb_rating)
-         free(info->esrb_rating);
-      if (info->bbfc_rating)
-         free(info->bbfc_rating);
-      if (info->crc32)
-         free(info->crc32);
-      if (info->sha1)
-         free(info->sha1);
-      if (info->md5)
-         free(info->md5);
+      struct database_info_arena *next = block->next;
+      free(block);
+      block = next;
    }
 
    free(database_info_list->list);
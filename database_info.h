@@ -54,14 +54,54 @@ typedef struct
    void *userdata;
 } database_info_t;
 
+/* Columns of database_info_t that can be requested from
+ * database_info_list_new_columns(). */
+enum database_info_column
+{
+   DATABASE_INFO_NAME = 0,
+   DATABASE_INFO_DESCRIPTION,
+   DATABASE_INFO_PUBLISHER,
+   DATABASE_INFO_DEVELOPER,
+   DATABASE_INFO_ORIGIN,
+   DATABASE_INFO_FRANCHISE,
+   DATABASE_INFO_EDGE_MAGAZINE_REVIEW,
+   DATABASE_INFO_BBFC_RATING,
+   DATABASE_INFO_ELSPA_RATING,
+   DATABASE_INFO_ESRB_RATING,
+   DATABASE_INFO_PEGI_RATING,
+   DATABASE_INFO_CERO_RATING,
+   DATABASE_INFO_ENHANCEMENT_HW,
+   DATABASE_INFO_CRC32,
+   DATABASE_INFO_SHA1,
+   DATABASE_INFO_MD5,
+   DATABASE_INFO_FAMITSU_MAGAZINE_RATING,
+   DATABASE_INFO_EDGE_MAGAZINE_RATING,
+   DATABASE_INFO_EDGE_MAGAZINE_ISSUE,
+   DATABASE_INFO_MAX_USERS,
+   DATABASE_INFO_RELEASEMONTH,
+   DATABASE_INFO_RELEASEYEAR,
+   DATABASE_INFO_ANALOG_SUPPORTED,
+   DATABASE_INFO_RUMBLE_SUPPORTED,
+
+   DATABASE_INFO_COLUMN_LAST
+};
+
+#define DATABASE_INFO_COLUMN(col) (1u << (col))
+#define DATABASE_INFO_COLUMNS_ALL ((1u << DATABASE_INFO_COLUMN_LAST) - 1)
+
 typedef struct
 {
    database_info_t *list;
    size_t count;
+   /* Owns the strings of every entry in the list. */
+   void *arena;
 } database_info_list_t;
 
 database_info_list_t *database_info_list_new(const char *rdb_path, const char *query);
 
+database_info_list_t *database_info_list_new_columns(const char *rdb_path,
+      const char *query, uint32_t columns);
+
 void database_info_list_free(database_info_list_t *list);
 
 int database_open_cursor(libretrodb_t *db,
@@ -17,6 +17,7 @@
 
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
 #include <sys/types.h>
 
@@ -24,7 +25,9 @@
 #include <retro_miscellaneous.h>
 #include <file/file_path.h>
 #include <string/string_list.h>
-#include "7zip_support.h"
+#include <compat/strl.h>
+#include "../file_extract.h"
+#include "../hash.h"
 
 #include "../deps/7zip/7z.h"
 #include "../deps/7zip/7zAlloc.h"
@@ -32,6 +35,10 @@
 #include "../deps/7zip/7zFile.h"
 #include "../deps/7zip/7zVersion.h"
 
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
 /* Undefined at the end of the file
  * Don't use outside of this file
  */
@@ -168,6 +175,287 @@ static SRes ConvertUtf16toCharString(const uint16_t *s, char *outstring)
    return res;
 }
 
+/* Decompressed solid blocks are kept for later reads from the
+ * same archive, and dropped least recently used first once they
+ * add up to more than this. */
+#ifndef SEVENZIP_BLOCK_CACHE_SIZE
+#define SEVENZIP_BLOCK_CACHE_SIZE (64 * 1024 * 1024)
+#endif
+
+typedef struct sevenzip_block
+{
+   char path[PATH_MAX_LENGTH];
+   uint64_t archive_size;
+   uint32_t index;
+   uint32_t crc;
+   uint8_t *data;
+   size_t size;
+   unsigned refs;
+   bool cached;
+   struct sevenzip_block *prev;
+   struct sevenzip_block *next;
+} sevenzip_block_t;
+
+static struct
+{
+   sevenzip_block_t *head;
+   sevenzip_block_t *tail;
+   size_t size;
+   bool enable;
+#ifdef HAVE_THREADS
+   slock_t *lock;
+#endif
+} sevenzip_cache;
+
+static void sevenzip_cache_lock(void)
+{
+#ifdef HAVE_THREADS
+   if (sevenzip_cache.lock)
+      slock_lock(sevenzip_cache.lock);
+#endif
+}
+
+static void sevenzip_cache_unlock(void)
+{
+#ifdef HAVE_THREADS
+   if (sevenzip_cache.lock)
+      slock_unlock(sevenzip_cache.lock);
+#endif
+}
+
+static void sevenzip_block_free(sevenzip_block_t *block)
+{
+   IAlloc_Free(&g_Alloc, block->data);
+   free(block);
+}
+
+static void sevenzip_cache_unlink(sevenzip_block_t *block)
+{
+   if (block->prev)
+      block->prev->next = block->next;
+   else
+      sevenzip_cache.head = block->next;
+
+   if (block->next)
+      block->next->prev = block->prev;
+   else
+      sevenzip_cache.tail = block->prev;
+
+   block->prev = block->next = NULL;
+}
+
+static void sevenzip_cache_push_front(sevenzip_block_t *block)
+{
+   block->prev = NULL;
+   block->next = sevenzip_cache.head;
+   if (sevenzip_cache.head)
+      sevenzip_cache.head->prev = block;
+   else
+      sevenzip_cache.tail = block;
+   sevenzip_cache.head = block;
+}
+
+/* Drops blocks from the tail until the cache fits in @budget.
+ * Blocks still in use are freed by their last release. */
+static void sevenzip_cache_trim(size_t budget)
+{
+   while (sevenzip_cache.tail && sevenzip_cache.size > budget)
+   {
+      sevenzip_block_t *block = sevenzip_cache.tail;
+
+      sevenzip_cache_unlink(block);
+      sevenzip_cache.size -= block->size;
+      block->cached        = false;
+
+      if (!block->refs)
+         sevenzip_block_free(block);
+   }
+}
+
+static bool sevenzip_block_matches(const sevenzip_block_t *block,
+      const char *path, uint64_t archive_size,
+      uint32_t index, const CSzFolder *folder)
+{
+   return block->index == index
+      && block->archive_size == archive_size
+      && block->crc == folder->UnpackCRC
+      && block->size == SzFolder_GetUnpackSize((CSzFolder*)folder)
+      && !strcmp(block->path, path);
+}
+
+static void sevenzip_block_release(sevenzip_block_t *block)
+{
+   if (!block)
+      return;
+
+   sevenzip_cache_lock();
+   if (--block->refs == 0 && !block->cached)
+      sevenzip_block_free(block);
+   sevenzip_cache_unlock();
+}
+
+/**
+ * sevenzip_block_get:
+ * @db                          : archive database.
+ * @stream                      : archive stream.
+ * @path                        : filename path of archive.
+ * @archive_size                : size of archive.
+ * @file_index                  : index of file in @db.
+ * @block                       : block held by the caller, replaced
+ *                                by the block holding the file.
+ * @offset                      : offset of the file in the block.
+ * @size                        : size of the file.
+ *
+ * Finds the decompressed solid block holding a file, decoding it
+ * only when neither the caller nor the block cache have it. The
+ * block stays valid until released with sevenzip_block_release().
+ * @block is NULL for files without data.
+ *
+ * Returns: SZ_OK on success, otherwise a 7z error code.
+ **/
+static SRes sevenzip_block_get(const CSzArEx *db, ILookInStream *stream,
+      const char *path, uint64_t archive_size, uint32_t file_index,
+      sevenzip_block_t **block, size_t *offset, size_t *size)
+{
+   ISzAlloc alloc_temp      = { SzAllocTemp, SzFreeTemp };
+   uint32_t index           = db->FileIndexToFolderIndexMap[file_index];
+   const CSzFolder *folder  = NULL;
+   sevenzip_block_t *found  = NULL;
+   uint32_t block_index;
+   uint8_t *data;
+   size_t data_size;
+   SRes res;
+
+   *offset = 0;
+   *size   = 0;
+
+   if (index == (uint32_t)-1)
+   {
+      sevenzip_block_release(*block);
+      *block = NULL;
+      return SZ_OK;
+   }
+
+   folder = db->db.Folders + index;
+
+   if (*block && !sevenzip_block_matches(*block, path, archive_size,
+            index, folder))
+   {
+      sevenzip_block_release(*block);
+      *block = NULL;
+   }
+
+   if (!*block && sevenzip_cache.enable)
+   {
+      sevenzip_cache_lock();
+      for (found = sevenzip_cache.head; found; found = found->next)
+         if (sevenzip_block_matches(found, path, archive_size,
+                  index, folder))
+            break;
+      if (found)
+      {
+         found->refs++;
+         sevenzip_cache_unlink(found);
+         sevenzip_cache_push_front(found);
+      }
+      sevenzip_cache_unlock();
+      *block = found;
+   }
+
+   if (!*block)
+   {
+      sevenzip_block_t *fresh = (sevenzip_block_t*)
+         calloc(1, sizeof(*fresh));
+
+      if (!fresh)
+         return SZ_ERROR_MEM;
+
+      strlcpy(fresh->path, path, sizeof(fresh->path));
+      fresh->archive_size = archive_size;
+      fresh->index        = index;
+      fresh->crc          = folder->UnpackCRC;
+      fresh->refs         = 1;
+
+      block_index = 0xFFFFFFFF;
+      res = SzArEx_Extract(db, stream, file_index, &block_index,
+            &fresh->data, &fresh->size, offset, size,
+            &g_Alloc, &alloc_temp);
+      if (res != SZ_OK)
+      {
+         sevenzip_block_free(fresh);
+         return res;
+      }
+
+      *block = fresh;
+
+      if (!sevenzip_cache.enable || fresh->size > SEVENZIP_BLOCK_CACHE_SIZE)
+         return SZ_OK;
+
+      /* Another thread may have decoded the same block meanwhile. */
+      sevenzip_cache_lock();
+      for (found = sevenzip_cache.head; found; found = found->next)
+         if (sevenzip_block_matches(found, path, archive_size,
+                  index, folder))
+            break;
+      if (!found)
+      {
+         fresh->cached        = true;
+         sevenzip_cache.size += fresh->size;
+         sevenzip_cache_push_front(fresh);
+         sevenzip_cache_trim(SEVENZIP_BLOCK_CACHE_SIZE);
+      }
+      sevenzip_cache_unlock();
+      return SZ_OK;
+   }
+
+   /* The block is already decoded: only locate and check the file. */
+   block_index = index;
+   data        = (*block)->data;
+   data_size   = (*block)->size;
+   return SzArEx_Extract(db, stream, file_index, &block_index,
+         &data, &data_size, offset, size, &g_Alloc, &alloc_temp);
+}
+
+/**
+ * compressed_7zip_cache_init:
+ *
+ * Enables the cache of decompressed solid blocks shared by all
+ * 7z reads. Without it, every read decodes its own block.
+ **/
+void compressed_7zip_cache_init(void)
+{
+   if (sevenzip_cache.enable)
+      return;
+
+#ifdef HAVE_THREADS
+   sevenzip_cache.lock = slock_new();
+   if (!sevenzip_cache.lock)
+      return;
+#endif
+   sevenzip_cache.enable = true;
+}
+
+/**
+ * compressed_7zip_cache_free:
+ *
+ * Frees the cached solid blocks and disables the cache.
+ **/
+void compressed_7zip_cache_free(void)
+{
+   if (!sevenzip_cache.enable)
+      return;
+
+   sevenzip_cache_lock();
+   sevenzip_cache_trim(0);
+   sevenzip_cache_unlock();
+
+   sevenzip_cache.enable = false;
+#ifdef HAVE_THREADS
+   slock_free(sevenzip_cache.lock);
+   sevenzip_cache.lock = NULL;
+#endif
+}
+
 /* Extract the relative path relative_path from a 7z archive 
  * archive_path and allocate a buf for it to write it in.
  * If optional_outfile is set, extract to that instead and don't alloc buffer.
@@ -183,6 +471,7 @@ int read_7zip_file(const char * archive_path,
    ISzAlloc allocTempImp;
    uint16_t *temp = NULL;
    size_t tempSize = 0;
+   uint64_t archive_size = 0;
    long outsize = -1;
    bool file_found = false;
 
@@ -209,18 +498,17 @@ int read_7zip_file(const char * archive_path,
    LookToRead_Init(&lookStream);
    CrcGenerateTable();
    SzArEx_Init(&db);
+   File_GetLength(&archiveStream.file, &archive_size);
    res = SzArEx_Open(&db, &lookStream.s, &allocImp, &allocTempImp);
    if (res == SZ_OK)
    {
       uint32_t i;
-      uint32_t blockIndex = 0xFFFFFFFF;
-      uint8_t *outBuffer = 0;
-      size_t outBufferSize = 0;
 
       for (i = 0; i < db.db.NumFiles; i++)
       {
          size_t offset = 0;
          size_t outSizeProcessed = 0;
+         sevenzip_block_t *block = NULL;
          const CSzFileItem *f = db.db.Files + i;
          size_t len;
          if (f->IsDir)
@@ -256,9 +544,8 @@ int read_7zip_file(const char * archive_path,
              * sourceforge.net/p/sevenzip/discussion/45798/thread/6fb59aaf/
              * */
             file_found = true;
-            res = SzArEx_Extract(&db, &lookStream.s, i,&blockIndex,
-                  &outBuffer, &outBufferSize,&offset, &outSizeProcessed,
-                  &allocImp, &allocTempImp);
+            res = sevenzip_block_get(&db, &lookStream.s, archive_path,
+                  archive_size, i, &block, &offset, &outSizeProcessed);
             if (res != SZ_OK)
             {
                break; /* This goes to the error section. */
@@ -271,27 +558,33 @@ int read_7zip_file(const char * archive_path,
                {
                   RARCH_ERR("Could not open outfilepath %s.\n",
                         optional_outfile);
-                  IAlloc_Free(&allocImp, outBuffer);
+                  sevenzip_block_release(block);
                   SzArEx_Free(&db, &allocImp);
                   free(temp);
                   File_Close(&archiveStream.file);
                   return -1;
                }
-               fwrite(outBuffer+offset,1,outsize,outsink);
+               if (block)
+                  fwrite(block->data + offset,1,outsize,outsink);
                fclose(outsink);
             }
             else
             {
-               /*We could either use the 7Zip allocated buffer,
-                * or create our own and use it.
-                * We would however need to realloc anyways, because RetroArch
-                * expects a \0 at the end, therefore we allocate new,
-                * copy and free the old one. */
+               /* The block may be shared through the cache, and
+                * RetroArch expects a \0 at the end, so the file
+                * is copied out of it. */
                *buf = malloc(outsize + 1);
+               if (!*buf)
+               {
+                  sevenzip_block_release(block);
+                  res = SZ_ERROR_MEM;
+                  break;
+               }
                ((char*)(*buf))[outsize] = '\0';
-               memcpy(*buf,outBuffer+offset,outsize);
+               if (block)
+                  memcpy(*buf,block->data + offset,outsize);
             }
-            IAlloc_Free(&allocImp, outBuffer);
+            sevenzip_block_release(block);
             break;
          }
       }
@@ -318,6 +611,17 @@ int read_7zip_file(const char * archive_path,
    return -1;
 }
 
+/**
+ * compressed_7zip_file_list_new:
+ * @path                        : filename path of archive.
+ * @ext                         : allowed extensions, separated by '|'.
+ *
+ * Lists the files of a 7z archive from its header database only;
+ * no compressed stream is decoded.
+ *
+ * Returns: string listing of files from archive on success,
+ * otherwise NULL.
+ **/
 struct string_list *compressed_7zip_file_list_new(const char *path,
       const char* ext)
 {
@@ -461,4 +765,115 @@ error:
    return NULL;
 }
 
+/**
+ * compressed_7zip_get_crc32s:
+ * @path                        : filename path of archive.
+ * @file_cb                     : called for every file in the archive.
+ * @userdata                    : userdata to pass to file_cb function pointer.
+ *
+ * Reports the CRC32s stored in the header database of a 7z
+ * archive. Only files without a stored CRC are extracted; the
+ * C LZMA SDK cannot extract in chunks, so their solid block is
+ * decompressed once and shared by all files in it.
+ *
+ * Returns: true (1) on success, otherwise false (0).
+ **/
+bool compressed_7zip_get_crc32s(const char *path,
+      compressed_crc_cb file_cb, void *userdata)
+{
+   CFileInStream archiveStream;
+   CLookToRead lookStream;
+   CSzArEx db;
+   SRes res;
+   ISzAlloc allocImp;
+   ISzAlloc allocTempImp;
+   uint16_t *temp          = NULL;
+   size_t tempSize         = 0;
+   uint64_t archive_size   = 0;
+   sevenzip_block_t *block = NULL;
+
+   allocImp.Alloc     = SzAlloc;
+   allocImp.Free      = SzFree;
+   allocTempImp.Alloc = SzAllocTemp;
+   allocTempImp.Free  = SzFreeTemp;
+
+   if (InFile_Open(&archiveStream.file, path))
+   {
+      RARCH_ERR("Could not open %s as 7z archive.\n", path);
+      return false;
+   }
+
+   FileInStream_CreateVTable(&archiveStream);
+   LookToRead_CreateVTable(&lookStream, False);
+   lookStream.realStream = &archiveStream.s;
+   LookToRead_Init(&lookStream);
+   CrcGenerateTable();
+   SzArEx_Init(&db);
+   File_GetLength(&archiveStream.file, &archive_size);
+
+   res = SzArEx_Open(&db, &lookStream.s, &allocImp, &allocTempImp);
+   if (res == SZ_OK)
+   {
+      uint32_t i;
+
+      for (i = 0; i < db.db.NumFiles; i++)
+      {
+         char infile[PATH_MAX_LENGTH];
+         const CSzFileItem *f = db.db.Files + i;
+         uint32_t crc         = f->Crc;
+         size_t len;
+
+         if (f->IsDir)
+            continue;
+
+         len = SzArEx_GetFileNameUtf16(&db, i, NULL);
+         if (len > tempSize)
+         {
+            free(temp);
+            tempSize = len;
+            temp = (uint16_t *)malloc(tempSize * sizeof(temp[0]));
+            if (!temp)
+            {
+               res = SZ_ERROR_MEM;
+               break;
+            }
+         }
+         SzArEx_GetFileNameUtf16(&db, i, temp);
+         if ((res = ConvertUtf16toCharString(temp, infile)) != SZ_OK)
+            break;
+
+         if (!f->CrcDefined)
+         {
+            size_t offset           = 0;
+            size_t outSizeProcessed = 0;
+
+            res = sevenzip_block_get(&db, &lookStream.s, path,
+                  archive_size, i, &block, &offset, &outSizeProcessed);
+            if (res != SZ_OK)
+               break;
+
+            crc = block ? crc32_calculate(block->data + offset,
+                  outSizeProcessed) : 0;
+         }
+
+         if (!file_cb(infile, f->Size, crc, userdata))
+            break;
+      }
+   }
+
+   sevenzip_block_release(block);
+   SzArEx_Free(&db, &allocImp);
+   free(temp);
+   File_Close(&archiveStream.file);
+
+   if (res != SZ_OK)
+   {
+      RARCH_ERR("Could not read 7z archive %s, error number was: #%d.\n",
+            path, res);
+      return false;
+   }
+
+   return true;
+}
+
 #undef RARCH_ZIP_SUPPORT_BUFFER_SIZE_MAX
@@ -27,6 +27,13 @@ int read_7zip_file(const char * archive_path,
 struct string_list *compressed_7zip_file_list_new(const char *path,
       const char* ext);
 
+bool compressed_7zip_get_crc32s(const char *path,
+      compressed_crc_cb file_cb, void *userdata);
+
+void compressed_7zip_cache_init(void);
+
+void compressed_7zip_cache_free(void);
+
 #ifdef __cplusplus
 }
 #endif
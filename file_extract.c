@@ -27,6 +27,10 @@
 
 #include <zlib.h>
 
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
 #include "hash.h"
 
 /* File backends. Can be fleshed out later, but keep it simple for now.
@@ -106,6 +110,12 @@ static void *zlib_file_open(const char *path)
    if (fstat(data->fd, &fds) < 0)
       goto error;
 
+   if ((uint64_t)fds.st_size > (size_t)-1)
+   {
+      RARCH_ERR("Archive is too large to be mapped: %s.\n", path);
+      goto error;
+   }
+
    data->size = fds.st_size;
    if (!data->size)
       return data;
@@ -211,11 +221,334 @@ static uint32_t read_le(const uint8_t *data, unsigned size)
 
    size *= 8;
    for (i = 0; i < size; i += 8)
-      val |= *data++ << i;
+      val |= (uint32_t)*data++ << i;
 
    return val;
 }
 
+static uint64_t read_le64(const uint8_t *data)
+{
+   return (uint64_t)read_le(data, 4) | ((uint64_t)read_le(data + 4, 4) << 32);
+}
+
+/* z_stream counts its input in uInt, members larger
+ * than this are fed to it in pieces. */
+#define ZLIB_INPUT_PIECE_SIZE (1U << 30)
+
+/**
+ * zlib_feed_input:
+ * @stream                      : inflate stream.
+ * @in                          : input left to feed, advanced.
+ * @in_left                     : size of @in, decreased.
+ *
+ * Hands the next piece of input to @stream once it has
+ * consumed the previous one.
+ **/
+static void zlib_feed_input(z_stream *stream,
+      const uint8_t **in, uint64_t *in_left)
+{
+   uInt count;
+
+   if (stream->avail_in || !*in_left)
+      return;
+
+   count = (*in_left > ZLIB_INPUT_PIECE_SIZE) ?
+      ZLIB_INPUT_PIECE_SIZE : (uInt)*in_left;
+
+   stream->next_in  = (Bytef*)*in;
+   stream->avail_in = count;
+   *in             += count;
+   *in_left        -= count;
+}
+
+/* Output is produced in chunks of this size, so that it can be
+ * checked while the rest is still being inflated. */
+#define ZLIB_INFLATE_CHUNK_SIZE (256 * 1024)
+
+/* Smaller members are not worth starting a thread for. */
+#define ZLIB_INFLATE_THREAD_MIN_SIZE (1024 * 1024)
+
+typedef struct
+{
+   z_stream stream;
+   const uint8_t *in;
+   uint64_t in_left;
+   uint8_t *out;
+   size_t size;
+   size_t pos;
+
+   /* Progress, published under @lock by the inflate thread. */
+   size_t produced;
+   bool done;
+   bool ok;
+#ifdef HAVE_THREADS
+   slock_t *lock;
+   scond_t *cond;
+#endif
+} zlib_inflate_job_t;
+
+/**
+ * zlib_inflate_step:
+ * @job                         : inflate job.
+ * @produced                    : bytes of output inflated so far.
+ *
+ * Inflates the next chunk of output.
+ *
+ * Returns: 1 if there is more to inflate, 0 once the output is
+ * complete, -1 on error.
+ **/
+static int zlib_inflate_step(zlib_inflate_job_t *job, size_t *produced)
+{
+   int ret;
+   size_t avail = job->size - job->pos;
+
+   *produced = job->pos;
+   if (!avail)
+      return 0;
+
+   if (avail > ZLIB_INFLATE_CHUNK_SIZE)
+      avail = ZLIB_INFLATE_CHUNK_SIZE;
+
+   zlib_feed_input(&job->stream, &job->in, &job->in_left);
+   job->stream.next_out  = job->out + job->pos;
+   job->stream.avail_out = avail;
+
+   ret       = inflate(&job->stream, Z_NO_FLUSH);
+   job->pos += avail - job->stream.avail_out;
+   *produced = job->pos;
+
+   if (ret != Z_OK && ret != Z_STREAM_END)
+      return -1;
+   if (*produced == job->size)
+      return 0;
+   return (ret == Z_STREAM_END) ? -1 : 1;
+}
+
+#ifdef HAVE_THREADS
+static void zlib_inflate_thread(void *data)
+{
+   int status;
+   zlib_inflate_job_t *job = (zlib_inflate_job_t*)data;
+
+   do
+   {
+      size_t produced = 0;
+
+      status = zlib_inflate_step(job, &produced);
+
+      slock_lock(job->lock);
+      job->produced = produced;
+      job->done     = status <= 0;
+      job->ok       = status == 0;
+      scond_signal(job->cond);
+      slock_unlock(job->lock);
+   } while (status > 0);
+}
+#endif
+
+/**
+ * zlib_inflate_data_to_buffer:
+ * @cdata                       : input data.
+ * @csize                       : size of input data.
+ * @out                         : output buffer.
+ * @size                        : size of the output, as stored in
+ *                                the archive.
+ * @checksum                    : CRC32 of the output.
+ *
+ * Decompresses a deflate stream straight into @out. Large members
+ * are inflated on a worker thread while the calling thread computes
+ * the CRC32 of every chunk as soon as it is complete, so checking
+ * the result costs no extra pass over the data.
+ *
+ * Returns: true (1) on success, otherwise false (0).
+ **/
+static bool zlib_inflate_data_to_buffer(const uint8_t *cdata,
+      uint64_t csize, uint8_t *out, size_t size, uint32_t *checksum)
+{
+   zlib_inflate_job_t job;
+   size_t hashed     = 0;
+   bool ret          = false;
+#ifdef HAVE_THREADS
+   sthread_t *thread = NULL;
+#endif
+
+   memset(&job, 0, sizeof(job));
+   job.in      = cdata;
+   job.in_left = csize;
+   job.out     = out;
+   job.size    = size;
+
+   *checksum = 0;
+
+   if (inflateInit2(&job.stream, -MAX_WBITS) != Z_OK)
+      return false;
+
+#ifdef HAVE_THREADS
+   if (size >= ZLIB_INFLATE_THREAD_MIN_SIZE)
+   {
+      job.lock = slock_new();
+      job.cond = scond_new();
+
+      if (job.lock && job.cond)
+         thread = sthread_create(zlib_inflate_thread, &job);
+   }
+
+   if (thread)
+   {
+      bool done = false;
+
+      while (!done)
+      {
+         size_t produced;
+
+         slock_lock(job.lock);
+         while (job.produced == hashed && !job.done)
+            scond_wait(job.cond, job.lock);
+         produced = job.produced;
+         done     = job.done;
+         slock_unlock(job.lock);
+
+         *checksum = crc32_update(*checksum, out + hashed,
+               produced - hashed);
+         hashed    = produced;
+      }
+
+      sthread_join(thread);
+      ret = job.ok;
+   }
+   else
+#endif
+   {
+      int status;
+
+      do
+      {
+         status = zlib_inflate_step(&job, &hashed);
+      } while (status > 0);
+
+      ret       = status == 0;
+      *checksum = crc32_calculate(out, hashed);
+   }
+
+#ifdef HAVE_THREADS
+   if (job.cond)
+      scond_free(job.cond);
+   if (job.lock)
+      slock_free(job.lock);
+#endif
+   inflateEnd(&job.stream);
+   return ret;
+}
+
+/**
+ * zlib_extract_member:
+ * @path                        : path of the file to write.
+ * @cdata                       : member data.
+ * @cmode                       : compression method (0 stored, 8 deflate).
+ * @csize                       : size of @cdata.
+ * @size                        : size of the member, as stored in
+ *                                the archive.
+ * @checksum                    : CRC32 from the archive.
+ * @buffer                      : scratch buffer.
+ * @buffer_size                 : size of @buffer.
+ *
+ * Streams a member to a file through @buffer, hashing it on
+ * the way, so that members of any size take a fixed amount
+ * of memory.
+ *
+ * Returns: true (1) on success, otherwise false (0).
+ **/
+static bool zlib_extract_member(const char *path, const uint8_t *cdata,
+      unsigned cmode, uint64_t csize, uint64_t size, uint32_t checksum,
+      uint8_t *buffer, size_t buffer_size)
+{
+   FILE *file;
+   z_stream stream;
+   int zret               = Z_OK;
+   uint64_t written       = 0;
+   uint32_t real_checksum = 0;
+   bool ret               = false;
+
+   if (cmode != 0 && cmode != 8)
+   {
+      RARCH_ERR("Unsupported compression method %u for %s.\n", cmode, path);
+      return false;
+   }
+
+   if (cmode == 0 && csize < size)
+      return false;
+
+   file = fopen(path, "wb");
+   if (!file)
+   {
+      RARCH_ERR("Failed to open %s for writing.\n", path);
+      return false;
+   }
+
+   if (cmode == 0)
+   {
+      while (written < size)
+      {
+         size_t count = buffer_size;
+
+         if (count > size - written)
+            count = size - written;
+         if (fwrite(cdata + written, 1, count, file) != count)
+            goto end;
+
+         real_checksum = crc32_update(real_checksum, cdata + written, count);
+         written      += count;
+      }
+   }
+   else
+   {
+      memset(&stream, 0, sizeof(stream));
+      if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+         goto end;
+
+      while (zret != Z_STREAM_END)
+      {
+         size_t count;
+
+         zlib_feed_input(&stream, &cdata, &csize);
+         stream.next_out  = buffer;
+         stream.avail_out = buffer_size;
+
+         zret = inflate(&stream, Z_NO_FLUSH);
+         if (zret != Z_OK && zret != Z_STREAM_END)
+            break;
+
+         count = buffer_size - stream.avail_out;
+         if (count > size - written ||
+               fwrite(buffer, 1, count, file) != count)
+         {
+            zret = Z_DATA_ERROR;
+            break;
+         }
+
+         real_checksum = crc32_update(real_checksum, buffer, count);
+         written      += count;
+      }
+
+      inflateEnd(&stream);
+      if (zret != Z_STREAM_END)
+         goto end;
+   }
+
+   ret = written == size;
+
+   if (ret && real_checksum != checksum)
+      RARCH_WARN("File CRC differs from ZIP CRC. File: 0x%x, ZIP: 0x%x.\n",
+            (unsigned)real_checksum, (unsigned)checksum);
+
+end:
+   if (fclose(file) != 0)
+      ret = false;
+   if (!ret)
+      RARCH_ERR("Failed to extract %s.\n", path);
+   return ret;
+}
+
 /**
  * zlib_inflate_data_to_file:
  * @path                        : filename path of archive.
@@ -231,42 +564,205 @@ static uint32_t read_le(const uint8_t *data, unsigned size)
  * Returns: true (1) on success, otherwise false (0).
  **/
 bool zlib_inflate_data_to_file(const char *path, const char *valid_exts,
-      const uint8_t *cdata, uint32_t csize, uint32_t size, uint32_t checksum)
+      const uint8_t *cdata, uint64_t csize, uint64_t size, uint32_t checksum)
 {
-   bool ret = true;
-   uint32_t real_checksum = 0;
-   z_stream stream = {0};
-   uint8_t *out_data = (uint8_t*)malloc(size);
+   bool ret;
+   uint8_t *buffer = (uint8_t*)malloc(ZLIB_INFLATE_CHUNK_SIZE);
+
+   (void)valid_exts;
 
-   if (!out_data)
+   if (!buffer)
       return false;
 
-   if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
-      GOTO_END_ERROR();
+   ret = zlib_extract_member(path, cdata, 8, csize, size, checksum,
+         buffer, ZLIB_INFLATE_CHUNK_SIZE);
 
-   stream.next_in   = (uint8_t*)cdata;
-   stream.avail_in  = csize;
-   stream.next_out  = out_data;
-   stream.avail_out = size;
+   free(buffer);
+   return ret;
+}
 
-   if (inflate(&stream, Z_FINISH) != Z_STREAM_END)
+/* A member of a ZIP archive, as described by its central
+ * directory entry. */
+typedef struct
+{
+   char name[PATH_MAX_LENGTH];
+   unsigned cmode;
+   uint32_t checksum;
+   uint64_t csize;
+   uint64_t size;
+   uint64_t offset;
+} zlib_entry_t;
+
+typedef struct
+{
+   const uint8_t *data;
+   size_t size;
+   size_t pos;
+   size_t end;
+} zlib_dir_t;
+
+/**
+ * zlib_dir_open:
+ * @dir                         : central directory iterator.
+ * @data                        : archive data.
+ * @size                        : size of @data.
+ *
+ * Locates the central directory from the end record, or from
+ * the ZIP64 end record when the archive has one.
+ *
+ * Returns: true (1) on success, otherwise false (0).
+ **/
+static bool zlib_dir_open(zlib_dir_t *dir, const uint8_t *data, size_t size)
+{
+   const uint8_t *footer;
+   uint64_t dir_offset, dir_size;
+
+   if (size < 22)
+      return false;
+
+   /* The end record sits before a comment of at most 64 KiB. */
+   for (footer = data + size - 22; ; footer--)
    {
-      inflateEnd(&stream);
-      GOTO_END_ERROR();
+      if (read_le(footer, 4) == 0x06054b50 &&
+            footer + 22 + read_le(footer + 20, 2) == data + size)
+         break;
+      if (footer == data || data + size - footer > 22 + 0xffff)
+         return false;
    }
-   inflateEnd(&stream);
 
-   real_checksum = crc32_calculate(out_data, size);
-   if (real_checksum != checksum)
-      RARCH_WARN("File CRC differs from ZIP CRC. File: 0x%x, ZIP: 0x%x.\n",
-            (unsigned)real_checksum, (unsigned)checksum);
+   dir_size   = read_le(footer + 12, 4);
+   dir_offset = read_le(footer + 16, 4);
 
-   if (!write_file(path, out_data, size))
-      GOTO_END_ERROR();
+   /* ZIP64 archives point to their own end record through a
+    * locator right before the classic one. */
+   if (footer - data >= 20 && read_le(footer - 20, 4) == 0x07064b50)
+   {
+      uint64_t record = read_le64(footer - 20 + 8);
 
-end:
-   free(out_data);
-   return ret;
+      if (record > (uint64_t)(footer - 20 - data) ||
+            (uint64_t)(footer - 20 - data) - record < 56 ||
+            read_le(data + record, 4) != 0x06064b50)
+         return false;
+
+      footer     = data + record;
+      dir_size   = read_le64(footer + 40);
+      dir_offset = read_le64(footer + 48);
+   }
+
+   if (dir_offset > (uint64_t)(footer - data) ||
+         dir_size > (uint64_t)(footer - data) - dir_offset)
+      return false;
+
+   dir->data = data;
+   dir->size = size;
+   dir->pos  = dir_offset;
+   dir->end  = dir_offset + dir_size;
+   return true;
+}
+
+/**
+ * zlib_dir_next:
+ * @dir                         : central directory iterator.
+ * @entry                       : next member of the archive.
+ *
+ * Returns: 1 if @entry was read, 0 at the end of the directory,
+ * -1 if the directory is corrupt.
+ **/
+static int zlib_dir_next(zlib_dir_t *dir, zlib_entry_t *entry)
+{
+   const uint8_t *header = dir->data + dir->pos;
+   const uint8_t *extra, *extra_end;
+   unsigned namelength, extralength, commentlength;
+
+   if (dir->end - dir->pos < 46 || read_le(header, 4) != 0x02014b50)
+      return 0;
+
+   namelength    = read_le(header + 28, 2);
+   extralength   = read_le(header + 30, 2);
+   commentlength = read_le(header + 32, 2);
+
+   if (namelength >= PATH_MAX_LENGTH ||
+         dir->end - dir->pos - 46 <
+         namelength + extralength + commentlength)
+      return -1;
+
+   entry->cmode    = read_le(header + 10, 2);
+   entry->checksum = read_le(header + 16, 4);
+   entry->csize    = read_le(header + 20, 4);
+   entry->size     = read_le(header + 24, 4);
+   entry->offset   = read_le(header + 42, 4);
+
+   memcpy(entry->name, header + 46, namelength);
+   entry->name[namelength] = '\0';
+
+   /* ZIP64 extended information holds the 64-bit values of the
+    * fields that are saturated above, in this order. */
+   extra     = header + 46 + namelength;
+   extra_end = extra + extralength;
+
+   while (extra_end - extra >= 4)
+   {
+      unsigned id     = read_le(extra, 2);
+      unsigned length = read_le(extra + 2, 2);
+      const uint8_t *field, *field_end;
+
+      extra += 4;
+      if ((unsigned)(extra_end - extra) < length)
+         return -1;
+
+      field     = extra;
+      field_end = extra + length;
+      extra    += length;
+
+      if (id != 0x0001)
+         continue;
+
+      if (entry->size == 0xffffffff && field_end - field >= 8)
+      {
+         entry->size = read_le64(field);
+         field      += 8;
+      }
+      if (entry->csize == 0xffffffff && field_end - field >= 8)
+      {
+         entry->csize = read_le64(field);
+         field       += 8;
+      }
+      if (entry->offset == 0xffffffff && field_end - field >= 8)
+         entry->offset = read_le64(field);
+   }
+
+   dir->pos += 46 + namelength + extralength + commentlength;
+   return 1;
+}
+
+/**
+ * zlib_entry_data:
+ * @dir                         : central directory iterator.
+ * @entry                       : member of the archive.
+ *
+ * Returns: compressed data of @entry, NULL if it lies outside
+ * the archive.
+ **/
+static const uint8_t *zlib_entry_data(const zlib_dir_t *dir,
+      const zlib_entry_t *entry)
+{
+   const uint8_t *header;
+   uint64_t offset;
+
+   if (dir->size < 30 || entry->offset > dir->size - 30)
+      return NULL;
+
+   header = dir->data + entry->offset;
+   if (read_le(header, 4) != 0x04034b50)
+      return NULL;
+
+   offset = entry->offset + 30 + read_le(header + 26, 2) +
+      read_le(header + 28, 2);
+
+   if (offset > dir->size || entry->csize > dir->size - offset)
+      return NULL;
+
+   return dir->data + offset;
 }
 
 /**
@@ -286,87 +782,163 @@ bool zlib_parse_file(const char *file, const char *valid_exts,
       zlib_file_cb file_cb, void *userdata)
 {
    void *handle;
-   const uint8_t *footer    = NULL;
-   const uint8_t *directory = NULL;
-   const uint8_t *data      = NULL;
-   ssize_t zip_size = 0;
+   zlib_dir_t dir;
+   zlib_entry_t entry;
+   int status;
    bool ret = true;
    const struct zlib_file_backend *backend = zlib_get_default_file_backend();
 
    if (!backend)
       return false;
 
-   (void)valid_exts;
-
    handle = backend->open(file);
    if (!handle)
       GOTO_END_ERROR();
 
-   zip_size = backend->size(handle);
-   if (zip_size < 22)
+   if (!zlib_dir_open(&dir, backend->data(handle), backend->size(handle)))
       GOTO_END_ERROR();
 
-   data = backend->data(handle);
-
-   footer = data + zip_size - 22;
-   for (;; footer--)
+   while ((status = zlib_dir_next(&dir, &entry)) > 0)
    {
-      if (footer <= data + 22)
+      const uint8_t *cdata = zlib_entry_data(&dir, &entry);
+
+      if (!cdata)
          GOTO_END_ERROR();
-      if (read_le(footer, 4) == 0x06054b50)
-      {
-         unsigned comment_len = read_le(footer + 20, 2);
-         if (footer + 22 + comment_len == data + zip_size)
-            break;
-      }
+
+      if (!file_cb(entry.name, valid_exts, cdata, entry.cmode,
+               entry.csize, entry.size, entry.checksum, userdata))
+         break;
    }
 
-   directory = data + read_le(footer + 16, 4);
+   if (status < 0)
+      GOTO_END_ERROR();
 
-   for (;;)
+end:
+   if (handle)
+      backend->free(handle);
+   return ret;
+}
+
+/* Output chunk size when a member has to be decompressed to
+ * compute its CRC32. */
+#define ZLIB_CRC_CHUNK_SIZE (64 * 1024)
+
+/**
+ * zlib_stream_crc32:
+ * @cdata                       : compressed member data.
+ * @cmode                       : compression method (0 stored, 8 deflate).
+ * @csize                       : size of @cdata.
+ * @crc                         : CRC32 of the uncompressed member.
+ *
+ * Inflates a member through a fixed-size buffer and hashes it
+ * chunk by chunk, so the member is never held in memory whole.
+ *
+ * Returns: true (1) on success, otherwise false (0).
+ **/
+static bool zlib_stream_crc32(const uint8_t *cdata, unsigned cmode,
+      uint64_t csize, uint32_t *crc)
+{
+   int ret;
+   z_stream stream = {0};
+   uint8_t *out;
+
+   *crc = 0;
+
+   if (cmode == 0)
    {
-      uint32_t checksum, csize, size, offset;
-      unsigned cmode, namelength, extralength, commentlength,
-               offsetNL, offsetEL;
-      char filename[PATH_MAX_LENGTH] = {0};
-      const uint8_t *cdata = NULL;
-      uint32_t signature = read_le(directory + 0, 4);
+      *crc = crc32_update(0, cdata, csize);
+      return true;
+   }
+
+   if (cmode != 8)
+      return false;
 
-      if (signature != 0x02014b50)
+   out = (uint8_t*)malloc(ZLIB_CRC_CHUNK_SIZE);
+   if (!out)
+      return false;
+
+   if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+   {
+      free(out);
+      return false;
+   }
+
+   do
+   {
+      zlib_feed_input(&stream, &cdata, &csize);
+      stream.next_out  = out;
+      stream.avail_out = ZLIB_CRC_CHUNK_SIZE;
+
+      ret = inflate(&stream, Z_NO_FLUSH);
+      if (ret != Z_OK && ret != Z_STREAM_END)
          break;
 
-      cmode         = read_le(directory + 10, 2);
-      checksum      = read_le(directory + 16, 4);
-      csize         = read_le(directory + 20, 4);
-      size          = read_le(directory + 24, 4);
+      *crc = crc32_update(*crc, out, ZLIB_CRC_CHUNK_SIZE - stream.avail_out);
+   } while (ret != Z_STREAM_END);
 
-      namelength    = read_le(directory + 28, 2);
-      extralength   = read_le(directory + 30, 2);
-      commentlength = read_le(directory + 32, 2);
+   inflateEnd(&stream);
+   free(out);
 
-      if (namelength >= PATH_MAX_LENGTH)
-         GOTO_END_ERROR();
+   return ret == Z_STREAM_END;
+}
 
-      memcpy(filename, directory + 46, namelength);
+/**
+ * zlib_get_crc32s:
+ * @path                        : filename path of archive.
+ * @file_cb                     : called for every file in the archive.
+ * @userdata                    : userdata to pass to file_cb function pointer.
+ *
+ * Walks the central directory of a ZIP archive and reports the
+ * CRC32 stored for every file. With the mmap() backend only the
+ * pages of the end record and the directory are read; local
+ * headers and data are only touched for members stored without
+ * a CRC.
+ *
+ * Returns: true (1) on success, otherwise false (0).
+ **/
+static bool zlib_get_crc32s(const char *path,
+      compressed_crc_cb file_cb, void *userdata)
+{
+   void *handle;
+   zlib_dir_t dir;
+   zlib_entry_t entry;
+   int status;
+   bool ret              = true;
+   const struct zlib_file_backend *backend = zlib_get_default_file_backend();
 
-      offset        = read_le(directory + 42, 4);
-      offsetNL      = read_le(data + offset + 26, 2);
-      offsetEL      = read_le(data + offset + 28, 2);
+   handle = backend->open(path);
+   if (!handle)
+      GOTO_END_ERROR();
 
-      cdata = data + offset + 30 + offsetNL + offsetEL;
+   if (!zlib_dir_open(&dir, backend->data(handle), backend->size(handle)))
+      GOTO_END_ERROR();
 
-#if 0
-      RARCH_LOG("OFFSET: %u, CSIZE: %u, SIZE: %u.\n", offset + 30 + 
-      offsetNL + offsetEL, csize, size);
-#endif
+   while ((status = zlib_dir_next(&dir, &entry)) > 0)
+   {
+      size_t namelength = strlen(entry.name);
 
-      if (!file_cb(filename, valid_exts, cdata, cmode,
-               csize, size, checksum, userdata))
-         break;
+      /* Skip directories. */
+      if (namelength && (entry.name[namelength - 1] == '/' ||
+               entry.name[namelength - 1] == '\\'))
+         continue;
 
-      directory += 46 + namelength + extralength + commentlength;
+      if (!entry.checksum && entry.size)
+      {
+         /* No CRC in the directory, hash the member itself. */
+         const uint8_t *cdata = zlib_entry_data(&dir, &entry);
+
+         if (!cdata || !zlib_stream_crc32(cdata, entry.cmode,
+                  entry.csize, &entry.checksum))
+            GOTO_END_ERROR();
+      }
+
+      if (!file_cb(entry.name, entry.size, entry.checksum, userdata))
+         break;
    }
 
+   if (status < 0)
+      GOTO_END_ERROR();
+
 end:
    if (handle)
       backend->free(handle);
@@ -384,7 +956,7 @@ struct zip_extract_userdata
 
 static bool zip_extract_cb(const char *name, const char *valid_exts,
       const uint8_t *cdata,
-      unsigned cmode, uint32_t csize, uint32_t size,
+      unsigned cmode, uint64_t csize, uint64_t size,
       uint32_t checksum, void *userdata)
 {
    struct zip_extract_userdata *data = (struct zip_extract_userdata*)userdata;
@@ -392,6 +964,8 @@ static bool zip_extract_cb(const char *name, const char *valid_exts,
    /* Extract first content that matches our list. */
    const char *ext = path_get_extension(name);
 
+   (void)valid_exts;
+
    if (ext && string_list_find_elem(data->ext, ext))
    {
       char new_path[PATH_MAX_LENGTH];
@@ -407,16 +981,20 @@ static bool zip_extract_cb(const char *name, const char *valid_exts,
       {
          /* Uncompressed. */
          case 0:
-            data->found_content = write_file(new_path, cdata, size);
-            return false;
          /* Deflate. */
          case 8:
-            if (zlib_inflate_data_to_file(new_path, valid_exts,
-                     cdata, csize, size, checksum))
             {
-               strlcpy(data->zip_path, new_path, data->zip_path_size);
-               data->found_content = true;
-               return false;
+               uint8_t *buffer = (uint8_t*)malloc(ZLIB_INFLATE_CHUNK_SIZE);
+
+               if (buffer && zlib_extract_member(new_path, cdata, cmode,
+                        csize, size, checksum,
+                        buffer, ZLIB_INFLATE_CHUNK_SIZE))
+               {
+                  strlcpy(data->zip_path, new_path, data->zip_path_size);
+                  data->found_content = true;
+               }
+
+               free(buffer);
             }
             return false;
 
@@ -480,9 +1058,202 @@ end:
    return ret;
 }
 
+struct zip_find_userdata
+{
+   char *zip_path;
+   size_t zip_path_size;
+   struct string_list *ext;
+   bool found_content;
+};
+
+static bool zip_find_cb(const char *name, const char *valid_exts,
+      const uint8_t *cdata,
+      unsigned cmode, uint64_t csize, uint64_t size,
+      uint32_t checksum, void *userdata)
+{
+   struct zip_find_userdata *data = (struct zip_find_userdata*)userdata;
+   const char *ext = path_get_extension(name);
+
+   (void)valid_exts;
+   (void)cdata;
+   (void)csize;
+   (void)size;
+   (void)checksum;
+
+   /* Same choice as zip_extract_cb(). */
+   if (!ext || !string_list_find_elem(data->ext, ext))
+      return true;
+
+   if (cmode == 0 || cmode == 8)
+   {
+      strlcat(data->zip_path, "#", data->zip_path_size);
+      strlcat(data->zip_path, name, data->zip_path_size);
+      data->found_content = true;
+   }
+
+   return false;
+}
+
+/**
+ * zlib_find_first_content_file:
+ * @zip_path                    : filename path to ZIP archive.
+ * @zip_path_size               : size of @zip_path.
+ * @valid_exts                  : valid extensions for a content file.
+ *
+ * Finds the content file zlib_extract_first_content_file() would
+ * extract, without extracting it. On success '#' and the name of
+ * the file are appended to @zip_path, so that read_file()
+ * decompresses it straight into memory.
+ *
+ * Returns : true (1) on success, otherwise false (0).
+ **/
+bool zlib_find_first_content_file(char *zip_path, size_t zip_path_size,
+      const char *valid_exts)
+{
+   struct string_list *list;
+   bool ret = true;
+   struct zip_find_userdata userdata = {0};
+
+   if (!valid_exts)
+   {
+      RARCH_ERR("Libretro implementation does not have any valid extensions. Cannot unzip without knowing this.\n");
+      return false;
+   }
+
+   list = string_split(valid_exts, "|");
+   if (!list)
+      GOTO_END_ERROR();
+
+   userdata.zip_path      = zip_path;
+   userdata.zip_path_size = zip_path_size;
+   userdata.ext           = list;
+
+   if (!zlib_parse_file(zip_path, valid_exts, zip_find_cb, &userdata))
+   {
+      RARCH_ERR("Parsing ZIP failed.\n");
+      GOTO_END_ERROR();
+   }
+
+   if (!userdata.found_content)
+   {
+      RARCH_ERR("Didn't find any content that matched valid extensions for libretro implementation.\n");
+      GOTO_END_ERROR();
+   }
+
+end:
+   if (list)
+      string_list_free(list);
+   return ret;
+}
+
+struct zip_read_userdata
+{
+   const char *needle;
+   void **buf;
+   long size;
+   bool found;
+};
+
+static bool zip_read_cb(const char *name, const char *valid_exts,
+      const uint8_t *cdata,
+      unsigned cmode, uint64_t csize, uint64_t size,
+      uint32_t checksum, void *userdata)
+{
+   uint32_t real_checksum = 0;
+   uint8_t *out = NULL;
+   struct zip_read_userdata *data = (struct zip_read_userdata*)userdata;
+
+   (void)valid_exts;
+
+   if (strcmp(name, data->needle) != 0)
+      return true;
+
+   data->found = true;
+
+   if (size >= LONG_MAX || size >= (size_t)-1)
+   {
+      RARCH_ERR("%s is too large to be loaded into memory.\n", name);
+      return false;
+   }
+
+   out = (uint8_t*)malloc(size + 1);
+   if (!out)
+      return false;
+
+   switch (cmode)
+   {
+      /* Uncompressed. */
+      case 0:
+         if (csize < size)
+            goto error;
+         memcpy(out, cdata, size);
+         real_checksum = crc32_calculate(out, size);
+         break;
+      /* Deflate. */
+      case 8:
+         if (!zlib_inflate_data_to_buffer(cdata, csize, out, size,
+                  &real_checksum))
+            goto error;
+         break;
+      default:
+         RARCH_ERR("Unsupported compression method %u for %s.\n",
+               cmode, name);
+         goto error;
+   }
+
+   if (real_checksum != checksum)
+      RARCH_WARN("File CRC differs from ZIP CRC. File: 0x%x, ZIP: 0x%x.\n",
+            (unsigned)real_checksum, (unsigned)checksum);
+
+   /* Allow for easy reading of strings, like read_file(). */
+   out[size]  = '\0';
+   *data->buf = out;
+   data->size = size;
+   return false;
+
+error:
+   free(out);
+   return false;
+}
+
+/**
+ * zlib_read_file:
+ * @path                        : filename path of archive.
+ * @needle                      : name of the file inside the archive.
+ * @buf                         : buffer to allocate and decompress
+ *                                the file into. Needs to be freed
+ *                                manually.
+ *
+ * Decompresses a file from a ZIP archive directly into memory,
+ * without going through a temporary file.
+ *
+ * Returns: size of the file, -1 on error.
+ **/
+long zlib_read_file(const char *path, const char *needle, void **buf)
+{
+   struct zip_read_userdata userdata = {0};
+
+   userdata.needle = needle;
+   userdata.buf    = buf;
+   userdata.size   = -1;
+
+   if (!zlib_parse_file(path, NULL, zip_read_cb, &userdata))
+   {
+      RARCH_ERR("Parsing ZIP failed.\n");
+      return -1;
+   }
+
+   if (!userdata.found)
+      RARCH_ERR("File %s not found in %s\n", needle, path);
+   else if (userdata.size < 0)
+      RARCH_ERR("Could not decompress %s from %s.\n", needle, path);
+
+   return userdata.size;
+}
+
 static bool zlib_get_file_list_cb(const char *path, const char *valid_exts,
       const uint8_t *cdata,
-      unsigned cmode, uint32_t csize, uint32_t size, uint32_t checksum,
+      unsigned cmode, uint64_t csize, uint64_t size, uint32_t checksum,
       void *userdata)
 {
    union string_list_elem_attr attr;
@@ -554,6 +1325,226 @@ struct string_list *zlib_get_file_list(const char *path, const char *valid_exts)
    return list;
 }
 
+/* Whole-archive extraction streams every member through a buffer
+ * of this size, and runs as many workers as the budget allows. */
+#define ZLIB_EXTRACT_BUFFER_SIZE (1024 * 1024)
+#define ZLIB_EXTRACT_MEMORY_BUDGET (4 * ZLIB_EXTRACT_BUFFER_SIZE)
+
+typedef struct
+{
+   char *path;
+   const uint8_t *cdata;
+   unsigned cmode;
+   uint32_t checksum;
+   uint64_t csize;
+   uint64_t size;
+} zlib_extract_job_t;
+
+typedef struct
+{
+   zlib_extract_job_t *jobs;
+   size_t count;
+   size_t next;
+   bool failed;
+#ifdef HAVE_THREADS
+   slock_t *lock;
+#endif
+} zlib_extract_queue_t;
+
+static int zlib_extract_job_compare(const void *a, const void *b)
+{
+   const zlib_extract_job_t *job_a = (const zlib_extract_job_t*)a;
+   const zlib_extract_job_t *job_b = (const zlib_extract_job_t*)b;
+
+   /* Largest first, so that one big member does not
+    * hold up the end of the run. */
+   if (job_a->size != job_b->size)
+      return (job_a->size < job_b->size) ? 1 : -1;
+   return 0;
+}
+
+/**
+ * zlib_extract_worker:
+ * @data                        : extraction queue.
+ *
+ * Extracts queued members until the queue is empty.
+ **/
+static void zlib_extract_worker(void *data)
+{
+   zlib_extract_queue_t *queue = (zlib_extract_queue_t*)data;
+   uint8_t *buffer = (uint8_t*)malloc(ZLIB_EXTRACT_BUFFER_SIZE);
+
+   for (;;)
+   {
+      zlib_extract_job_t *job = NULL;
+      bool ok;
+
+#ifdef HAVE_THREADS
+      if (queue->lock)
+         slock_lock(queue->lock);
+#endif
+      if (!buffer)
+         queue->failed = true;
+      else if (queue->next < queue->count && !queue->failed)
+         job = &queue->jobs[queue->next++];
+#ifdef HAVE_THREADS
+      if (queue->lock)
+         slock_unlock(queue->lock);
+#endif
+
+      if (!job)
+         break;
+
+      ok = zlib_extract_member(job->path, job->cdata, job->cmode,
+            job->csize, job->size, job->checksum,
+            buffer, ZLIB_EXTRACT_BUFFER_SIZE);
+
+      if (!ok)
+      {
+#ifdef HAVE_THREADS
+         if (queue->lock)
+            slock_lock(queue->lock);
+#endif
+         queue->failed = true;
+#ifdef HAVE_THREADS
+         if (queue->lock)
+            slock_unlock(queue->lock);
+#endif
+      }
+   }
+
+   free(buffer);
+}
+
+/**
+ * zlib_extract_archive:
+ * @path                        : filename path of archive.
+ * @path_cb                     : picks the output path of every member.
+ * @userdata                    : userdata to pass to @path_cb.
+ *
+ * Extracts a whole ZIP archive. The members are listed first,
+ * then inflated in parallel by a pool of workers. Each worker
+ * streams its members to disk through one fixed-size buffer, so
+ * the output held in memory stays within
+ * ZLIB_EXTRACT_MEMORY_BUDGET whatever the size of the members.
+ *
+ * Returns: true (1) if every selected member was extracted,
+ * otherwise false (0).
+ **/
+bool zlib_extract_archive(const char *path,
+      zlib_extract_path_cb path_cb, void *userdata)
+{
+   void *handle;
+   zlib_dir_t dir;
+   zlib_entry_t entry;
+   int status;
+   size_t i, capacity = 0;
+   zlib_extract_queue_t queue;
+   bool ret = true;
+   const struct zlib_file_backend *backend = zlib_get_default_file_backend();
+#ifdef HAVE_THREADS
+   sthread_t *threads[ZLIB_EXTRACT_MEMORY_BUDGET / ZLIB_EXTRACT_BUFFER_SIZE];
+   unsigned num_threads = 0;
+#endif
+
+   memset(&queue, 0, sizeof(queue));
+
+   handle = backend->open(path);
+   if (!handle)
+      GOTO_END_ERROR();
+
+   if (!zlib_dir_open(&dir, backend->data(handle), backend->size(handle)))
+      GOTO_END_ERROR();
+
+   while ((status = zlib_dir_next(&dir, &entry)) > 0)
+   {
+      char out_path[PATH_MAX_LENGTH];
+      size_t namelength = strlen(entry.name);
+      zlib_extract_job_t *job;
+
+      out_path[0] = '\0';
+      if (!path_cb(entry.name, out_path, sizeof(out_path), userdata))
+         GOTO_END_ERROR();
+
+      /* Directories are left to the callback. */
+      if (!*out_path || !namelength || entry.name[namelength - 1] == '/'
+            || entry.name[namelength - 1] == '\\')
+         continue;
+
+      if (queue.count == capacity)
+      {
+         zlib_extract_job_t *jobs;
+
+         capacity = capacity ? capacity * 2 : 64;
+         jobs     = (zlib_extract_job_t*)
+            realloc(queue.jobs, capacity * sizeof(*jobs));
+         if (!jobs)
+            GOTO_END_ERROR();
+         queue.jobs = jobs;
+      }
+
+      job           = &queue.jobs[queue.count];
+      job->path     = strdup(out_path);
+      job->cdata    = zlib_entry_data(&dir, &entry);
+      job->cmode    = entry.cmode;
+      job->checksum = entry.checksum;
+      job->csize    = entry.csize;
+      job->size     = entry.size;
+
+      if (!job->path)
+         GOTO_END_ERROR();
+      queue.count++;
+
+      if (!job->cdata)
+         GOTO_END_ERROR();
+   }
+
+   if (status < 0)
+      GOTO_END_ERROR();
+
+   qsort(queue.jobs, queue.count, sizeof(*queue.jobs),
+         zlib_extract_job_compare);
+
+   /* The calling thread is one of the workers. */
+#ifdef HAVE_THREADS
+   if (queue.count > 1 && (queue.lock = slock_new()))
+   {
+      size_t workers = ZLIB_EXTRACT_MEMORY_BUDGET / ZLIB_EXTRACT_BUFFER_SIZE;
+
+      if (workers > queue.count)
+         workers = queue.count;
+
+      while (num_threads + 1 < workers)
+      {
+         threads[num_threads] = sthread_create(zlib_extract_worker, &queue);
+         if (!threads[num_threads])
+            break;
+         num_threads++;
+      }
+   }
+#endif
+
+   zlib_extract_worker(&queue);
+
+#ifdef HAVE_THREADS
+   for (i = 0; i < num_threads; i++)
+      sthread_join(threads[i]);
+   if (queue.lock)
+      slock_free(queue.lock);
+#endif
+
+   if (queue.failed)
+      GOTO_END_ERROR();
+
+end:
+   for (i = 0; i < queue.count; i++)
+      free(queue.jobs[i].path);
+   free(queue.jobs);
+   if (handle)
+      backend->free(handle);
+   return ret;
+}
+
 struct string_list *compressed_file_list_new(const char *path,
       const char* ext)
 {
@@ -571,3 +1562,18 @@ struct string_list *compressed_file_list_new(const char *path,
 #endif
    return NULL;
 }
+
+bool compressed_file_get_crc32s(const char *path,
+      compressed_crc_cb file_cb, void *userdata)
+{
+   const char *file_ext = path_get_extension(path);
+
+#ifdef HAVE_7ZIP
+   if (strcasecmp(file_ext, "7z") == 0)
+      return compressed_7zip_get_crc32s(path, file_cb, userdata);
+#endif
+   if (strcasecmp(file_ext, "zip") == 0)
+      return zlib_get_crc32s(path, file_cb, userdata);
+
+   return false;
+}
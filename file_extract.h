@@ -21,6 +21,11 @@
 #include <stddef.h>
 #include <stdint.h>
 
+/* Called for every member of an archive with its uncompressed size
+ * and CRC32. Returns true when parsing should continue. */
+typedef bool (*compressed_crc_cb)(const char *name, uint64_t size,
+      uint32_t crc32, void *userdata);
+
 #ifdef HAVE_7ZIP
 #include "decompress/7zip_support.h"
 #endif
@@ -31,9 +36,16 @@
 
 /* Returns true when parsing should continue. False to stop. */
 typedef bool (*zlib_file_cb)(const char *name, const char *valid_exts,
-      const uint8_t *cdata, unsigned cmode, uint32_t csize, uint32_t size,
+      const uint8_t *cdata, unsigned cmode, uint64_t csize, uint64_t size,
       uint32_t crc32, void *userdata);
 
+/* Called for every member of an archive by zlib_extract_archive().
+ * Stores the path to extract the member to in @path, or leaves it
+ * empty to skip the member. Directories are never extracted, the
+ * callback may create them. Returns false to abort extraction. */
+typedef bool (*zlib_extract_path_cb)(const char *name, char *path,
+      size_t path_size, void *userdata);
+
 /**
  * zlib_parse_file:
  * @file                        : filename path of archive
@@ -50,6 +62,21 @@ typedef bool (*zlib_file_cb)(const char *name, const char *valid_exts,
 bool zlib_parse_file(const char *file, const char *valid_exts,
       zlib_file_cb file_cb, void *userdata);
 
+/**
+ * zlib_extract_archive:
+ * @path                        : filename path of archive.
+ * @path_cb                     : picks the output path of every member.
+ * @userdata                    : userdata to pass to @path_cb.
+ *
+ * Extracts a whole ZIP archive, inflating the members in parallel
+ * with a bounded amount of memory.
+ *
+ * Returns: true (1) if every selected member was extracted,
+ * otherwise false (0).
+ **/
+bool zlib_extract_archive(const char *path,
+      zlib_extract_path_cb path_cb, void *userdata);
+
 /**
  * zlib_extract_first_content_file:
  * @zip_path                    : filename path to ZIP archive.
@@ -65,6 +92,37 @@ bool zlib_parse_file(const char *file, const char *valid_exts,
 bool zlib_extract_first_content_file(char *zip_path, size_t zip_path_size, 
       const char *valid_exts, const char *extraction_dir);
 
+/**
+ * zlib_find_first_content_file:
+ * @zip_path                    : filename path to ZIP archive.
+ * @zip_path_size               : size of @zip_path.
+ * @valid_exts                  : valid extensions for a content file.
+ *
+ * Finds the content file zlib_extract_first_content_file() would
+ * extract, without extracting it. On success '#' and the name of
+ * the file are appended to @zip_path, so that read_file()
+ * decompresses it straight into memory.
+ *
+ * Returns : true (1) on success, otherwise false (0).
+ **/
+bool zlib_find_first_content_file(char *zip_path, size_t zip_path_size,
+      const char *valid_exts);
+
+/**
+ * zlib_read_file:
+ * @path                        : filename path of archive.
+ * @needle                      : name of the file inside the archive.
+ * @buf                         : buffer to allocate and decompress
+ *                                the file into. Needs to be freed
+ *                                manually.
+ *
+ * Decompresses a file from a ZIP archive directly into memory,
+ * without going through a temporary file.
+ *
+ * Returns: size of the file, -1 on error.
+ **/
+long zlib_read_file(const char *path, const char *needle, void **buf);
+
 /**
  * zlib_get_file_list:
  * @path                        : filename path of archive
@@ -88,10 +146,26 @@ struct string_list *zlib_get_file_list(const char *path, const char *valid_exts)
  * Returns: true (1) on success, otherwise false (0).
  **/
 bool zlib_inflate_data_to_file(const char *path, const char *valid_exts,
-      const uint8_t *data, uint32_t csize, uint32_t size, uint32_t crc32);
+      const uint8_t *data, uint64_t csize, uint64_t size, uint32_t crc32);
 
 struct string_list *compressed_file_list_new(const char *filename,
       const char* ext);
 
+/**
+ * compressed_file_get_crc32s:
+ * @path                        : filename path of archive.
+ * @file_cb                     : called for every file in the archive.
+ * @userdata                    : userdata to pass to file_cb function pointer.
+ *
+ * Identifies the files of a ZIP or 7z archive by reading the
+ * CRC32s stored in its headers, without decompressing anything.
+ * Members whose header carries no CRC are decompressed and hashed
+ * in chunks.
+ *
+ * Returns: true (1) on success, otherwise false (0).
+ **/
+bool compressed_file_get_crc32s(const char *path,
+      compressed_crc_cb file_cb, void *userdata);
+
 #endif
 
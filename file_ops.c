@@ -185,7 +185,11 @@ long read_compressed_file(const char * path, void **buf,
 #endif
 #ifdef HAVE_ZLIB
    if (strcasecmp(file_ext,"zip") == 0)
+   {
+      if (!optional_filename)
+         return zlib_read_file(archive_path,archive_found,buf);
       return read_zip_file(archive_path,archive_found,buf,optional_filename);
+   }
 #endif
    return -1;
 }
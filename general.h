@@ -616,6 +616,13 @@ struct global
       bool movie_start_recording;
       bool movie_start_playback;
       bool movie_end;
+
+      /* Headless, unthrottled playback (--bsvbench). */
+      bool benchmark;
+      retro_time_t benchmark_start;
+      uint32_t *benchmark_frame_usec;
+      size_t benchmark_frames;
+      size_t benchmark_frames_size;
    } bsv;
 
    bool sram_load_disable;
@@ -644,6 +651,9 @@ struct global
    bool netplay_is_spectate;
    unsigned netplay_sync_frames;
    unsigned netplay_port;
+   /* Injected network conditions, for benchmarking. */
+   unsigned netplay_sim_delay_ms;
+   unsigned netplay_sim_loss;
 #endif
 
    /* Recording. */
@@ -58,14 +58,31 @@
  **/
 void sha256_hash(char *out, const uint8_t *in, size_t size);
 
+/**
+ * crc32_calculate:
+ * @data              : Input.
+ * @length            : Size of @data.
+ *
+ * Returns: CRC32 (zlib polynomial) of @data.
+ **/
+uint32_t crc32_calculate(const uint8_t *data, size_t length);
+
+/**
+ * crc32_update:
+ * @crc               : CRC32 of the preceding data, 0 to start.
+ * @data              : Input.
+ * @length            : Size of @data.
+ *
+ * Continues a CRC32 over @data, like zlib's crc32(), so large
+ * inputs can be hashed in chunks.
+ *
+ * Returns: CRC32 of the preceding data followed by @data.
+ **/
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t length);
+
 #ifdef HAVE_ZLIB
 #include <zlib.h>
 
-static inline uint32_t crc32_calculate(const uint8_t *data, size_t length)
-{
-   return crc32(0, data, length);
-}
-
 static inline uint32_t crc32_adjust(uint32_t crc, uint8_t data)
 {
    /* zlib and nall have different
@@ -73,13 +90,12 @@ static inline uint32_t crc32_adjust(uint32_t crc, uint8_t data)
    return ~crc32(~crc, &data, 1);
 }
 #else
-uint32_t crc32_calculate(const uint8_t *data, size_t length);
 uint32_t crc32_adjust(uint32_t crc, uint8_t data);
 #endif
 
 typedef struct SHA1Context
 {
-   unsigned Message_Digest[5]; /* Message Digest (output)          */
+   uint32_t Message_Digest[5]; /* Message Digest (output)          */
 
    unsigned Length_Low;        /* Message length in bits           */
    unsigned Length_High;       /* Message length in bits           */
@@ -93,5 +109,15 @@ typedef struct SHA1Context
 
 int sha1_calculate(const char *path, char *result);
 
+/**
+ * sha1_hash:
+ * @out               : Output (41 bytes: 40 uppercase hex digits + NUL).
+ * @in                : Input.
+ * @size              : Size of @in.
+ *
+ * Hashes @in with SHA1.
+ **/
+void sha1_hash(char *out, const uint8_t *in, size_t size);
+
 #endif
 
@@ -31,7 +31,6 @@
 #include <compat/msvc.h>
 #include <file/file_path.h>
 #include <retro_miscellaneous.h>
-#include <string/string_list.h>
 
 #if !defined(_WIN32) && !defined(__CELLOS_LV2__) && !defined(_XBOX)
 #include <sys/param.h> /* PATH_MAX */
@@ -43,52 +42,205 @@
 #endif
 
 #define MAX_INCLUDE_DEPTH 16
+#define CONFIG_INDEX_MIN_SIZE 64
+
+/* A config file is read into one block holding this header, the
+ * file's text, which is tokenized in place, and an entry slot
+ * for each of its lines. */
+struct config_arena
+{
+   struct config_arena *next;
+};
+
+#define CONFIG_ARENA_TEXT(arena) ((char*)((arena) + 1))
+#define CONFIG_ARENA_ALIGN(size) \
+   (((size) + sizeof(void*) - 1) & ~(sizeof(void*) - 1))
 
 
 static config_file_t *config_file_new_internal(const char *path, unsigned depth);
 void config_file_free(config_file_t *conf);
 
-static char *getaline(FILE *file)
+static uint32_t config_hash_key(const char *key)
 {
-   char* newline = (char*)malloc(9);
-   char* newline_tmp = NULL;
-   size_t cur_size = 8;
-   size_t idx = 0;
-   int in = getc(file);
+   /* FNV-1a */
+   uint32_t hash = 0x811c9dc5;
 
-   if (!newline)
-      return NULL;
+   while (*key)
+   {
+      hash ^= (uint8_t)*key++;
+      hash *= 0x01000193;
+   }
+
+   return hash;
+}
+
+/* Returns the index slot holding @key, or the empty slot it
+ * would be inserted at. */
+static struct config_entry_list **config_index_slot(
+      const config_file_t *conf, const char *key, uint32_t hash)
+{
+   size_t mask = conf->index_size - 1;
+   size_t i    = hash & mask;
 
-   while (in != EOF && in != '\n')
+   while (conf->index[i])
    {
-      if (idx == cur_size)
-      {
-         cur_size *= 2;
-         newline_tmp = (char*)realloc(newline, cur_size + 1);
+      const struct config_entry_list *entry = conf->index[i];
 
-         if (!newline_tmp)
-         {
-            free(newline);
-            return NULL;
-         }
+      if (entry->hash == hash && !strcmp(entry->key, key))
+         break;
+      i = (i + 1) & mask;
+   }
 
-         newline = newline_tmp;
+   return &conf->index[i];
+}
+
+/* Indexes every entry, keeping the first one in list order for
+ * each key. If this runs out of memory, conf is left without an
+ * index and lookups fall back to walking the list. */
+static void config_index_rebuild(config_file_t *conf)
+{
+   struct config_entry_list *list = NULL;
+   size_t count                   = 0;
+   size_t size                    = CONFIG_INDEX_MIN_SIZE;
+
+   free(conf->index);
+   conf->index       = NULL;
+   conf->index_size  = 0;
+   conf->index_count = 0;
+
+   for (list = conf->entries; list; list = list->next)
+      count++;
+   while (size < count * 2)
+      size *= 2;
+
+   conf->index = (struct config_entry_list**)calloc(size,
+         sizeof(*conf->index));
+   if (!conf->index)
+      return;
+   conf->index_size = size;
+
+   for (list = conf->entries; list; list = list->next)
+   {
+      struct config_entry_list **slot = NULL;
+
+      list->hash = config_hash_key(list->key);
+      slot       = config_index_slot(conf, list->key, list->hash);
+      if (*slot)
+         continue;
+
+      *slot = list;
+      conf->index_count++;
+   }
+}
+
+/* Indexes an entry that was just linked at the end of the list. */
+static void config_index_add(config_file_t *conf,
+      struct config_entry_list *entry)
+{
+   struct config_entry_list **slot = NULL;
+
+   entry->hash = config_hash_key(entry->key);
+
+   if (!conf->index || (conf->index_count + 1) * 2 > conf->index_size)
+   {
+      config_index_rebuild(conf);
+      return;
+   }
+
+   slot = config_index_slot(conf, entry->key, entry->hash);
+   if (*slot)
+      return;
+
+   *slot = entry;
+   conf->index_count++;
+}
+
+static struct config_entry_list *config_get_entry(
+      const config_file_t *conf, const char *key)
+{
+   struct config_entry_list *list = NULL;
+
+   if (conf->index)
+      return *config_index_slot(conf, key, config_hash_key(key));
+
+   for (list = conf->entries; list; list = list->next)
+   {
+      if (strcmp(key, list->key) == 0)
+         return list;
+   }
+
+   return NULL;
+}
+
+/* Reads the rest of @file into a new arena, NUL-terminated.
+ * Its length is returned in @len. */
+static struct config_arena *config_arena_read(FILE *file, size_t *len)
+{
+   struct config_arena *arena = NULL;
+   size_t size                = 4096;
+   size_t read                = 0;
+   long file_size             = -1;
+
+   if (fseek(file, 0, SEEK_END) == 0)
+   {
+      file_size = ftell(file);
+      rewind(file);
+   }
+
+   /* One byte more than the file so that a complete read
+    * comes up short and ends the loop. */
+   if (file_size >= 0 && (unsigned long)file_size < ((size_t)-1 >> 1))
+      size = file_size + 1;
+
+   for (;;)
+   {
+      struct config_arena *tmp = (struct config_arena*)
+         realloc(arena, sizeof(*arena) + size + 1);
+
+      if (!tmp)
+      {
+         free(arena);
+         return NULL;
       }
 
-      newline[idx++] = in;
-      in = getc(file);
+      arena = tmp;
+      read += fread(CONFIG_ARENA_TEXT(arena) + read, 1, size - read, file);
+      if (read < size)
+         break;
+      size *= 2;
    }
-   newline[idx] = '\0';
-   return newline; 
+
+   CONFIG_ARENA_TEXT(arena)[read] = '\0';
+   *len = read;
+   return arena;
+}
+
+/* Moves the arenas of @src, and so the storage of any entries
+ * taken from it, over to @dst. */
+static void config_file_take_arenas(config_file_t *dst, config_file_t *src)
+{
+   struct config_arena *last = src->arenas;
+
+   if (!last)
+      return;
+
+   while (last->next)
+      last = last->next;
+
+   last->next   = dst->arenas;
+   dst->arenas  = src->arenas;
+   src->arenas  = NULL;
 }
 
+/* Terminates the value in place and returns it, or NULL if
+ * there is none. */
 static char *extract_value(char *line, bool is_value)
 {
-   char *save = NULL, *tok = NULL;
+   char *value = NULL;
 
    if (is_value)
    {
-      while (isspace(*line))
+      while (isspace((unsigned char)*line))
          line++;
 
       /* If we don't have an equal sign here,
@@ -99,26 +251,32 @@ static char *extract_value(char *line, bool is_value)
       line++;
    }
 
-   while (isspace(*line))
+   while (isspace((unsigned char)*line))
       line++;
 
    /* We have a full string. Read until next ". */
    if (*line == '"')
    {
-      line++;
-      tok = strtok_r(line, "\"", &save);
-      if (!tok)
+      while (*line == '"')
+         line++;
+      if (*line == '\0')
          return NULL;
-      return strdup(tok);
+
+      value = line;
+      while (*line && *line != '"')
+         line++;
+      *line = '\0';
+      return value;
    }
    else if (*line == '\0') /* Nothing */
       return NULL;
 
    /* We don't have that. Read until next space. */
-   tok = strtok_r(line, " \n\t\f\r\v", &save);
-   if (tok)
-      return strdup(tok);
-   return NULL;
+   value = line;
+   while (*line && !isspace((unsigned char)*line))
+      line++;
+   *line = '\0';
+   return value;
 }
 
 static void set_list_readonly(struct config_entry_list *list)
@@ -133,35 +291,25 @@ static void set_list_readonly(struct config_entry_list *list)
 /* Move semantics? */
 static void add_child_list(config_file_t *parent, config_file_t *child)
 {
-   if (parent->entries)
-   {
-      struct config_entry_list *head = parent->entries;
-      while (head->next)
-         head = head->next;
+   struct config_entry_list *list = child->entries;
 
-      set_list_readonly(child->entries);
-      head->next = child->entries;
-   }
+   if (!list)
+      return;
+
+   set_list_readonly(list);
+
+   if (parent->tail)
+      parent->tail->next = list;
    else
-   {
-      set_list_readonly(child->entries);
-      parent->entries = child->entries;
-   }
+      parent->entries = list;
+   parent->tail = child->tail;
 
    child->entries = NULL;
+   child->tail    = NULL;
+   config_file_take_arenas(parent, child);
 
-   /* Rebase tail. */
-   if (parent->entries)
-   {
-      struct config_entry_list *head = 
-         (struct config_entry_list*)parent->entries;
-
-      while (head->next)
-         head = head->next;
-      parent->tail = head;
-   }
-   else
-      parent->tail = NULL;
+   for (; list; list = list->next)
+      config_index_add(parent, list);
 }
 
 static void add_include_list(config_file_t *conf, const char *path)
@@ -215,73 +363,43 @@ static void add_sub_conf(config_file_t *conf, char *line)
    sub_conf = (config_file_t*)
       config_file_new_internal(real_path, conf->include_depth + 1);
    if (!sub_conf)
-   {
-      free(path);
       return;
-   }
 
    /* Pilfer internal list. */
    add_child_list(conf, sub_conf);
    config_file_free(sub_conf);
-   free(path);
 }
 
 static char *strip_comment(char *str)
 {
    /* Remove everything after comment.
     * Keep #s inside string literals. */
-   char *strend = str + strlen(str);
-   bool cut_comment = true;
+   bool in_literal = false;
 
-   while (*str)
+   for (; *str; str++)
    {
-      char *comment = NULL;
-      char *literal = strchr(str, '\"');
-      if (!literal)
-         literal = strend;
-      comment = (char*)strchr(str, '#');
-      if (!comment)
-         comment = strend;
-
-      if (cut_comment && literal < comment)
+      if (*str == '"')
+         in_literal = !in_literal;
+      else if (*str == '#' && !in_literal)
       {
-         cut_comment = false;
-         str = literal + 1;
+         *str = '\0';
+         break;
       }
-      else if (!cut_comment && literal)
-      {
-         cut_comment = true;
-         str = literal + 1;
-      }
-      else if (comment)
-      {
-         *comment = '\0';
-         str = comment;
-      }
-      else
-         str = strend;
    }
 
    return str;
 }
 
+/* Tokenizes @line in place into @list. */
 static bool parse_line(config_file_t *conf,
       struct config_entry_list *list, char *line)
 {
-   char* comment = NULL;
-   char* key = (char*)malloc(9);
-   char* key_tmp = NULL;
-   size_t cur_size = 8;
-   size_t idx = 0;
-
-   if (!key)
-      return false;
+   char *comment = NULL;
+   char *key     = NULL;
+   char *value   = NULL;
 
    if (!line || !*line)
-   {
-      free(key);
       return false;
-   }
 
    comment = strip_comment(line);
 
@@ -289,10 +407,9 @@ static bool parse_line(config_file_t *conf,
    if ((comment == line) && (conf->include_depth < MAX_INCLUDE_DEPTH))
    {
       comment++;
-      if (strstr(comment, "include ") == comment)
+      if (strncmp(comment, "include ", strlen("include ")) == 0)
       {
          add_sub_conf(conf, comment + strlen("include "));
-         free(key);
          return false;
       }
    }
@@ -302,38 +419,89 @@ static bool parse_line(config_file_t *conf,
    }
 
    /* Skips to first character. */
-   while (isspace(*line))
+   while (isspace((unsigned char)*line))
       line++;
 
-   while (isgraph(*line))
-   {
-      if (idx == cur_size)
-      {
-         cur_size *= 2;
-         key_tmp = (char*)realloc(key, cur_size + 1);
+   key = line;
+   while (isgraph((unsigned char)*line))
+      line++;
 
-         if (!key_tmp)
-         {
-            free(key);
-            return false;
-         }
+   /* The key has to be followed by whitespace before the '='. */
+   if (!isspace((unsigned char)*line))
+      return false;
+   *line++ = '\0';
 
-         key = key_tmp;
-      }
+   value = extract_value(line, true);
+   if (!value)
+      return false;
 
-      key[idx++] = *line++;
+   list->key   = key;
+   list->value = value;
+   return true;
+}
+
+/* Tokenizes the text of @arena in place and links an entry
+ * into @conf for each valid line. Takes ownership of @arena. */
+static bool config_file_parse(config_file_t *conf,
+      struct config_arena *arena, size_t len)
+{
+   size_t lines                      = 1;
+   size_t offset                     = 0;
+   char *text                        = CONFIG_ARENA_TEXT(arena);
+   char *line                        = text;
+   struct config_arena *tmp          = NULL;
+   struct config_entry_list *entries = NULL;
+
+   while ((line = (char*)memchr(line, '\n', text + len - line)))
+   {
+      line++;
+      lines++;
    }
-   key[idx] = '\0';
-   list->key = key;
 
-   list->value = extract_value(line, true);
-   if (!list->value)
+   offset = CONFIG_ARENA_ALIGN(sizeof(*arena) + len + 1);
+   tmp    = (struct config_arena*)realloc(arena,
+         offset + lines * sizeof(*entries));
+   if (!tmp)
    {
-      list->key = NULL;
-      free(key);
+      free(arena);
       return false;
    }
 
+   arena        = tmp;
+   arena->next  = conf->arenas;
+   conf->arenas = arena;
+
+   text    = CONFIG_ARENA_TEXT(arena);
+   entries = (struct config_entry_list*)((char*)arena + offset);
+
+   for (line = text; line < text + len; )
+   {
+      char *next = (char*)memchr(line, '\n', text + len - line);
+
+      if (next)
+         *next++ = '\0';
+      else
+         next = text + len;
+
+      memset(entries, 0, sizeof(*entries));
+
+      if (parse_line(conf, entries, line))
+      {
+         entries->arena = true;
+
+         if (conf->entries)
+            conf->tail->next = entries;
+         else
+            conf->entries = entries;
+
+         conf->tail = entries;
+         config_index_add(conf, entries);
+         entries++;
+      }
+
+      line = next;
+   }
+
    return true;
 }
 
@@ -347,7 +515,15 @@ bool config_append_file(config_file_t *conf, const char *path)
    {
       new_conf->tail->next = conf->entries;
       conf->entries        = new_conf->entries; /* Pilfer. */
+      if (!conf->tail)
+         conf->tail        = new_conf->tail;
       new_conf->entries    = NULL;
+      new_conf->tail       = NULL;
+      config_file_take_arenas(conf, new_conf);
+
+      /* The new entries take priority, so every key may now
+       * resolve to a different entry. */
+      config_index_rebuild(conf);
    }
 
    config_file_free(new_conf);
@@ -357,8 +533,10 @@ bool config_append_file(config_file_t *conf, const char *path)
 static config_file_t *config_file_new_internal(
       const char *path, unsigned depth)
 {
-   FILE *file = NULL;
-   struct config_file *conf = (struct config_file*)calloc(1, sizeof(*conf));
+   size_t len                 = 0;
+   FILE *file                 = NULL;
+   struct config_arena *arena = NULL;
+   struct config_file *conf   = (struct config_file*)calloc(1, sizeof(*conf));
    if (!conf)
       return NULL;
 
@@ -382,49 +560,23 @@ static config_file_t *config_file_new_internal(
       return NULL;
    }
 
-   while (!feof(file))
-   {
-      struct config_entry_list *list = (struct config_entry_list*)
-         calloc(1, sizeof(*list));
-      char *line = NULL;
-
-      if (!list)
-      {
-         config_file_free(conf);
-         fclose(file);
-         return NULL;
-      }
-
-      line = getaline(file);
-
-      if (line)
-      {
-         if (parse_line(conf, list, line))
-         {
-            if (conf->entries)
-               conf->tail->next = list;
-            else
-               conf->entries = list;
-
-            conf->tail = list;
-         }
-
-         free(line);
-      }
+   arena = config_arena_read(file, &len);
+   fclose(file);
 
-      if (list != conf->tail)
-         free(list);
+   if (!arena || !config_file_parse(conf, arena, len))
+   {
+      config_file_free(conf);
+      return NULL;
    }
-   fclose(file);
 
    return conf;
 }
 
 config_file_t *config_file_new_from_string(const char *from_string)
 {
-   size_t i;
-   struct string_list *lines = NULL;
-   struct config_file *conf = (struct config_file*)calloc(1, sizeof(*conf));
+   size_t len                 = 0;
+   struct config_arena *arena = NULL;
+   struct config_file *conf   = (struct config_file*)calloc(1, sizeof(*conf));
    if (!conf)
       return NULL;
 
@@ -433,42 +585,21 @@ config_file_t *config_file_new_from_string(const char *from_string)
 
    conf->path = NULL;
    conf->include_depth = 0;
-   
-   lines = string_split(from_string, "\n");
-   if (!lines)
-      return conf;
 
-   for (i = 0; i < lines->size; i++)
+   len   = strlen(from_string);
+   arena = (struct config_arena*)malloc(sizeof(*arena) + len + 1);
+   if (!arena)
    {
-      struct config_entry_list *list = (struct config_entry_list*)
-         calloc(1, sizeof(*list));
-      char* line = lines->elems[i].data;
-
-      if (!list)
-      {
-         string_list_free(lines);
-         config_file_free(conf);
-         return NULL;
-      }
-
-      if (line)
-      {
-         if (parse_line(conf, list, line))
-         {
-            if (conf->entries)
-               conf->tail->next = list;
-            else
-               conf->entries = list;
-
-            conf->tail = list;
-         }
-      }
-
-      if (list != conf->tail)
-         free(list);
+      config_file_free(conf);
+      return NULL;
    }
+   memcpy(CONFIG_ARENA_TEXT(arena), from_string, len + 1);
 
-   string_list_free(lines);
+   if (!config_file_parse(conf, arena, len))
+   {
+      config_file_free(conf);
+      return NULL;
+   }
 
    return conf;
 }
@@ -482,17 +613,30 @@ void config_file_free(config_file_t *conf)
 {
    struct config_include_list *inc_tmp = NULL;
    struct config_entry_list *tmp = NULL;
+   struct config_arena *arena = NULL;
    if (!conf)
       return;
 
    tmp = conf->entries;
    while (tmp)
    {
-      struct config_entry_list *hold = NULL;
-      free(tmp->key);
-      free(tmp->value);
-      hold = tmp;
+      struct config_entry_list *hold = tmp;
       tmp = tmp->next;
+
+      if (hold->value_owned)
+         free(hold->value);
+      if (!hold->arena)
+      {
+         free(hold->key);
+         free(hold);
+      }
+   }
+
+   arena = conf->arenas;
+   while (arena)
+   {
+      struct config_arena *hold = arena;
+      arena = arena->next;
       free(hold);
    }
 
@@ -506,182 +650,136 @@ void config_file_free(config_file_t *conf)
       free(hold);
    }
 
+   free(conf->index);
    free(conf->path);
    free(conf);
 }
 
 bool config_get_double(config_file_t *conf, const char *key, double *in)
 {
-   struct config_entry_list *list = conf->entries;
+   const struct config_entry_list *entry = config_get_entry(conf, key);
 
-   while (list)
-   {
-      if (strcmp(key, list->key) == 0)
-      {
-         *in = strtod(list->value, NULL);
-         return true;
-      }
-      list = list->next;
-   }
-   return false;
+   if (!entry)
+      return false;
+
+   *in = strtod(entry->value, NULL);
+   return true;
 }
 
 bool config_get_float(config_file_t *conf, const char *key, float *in)
 {
-   struct config_entry_list *list = conf->entries;
+   const struct config_entry_list *entry = config_get_entry(conf, key);
 
-   while (list)
-   {
-      if (strcmp(key, list->key) == 0)
-      {
-         /* strtof() is C99/POSIX. Just use the more portable kind. */
-         *in = (float)strtod(list->value, NULL);
-         return true;
-      }
-      list = list->next;
-   }
-   return false;
+   if (!entry)
+      return false;
+
+   /* strtof() is C99/POSIX. Just use the more portable kind. */
+   *in = (float)strtod(entry->value, NULL);
+   return true;
 }
 
 bool config_get_int(config_file_t *conf, const char *key, int *in)
 {
-   struct config_entry_list *list = conf->entries;
+   int val;
+   const struct config_entry_list *entry = config_get_entry(conf, key);
 
-   while (list)
-   {
-      if (strcmp(key, list->key) == 0)
-      {
-         int val;
-         errno = 0;
-         val = strtol(list->value, NULL, 0);
-         if (errno == 0)
-         {
-            *in = val;
-            return true;
-         }
-         return false;
-      }
-      list = list->next;
-   }
-   return false;
+   if (!entry)
+      return false;
+
+   errno = 0;
+   val = strtol(entry->value, NULL, 0);
+   if (errno != 0)
+      return false;
+
+   *in = val;
+   return true;
 }
 
 bool config_get_uint64(config_file_t *conf, const char *key, uint64_t *in)
 {
-   struct config_entry_list *list = conf->entries;
+   uint64_t val;
+   const struct config_entry_list *entry = config_get_entry(conf, key);
 
-   while (list)
-   {
-      if (strcmp(key, list->key) == 0)
-      {
-         uint64_t val;
-         errno = 0;
-         val = strtoull(list->value, NULL, 0);
-         if (errno == 0)
-         {
-            *in = val;
-            return true;
-         }
-         return false;
-      }
-      list = list->next;
-   }
-   return false;
+   if (!entry)
+      return false;
+
+   errno = 0;
+   val = strtoull(entry->value, NULL, 0);
+   if (errno != 0)
+      return false;
+
+   *in = val;
+   return true;
 }
 
 bool config_get_uint(config_file_t *conf, const char *key, unsigned *in)
 {
-   struct config_entry_list *list = conf->entries;
+   unsigned val;
+   const struct config_entry_list *entry = config_get_entry(conf, key);
 
-   while (list != NULL)
-   {
-      if (strcmp(key, list->key) == 0)
-      {
-         unsigned val;
-         errno = 0;
-         val = strtoul(list->value, NULL, 0);
-         if (errno == 0)
-         {
-            *in = val;
-            return true;
-         }
-         return false;
-      }
-      list = list->next;
-   }
+   if (!entry)
+      return false;
+
+   errno = 0;
+   val = strtoul(entry->value, NULL, 0);
+   if (errno != 0)
+      return false;
 
-   return false;
+   *in = val;
+   return true;
 }
 
 bool config_get_hex(config_file_t *conf, const char *key, unsigned *in)
 {
-   struct config_entry_list *list = conf->entries;
+   unsigned val;
+   const struct config_entry_list *entry = config_get_entry(conf, key);
 
-   while (list)
-   {
-      if (strcmp(key, list->key) == 0)
-      {
-         unsigned val;
-         errno = 0;
-         val = strtoul(list->value, NULL, 16);
-         if (errno == 0)
-         {
-            *in = val;
-            return true;
-         }
-         return false;
-      }
-      list = list->next;
-   }
-   return false;
+   if (!entry)
+      return false;
+
+   errno = 0;
+   val = strtoul(entry->value, NULL, 16);
+   if (errno != 0)
+      return false;
+
+   *in = val;
+   return true;
 }
 
 bool config_get_char(config_file_t *conf, const char *key, char *in)
 {
-   struct config_entry_list *list = conf->entries;
+   const struct config_entry_list *entry = config_get_entry(conf, key);
 
-   while (list)
-   {
-      if (strcmp(key, list->key) == 0)
-      {
-         if (list->value[0] && list->value[1])
-            return false;
-         *in = *list->value;
-         return true;
-      }
-      list = list->next;
-   }
-   return false;
+   if (!entry)
+      return false;
+
+   if (entry->value[0] && entry->value[1])
+      return false;
+
+   *in = *entry->value;
+   return true;
 }
 
 bool config_get_string(config_file_t *conf, const char *key, char **str)
 {
-   struct config_entry_list *list = conf->entries;
+   const struct config_entry_list *entry = config_get_entry(conf, key);
 
-   while (list)
-   {
-      if (strcmp(key, list->key) == 0)
-      {
-         *str = strdup(list->value);
-         return true;
-      }
-      list = list->next;
-   }
-   return false;
+   if (!entry)
+      return false;
+
+   *str = strdup(entry->value);
+   return true;
 }
 
 bool config_get_array(config_file_t *conf, const char *key,
       char *buf, size_t size)
 {
-   struct config_entry_list *list = conf->entries;
+   const struct config_entry_list *entry = config_get_entry(conf, key);
 
-   while (list)
-   {
-      if (strcmp(key, list->key) == 0)
-         return strlcpy(buf, list->value, size) < size;
-      list = list->next;
-   }
-   return false;
+   if (!entry)
+      return false;
+
+   return strlcpy(buf, entry->value, size) < size;
 }
 
 bool config_get_path(config_file_t *conf, const char *key,
@@ -690,63 +788,56 @@ bool config_get_path(config_file_t *conf, const char *key,
 #if defined(RARCH_CONSOLE)
    return config_get_array(conf, key, buf, size);
 #else
-   struct config_entry_list *list = conf->entries;
+   const struct config_entry_list *entry = config_get_entry(conf, key);
 
-   while (list)
-   {
-      if (strcmp(key, list->key) == 0)
-      {
-         fill_pathname_expand_special(buf, list->value, size);
-         return true;
-      }
-      list = list->next;
-   }
-   return false;
+   if (!entry)
+      return false;
+
+   fill_pathname_expand_special(buf, entry->value, size);
+   return true;
 #endif
 }
 
 bool config_get_bool(config_file_t *conf, const char *key, bool *in)
 {
-   struct config_entry_list *list = conf->entries;
+   const struct config_entry_list *entry = config_get_entry(conf, key);
 
-   while (list)
-   {
-      if (strcmp(key, list->key) == 0)
-      {
-         if (strcasecmp(list->value, "true") == 0)
-            *in = true;
-         else if (strcasecmp(list->value, "1") == 0)
-            *in = true;
-         else if (strcasecmp(list->value, "false") == 0)
-            *in = false;
-         else if (strcasecmp(list->value, "0") == 0)
-            *in = false;
-         else
-            return false;
+   if (!entry)
+      return false;
 
-         return true;
-      }
-      list = list->next;
-   }
-   return false;
+   if (strcasecmp(entry->value, "true") == 0)
+      *in = true;
+   else if (strcasecmp(entry->value, "1") == 0)
+      *in = true;
+   else if (strcasecmp(entry->value, "false") == 0)
+      *in = false;
+   else if (strcasecmp(entry->value, "0") == 0)
+      *in = false;
+   else
+      return false;
+
+   return true;
 }
 
 void config_set_string(config_file_t *conf, const char *key, const char *val)
 {
    struct config_entry_list *elem = NULL;
-   struct config_entry_list *list = conf->entries;
-   struct config_entry_list *last = list;
-   while (list)
+   struct config_entry_list *list = config_get_entry(conf, key);
+
+   /* The first entry for a key may come from an #include, in which
+    * case a later writable one is updated instead. */
+   for (; list; list = list->next)
    {
       if (!list->readonly && (strcmp(key, list->key) == 0))
       {
-         free(list->value);
-         list->value = strdup(val);
+         /* Values read from a file stay in its arena until
+          * they are first changed. */
+         if (list->value_owned)
+            free(list->value);
+         list->value       = strdup(val);
+         list->value_owned = true;
          return;
       }
-
-      last = list;
-      list = list->next;
    }
 
    elem = (struct config_entry_list*)calloc(1, sizeof(*elem));
@@ -756,11 +847,15 @@ void config_set_string(config_file_t *conf, const char *key, const char *val)
 
    elem->key = strdup(key);
    elem->value = strdup(val);
+   elem->value_owned = true;
 
-   if (last)
-      last->next = elem;
+   if (conf->tail)
+      conf->tail->next = elem;
    else
       conf->entries = elem;
+   conf->tail = elem;
+
+   config_index_add(conf, elem);
 }
 
 void config_set_path(config_file_t *conf, const char *entry, const char *val)
@@ -871,16 +966,7 @@ void config_file_dump(config_file_t *conf, FILE *file)
 
 bool config_entry_exists(config_file_t *conf, const char *entry)
 {
-   struct config_entry_list *list = conf->entries;
-
-   while (list)
-   {
-      if (strcmp(entry, list->key) == 0)
-         return true;
-      list = list->next;
-   }
-
-   return false;
+   return config_get_entry(conf, entry) != NULL;
 }
 
 bool config_get_entry_list_head(config_file_t *conf,
@@ -38,6 +38,13 @@ struct config_entry_list
    /* If we got this from an #include,
     * do not allow overwrite. */
    bool readonly;
+   /* Entry and key live in a config file arena and
+    * are not freed on their own. */
+   bool arena;
+   /* Value was allocated by a setter rather than
+    * pointing into an arena. */
+   bool value_owned;
+   uint32_t hash;
    char *key;
    char *value;
    struct config_entry_list *next;
@@ -49,6 +56,8 @@ struct config_include_list
    struct config_include_list *next;
 };
 
+struct config_arena;
+
 struct config_file
 {
    char *path;
@@ -56,6 +65,17 @@ struct config_file
    struct config_entry_list *tail;
    unsigned include_depth;
 
+   /* Open-addressed hash index over entries, pointing at the
+    * first entry in list order for each key. The list itself
+    * keeps insertion order for config_file_dump(). */
+   struct config_entry_list **index;
+   size_t index_size;
+   size_t index_count;
+
+   /* Buffers holding the text of the parsed file and of its
+    * includes, tokenized in place, along with their entries. */
+   struct config_arena *arenas;
+
    struct config_include_list *includes;
 };
 
@@ -1,3 +1,7 @@
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
 #include "libretrodb.h"
 
 #include <sys/types.h>
@@ -14,19 +18,58 @@
 
 #include <stdio.h>
 
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
 #include "rmsgpack_dom.h"
 #include "rmsgpack.h"
-#include "bintree.h"
 #include "libretrodb_endian.h"
 #include "query.h"
 
-struct node_iter_ctx
+static struct rmsgpack_dom_value sentinal;
+
+/* An index loaded into memory in Eytzinger (BFS) order: the
+ * children of slot k are 2k and 2k+1, so the first levels of every
+ * search share the same few cache lines. Slot 0 is unused. */
+struct libretrodb_lookup
 {
-	libretrodb_t *db;
-	libretrodb_index_t *idx;
+   char name[50];
+   uint8_t key_size;
+   uint64_t count;
+   /* First eight key bytes as a big-endian integer, which orders
+    * like memcmp() on the key. */
+   uint64_t *prefix;
+   /* Full keys, only kept when key_size is larger than 8. */
+   uint8_t *keys;
+   uint64_t *offsets;
+   /* String indexes (key_size 0): slots sorted by their case-folded
+    * string, which points into pool. */
+   struct libretrodb_string_slot *slots;
+   const char *pool;
+   /* Index data read from the file when it is not mapped. */
+   uint8_t *data;
+   struct libretrodb_lookup *next;
 };
 
-static struct rmsgpack_dom_value sentinal;
+/* On-disk layout of a string index, after its header:
+ * uint64_t count, count slots, then the string pool. */
+struct libretrodb_string_slot
+{
+   uint64_t item;
+   uint32_t offset;
+   uint32_t len;
+};
+
+static void libretrodb_lookup_free(struct libretrodb_lookup *l)
+{
+   free(l->prefix);
+   free(l->keys);
+   free(l->offsets);
+   free(l->slots);
+   free(l->data);
+   free(l);
+}
 
 static int libretrodb_read_metadata(int fd, libretrodb_metadata_t *md)
 {
@@ -141,10 +184,54 @@ static void libretrodb_write_index_header(int fd, libretrodb_index_t * idx)
 
 void libretrodb_close(libretrodb_t *db)
 {
+#ifdef HAVE_MMAP
+   if (db->map)
+      munmap((void*)db->map, db->map_size);
+#endif
+   db->map      = NULL;
+   db->map_size = 0;
+
+   while (db->lookups)
+   {
+      struct libretrodb_lookup *next = db->lookups->next;
+      libretrodb_lookup_free(db->lookups);
+      db->lookups = next;
+   }
+
 	close(db->fd);
 	db->fd = -1;
 }
 
+/**
+ * libretrodb_map:
+ * @db                  : Handle to database.
+ *
+ * Maps the database file read-only so cursors can decode items in
+ * place instead of issuing a read() per msgpack token. Failure is not
+ * fatal, readers fall back to the file descriptor.
+ **/
+static void libretrodb_map(libretrodb_t *db)
+{
+#ifdef HAVE_MMAP
+   struct stat st;
+   void *map;
+
+   if (fstat(db->fd, &st) != 0 || st.st_size <= 0)
+      return;
+
+   map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, db->fd, 0);
+   if (map == MAP_FAILED)
+      return;
+
+#ifdef MADV_SEQUENTIAL
+   madvise(map, st.st_size, MADV_SEQUENTIAL);
+#endif
+
+   db->map      = (const uint8_t*)map;
+   db->map_size = st.st_size;
+#endif
+}
+
 int libretrodb_open(const char *path, libretrodb_t *db)
 {
    libretrodb_header_t header;
@@ -152,6 +239,10 @@ int libretrodb_open(const char *path, libretrodb_t *db)
    int rv;
    int fd = open(path, O_RDWR);
 
+   db->map      = NULL;
+   db->map_size = 0;
+   db->lookups  = NULL;
+
    if (fd == -1)
       return -errno;
 
@@ -164,7 +255,7 @@ int libretrodb_open(const char *path, libretrodb_t *db)
       goto error;
    }
 
-   if (strncmp(header.magic_number, MAGIC_NUMBER, sizeof(MAGIC_NUMBER)) != 0)
+   if (memcmp(header.magic_number, MAGIC_NUMBER, sizeof(MAGIC_NUMBER)-1) != 0)
    {
       rv = -EINVAL;
       goto error;
@@ -182,6 +273,7 @@ int libretrodb_open(const char *path, libretrodb_t *db)
    db->count = md.count;
    db->first_index_offset = lseek(fd, 0, SEEK_CUR);
    db->fd = fd;
+   libretrodb_map(db);
    return 0;
 error:
    close(fd);
@@ -196,9 +288,10 @@ static int libretrodb_find_index(libretrodb_t *db, const char *index_name,
 
    while (offset < eof)
    {
-      libretrodb_read_index_header(db->fd, idx);
+      if (libretrodb_read_index_header(db->fd, idx) < 0)
+         break;
 
-      if (strncmp(index_name, idx->name, strlen(idx->name)) == 0)
+      if (strcmp(index_name, idx->name) == 0)
          return 0;
 
       offset = lseek(db->fd, idx->next, SEEK_CUR);
@@ -207,78 +300,471 @@ static int libretrodb_find_index(libretrodb_t *db, const char *index_name,
    return -1;
 }
 
-static int node_compare(const void * a, const void * b, void * ctx)
+/* Searches interleaved by libretrodb_find_entries(). */
+#define LIBRETRODB_LOOKUP_BATCH 8
+
+#ifdef __GNUC__
+#define LIBRETRODB_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define LIBRETRODB_PREFETCH(p) ((void)0)
+#endif
+
+static uint64_t libretrodb_key_prefix(const uint8_t *key, uint8_t key_size)
 {
-   return memcmp(a, b, *(uint8_t *)ctx);
+   unsigned i;
+   unsigned len    = key_size < 8 ? key_size : 8;
+   uint64_t prefix = 0;
+
+   for (i = 0; i < len; i++)
+      prefix = (prefix << 8) | key[i];
+
+   return len < 8 ? prefix << (8 * (8 - len)) : prefix;
+}
+
+/* Returns non-zero if the key in slot @k sorts before @key. */
+static INLINE int libretrodb_lookup_less(const struct libretrodb_lookup *l,
+      uint64_t k, uint64_t prefix, const uint8_t *key)
+{
+   if (l->prefix[k] != prefix || !l->keys)
+      return l->prefix[k] < prefix;
+   return memcmp(l->keys + k * l->key_size, key, l->key_size) < 0;
 }
 
-static int binsearch(const void * buff, const void * item,
-      uint64_t count, uint8_t field_size, uint64_t * offset)
+/* Turns the final position of a descent into the slot holding the
+ * lower bound, or 0 if every key sorts before the searched one. */
+static uint64_t libretrodb_lookup_resolve(const struct libretrodb_lookup *l,
+      uint64_t k, uint64_t prefix, const uint8_t *key)
 {
-   int mid            = count / 2;
-   int item_size      = field_size + sizeof(uint64_t);
-   uint64_t * current = (uint64_t *)buff + (mid * item_size);
-   int rv             = node_compare(current, item, &field_size);
+   /* Undo the right turns taken after the last left turn. */
+   while (k & 1)
+      k >>= 1;
+   k >>= 1;
 
-   if (rv == 0)
-   {
-      *offset = *(uint64_t *)(current + field_size);
+   if (!k || l->prefix[k] != prefix)
       return 0;
-   }
+   if (l->keys && memcmp(l->keys + k * l->key_size, key, l->key_size))
+      return 0;
+   return k;
+}
 
-   if (count == 0)
-      return -1;
+static uint64_t libretrodb_lookup_fill(struct libretrodb_lookup *l,
+      const uint8_t *sorted, uint64_t i, uint64_t k)
+{
+   const uint8_t *rec;
+
+   if (k > l->count)
+      return i;
 
-   if (rv > 0)
-      return binsearch(buff, item, mid, field_size, offset);
+   i   = libretrodb_lookup_fill(l, sorted, i, 2 * k);
+   rec = sorted + i * (l->key_size + sizeof(uint64_t));
 
-   return binsearch(current + item_size, item,
-         count - mid, field_size, offset);
+   l->prefix[k] = libretrodb_key_prefix(rec, l->key_size);
+   memcpy(&l->offsets[k], rec + l->key_size, sizeof(uint64_t));
+   if (l->keys)
+      memcpy(l->keys + k * l->key_size, rec, l->key_size);
+
+   return libretrodb_lookup_fill(l, sorted, i + 1, 2 * k + 1);
 }
 
-int libretrodb_find_entry(libretrodb_t *db, const char *index_name,
-        const void *key, struct rmsgpack_dom_value *out)
+/**
+ * libretrodb_lookup_get:
+ * @db                  : Handle to database.
+ * @index_name          : Name of the index.
+ *
+ * Returns the in-memory copy of index @index_name, reading it from
+ * the database the first time it is asked for. The copy lives until
+ * libretrodb_close().
+ *
+ * Returns: the index, or NULL if it does not exist or is corrupt.
+ **/
+static struct libretrodb_lookup *libretrodb_lookup_get(libretrodb_t *db,
+      const char *index_name)
 {
    libretrodb_index_t idx;
-   int rv;
-   void * buff;
-   uint64_t offset;
-   ssize_t bufflen, nread = 0;
+   struct libretrodb_lookup *l;
+   uint64_t rec_size, pos;
+   uint8_t *buff      = NULL;
+   const uint8_t *src = NULL;
+
+   for (l = db->lookups; l; l = l->next)
+      if (strcmp(l->name, index_name) == 0)
+         return l;
 
    if (libretrodb_find_index(db, index_name, &idx) < 0)
-      return -1;
+      return NULL;
 
-   bufflen = idx.next;
-   buff = malloc(bufflen);
+   if (idx.key_size > 255)
+      return NULL;
 
-   if (!buff)
-      return -ENOMEM;
+   rec_size = idx.key_size + sizeof(uint64_t);
+   pos      = lseek(db->fd, 0, SEEK_CUR);
+
+   if (idx.key_size && idx.next % rec_size)
+      return NULL;
 
-   while (nread < bufflen)
+   if (db->map && pos + idx.next <= db->map_size)
+      src = db->map + pos;
+   else
    {
-      void * buff_ = (uint64_t *)buff + nread;
-      rv = read(db->fd, buff_, bufflen - nread);
+      uint64_t nread = 0;
 
-      if (rv <= 0)
+      buff = (uint8_t*)malloc(idx.next ? idx.next : 1);
+      if (!buff)
+         return NULL;
+
+      while (nread < idx.next)
       {
-         free(buff);
-         return -errno;
+         ssize_t rv = read(db->fd, buff + nread, idx.next - nread);
+
+         if (rv <= 0)
+         {
+            free(buff);
+            return NULL;
+         }
+         nread += rv;
       }
-      nread += rv;
+      src = buff;
    }
 
-   rv = binsearch(buff, key, db->count, idx.key_size, &offset);
+   l = (struct libretrodb_lookup*)calloc(1, sizeof(*l));
+   if (!l)
+      goto error;
+
+   strncpy(l->name, index_name, sizeof(l->name) - 1);
+   l->key_size = idx.key_size;
+
+   if (!l->key_size)
+   {
+      uint64_t i, pool_size;
+      size_t slots_size;
+
+      if (idx.next < sizeof(uint64_t))
+         goto error;
+
+      memcpy(&l->count, src, sizeof(uint64_t));
+      if (l->count > (idx.next - sizeof(uint64_t)) /
+            sizeof(struct libretrodb_string_slot))
+         goto error;
+
+      slots_size = l->count * sizeof(struct libretrodb_string_slot);
+      pool_size  = idx.next - sizeof(uint64_t) - slots_size;
+      l->slots   = (struct libretrodb_string_slot*)malloc(
+            slots_size ? slots_size : 1);
+      if (!l->slots)
+         goto error;
+
+      memcpy(l->slots, src + sizeof(uint64_t), slots_size);
+      l->pool = (const char*)src + sizeof(uint64_t) + slots_size;
+      l->data = buff;
+
+      for (i = 0; i < l->count; i++)
+      {
+         if (l->slots[i].offset > pool_size ||
+               l->slots[i].len > pool_size - l->slots[i].offset)
+            goto error;
+      }
+
+      l->next     = db->lookups;
+      db->lookups = l;
+      return l;
+   }
+
+   l->count    = idx.next / rec_size;
+   l->prefix   = (uint64_t*)malloc((l->count + 1) * sizeof(uint64_t));
+   l->offsets  = (uint64_t*)malloc((l->count + 1) * sizeof(uint64_t));
+   if (l->key_size > 8)
+      l->keys  = (uint8_t*)malloc((l->count + 1) * l->key_size);
+
+   if (!l->prefix || !l->offsets || (l->key_size > 8 && !l->keys))
+      goto error;
+
+   libretrodb_lookup_fill(l, src, 0, 1);
+   free(buff);
+
+   l->next     = db->lookups;
+   db->lookups = l;
+   return l;
+
+error:
+   if (l)
+   {
+      l->data = NULL;
+      libretrodb_lookup_free(l);
+   }
    free(buff);
+   return NULL;
+}
+
+static INLINE char libretrodb_fold(char c)
+{
+   return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
 
-   if (rv == 0)
-      lseek(db->fd, offset, SEEK_SET);
+/* Compares a folded index string with @str, folding @str on the fly.
+ * Only the first @len bytes of @str take part. */
+static int libretrodb_string_cmp(const char *folded, size_t folded_len,
+      const char *str, size_t len)
+{
+   size_t i;
+   size_t n = folded_len < len ? folded_len : len;
 
-   rv = rmsgpack_dom_read(db->fd, out);
+   for (i = 0; i < n; i++)
+   {
+      unsigned char a = (unsigned char)folded[i];
+      unsigned char b = (unsigned char)libretrodb_fold(str[i]);
 
-   if (rv < 0)
-      return rv;
+      if (a != b)
+         return a < b ? -1 : 1;
+   }
 
-   return rv;
+   if (folded_len == len)
+      return 0;
+   return folded_len < len ? -1 : 1;
+}
+
+static int libretrodb_string_contains(const char *folded, size_t folded_len,
+      const char *str, size_t len)
+{
+   size_t i;
+
+   if (len > folded_len)
+      return 0;
+
+   for (i = 0; i + len <= folded_len; i++)
+   {
+      if (folded[i] == libretrodb_fold(str[0]) &&
+            libretrodb_string_cmp(folded + i, len, str, len) == 0)
+         return 1;
+   }
+
+   return 0;
+}
+
+/**
+ * libretrodb_find_strings:
+ * @db                  : Handle to database.
+ * @index_name          : Name of a string index.
+ * @str                 : String to look for.
+ * @len                 : Length of @str.
+ * @match               : LIBRETRODB_MATCH_EXACT, _PREFIX or _SUBSTRING.
+ * @offsets             : Receives a malloc'ed array of item offsets,
+ *                        sorted by the indexed string.
+ *
+ * Searches a string index case-insensitively (ASCII). Exact and
+ * prefix matches binary search the sorted strings, substring
+ * matches scan the string pool without touching the items.
+ *
+ * Returns: number of matches, or -1 if there is no such string
+ * index or memory runs out.
+ **/
+int libretrodb_find_strings(libretrodb_t *db, const char *index_name,
+      const char *str, size_t len, unsigned match, uint64_t **offsets)
+{
+   uint64_t lo, hi, i;
+   size_t found = 0, cap = 0;
+   uint64_t *out = NULL;
+   struct libretrodb_lookup *l = libretrodb_lookup_get(db, index_name);
+
+   *offsets = NULL;
+
+   if (!l || l->key_size)
+      return -1;
+
+   lo = 0;
+   hi = l->count;
+
+   if (match == LIBRETRODB_MATCH_SUBSTRING && len == 0)
+      match = LIBRETRODB_MATCH_PREFIX;
+
+   if (match != LIBRETRODB_MATCH_SUBSTRING)
+   {
+      /* Lower bound of @str. */
+      while (lo < hi)
+      {
+         uint64_t mid = lo + (hi - lo) / 2;
+         const struct libretrodb_string_slot *slot = &l->slots[mid];
+
+         if (libretrodb_string_cmp(l->pool + slot->offset, slot->len,
+                  str, len) < 0)
+            lo = mid + 1;
+         else
+            hi = mid;
+      }
+      hi = l->count;
+   }
+
+   for (i = lo; i < hi; i++)
+   {
+      const struct libretrodb_string_slot *slot = &l->slots[i];
+      const char *s = l->pool + slot->offset;
+
+      if (match == LIBRETRODB_MATCH_SUBSTRING)
+      {
+         if (!libretrodb_string_contains(s, slot->len, str, len))
+            continue;
+      }
+      else
+      {
+         size_t n = slot->len;
+
+         if (match == LIBRETRODB_MATCH_PREFIX && n > len)
+            n = len;
+         /* Sorted: the first mismatch ends the run. */
+         if (libretrodb_string_cmp(s, n, str, len) != 0)
+            break;
+      }
+
+      if (found == cap)
+      {
+         uint64_t *tmp;
+
+         cap = cap ? cap * 2 : 16;
+         tmp = (uint64_t*)realloc(out, cap * sizeof(uint64_t));
+         if (!tmp)
+         {
+            free(out);
+            return -1;
+         }
+         out = tmp;
+      }
+      out[found++] = slot->item;
+   }
+
+   *offsets = out;
+   return found;
+}
+
+/**
+ * libretrodb_read_entry:
+ * @db                  : Handle to database.
+ * @offset              : Item offset, as returned by
+ *                        libretrodb_find_entries().
+ * @out                 : Decoded item.
+ *
+ * Returns: 0 if successful, otherwise negative.
+ **/
+int libretrodb_read_entry(libretrodb_t *db, uint64_t offset,
+      struct rmsgpack_dom_value *out)
+{
+   if (db->map && offset < db->map_size)
+   {
+      size_t pos = offset;
+      return rmsgpack_dom_read_buf(db->map, db->map_size, &pos, out);
+   }
+
+   if (lseek(db->fd, offset, SEEK_SET) == (off_t)-1)
+      return -errno;
+   return rmsgpack_dom_read(db->fd, out);
+}
+
+/**
+ * libretrodb_find_entries:
+ * @db                  : Handle to database.
+ * @index_name          : Name of the index to search.
+ * @keys                : @count keys of the index's key size, back to back.
+ * @count               : Number of keys.
+ * @offsets             : Receives the item offset for each key, or 0
+ *                        for keys that are not in the index.
+ *
+ * Looks up many keys at once. Descents are interleaved so their
+ * cache misses overlap.
+ *
+ * Returns: number of keys found, or -1 if the index does not exist.
+ **/
+int libretrodb_find_entries(libretrodb_t *db, const char *index_name,
+      const void *keys, size_t count, uint64_t *offsets)
+{
+   size_t i, j;
+   int found = 0;
+   const uint8_t *key = (const uint8_t*)keys;
+   struct libretrodb_lookup *l = libretrodb_lookup_get(db, index_name);
+
+   if (!l || !l->key_size)
+      return -1;
+
+   for (i = 0; i < count; i += LIBRETRODB_LOOKUP_BATCH)
+   {
+      uint64_t k[LIBRETRODB_LOOKUP_BATCH];
+      uint64_t prefix[LIBRETRODB_LOOKUP_BATCH];
+      size_t n = count - i;
+      int active = 1;
+
+      if (n > LIBRETRODB_LOOKUP_BATCH)
+         n = LIBRETRODB_LOOKUP_BATCH;
+
+      for (j = 0; j < n; j++)
+      {
+         k[j]      = 1;
+         prefix[j] = libretrodb_key_prefix(key + j * l->key_size,
+               l->key_size);
+      }
+
+      while (active)
+      {
+         active = 0;
+         for (j = 0; j < n; j++)
+         {
+            if (k[j] > l->count)
+               continue;
+
+            LIBRETRODB_PREFETCH(&l->prefix[16 * k[j]]);
+            k[j]   = 2 * k[j] + libretrodb_lookup_less(l, k[j], prefix[j],
+                  key + j * l->key_size);
+            active = 1;
+         }
+      }
+
+      for (j = 0; j < n; j++)
+      {
+         uint64_t slot = libretrodb_lookup_resolve(l, k[j], prefix[j],
+               key + j * l->key_size);
+
+         offsets[i + j] = slot ? l->offsets[slot] : 0;
+         if (slot)
+            found++;
+      }
+
+      key += n * l->key_size;
+   }
+
+   return found;
+}
+
+/**
+ * libretrodb_find_entry:
+ * @db                  : Handle to database.
+ * @index_name          : Name of the index to search.
+ * @key                 : Key, of the index's key size.
+ * @out                 : Decoded item.
+ *
+ * The index is loaded once per database handle, later lookups
+ * only walk the in-memory copy.
+ *
+ * Returns: 0 if found, 1 if @key is not in the index,
+ * otherwise negative.
+ **/
+int libretrodb_find_entry(libretrodb_t *db, const char *index_name,
+        const void *key, struct rmsgpack_dom_value *out)
+{
+   uint64_t k, prefix;
+   struct libretrodb_lookup *l = libretrodb_lookup_get(db, index_name);
+
+   if (!l || !l->key_size)
+      return -1;
+
+   prefix = libretrodb_key_prefix((const uint8_t*)key, l->key_size);
+
+   for (k = 1; k <= l->count; )
+   {
+      LIBRETRODB_PREFETCH(&l->prefix[16 * k]);
+      k = 2 * k + libretrodb_lookup_less(l, k, prefix, (const uint8_t*)key);
+   }
+
+   k = libretrodb_lookup_resolve(l, k, prefix, (const uint8_t*)key);
+   if (!k)
+      return 1;
+
+   return libretrodb_read_entry(db, l->offsets[k], out);
 }
 
 /**
@@ -291,22 +777,85 @@ int libretrodb_find_entry(libretrodb_t *db, const char *index_name,
  **/
 int libretrodb_cursor_reset(libretrodb_cursor_t *cursor)
 {
-	cursor->eof = 0;
+	cursor->eof       = 0;
+   cursor->offset    = cursor->db->root + sizeof(libretrodb_header_t);
+   cursor->index_pos = 0;
+
+   if (cursor->db->map)
+      return cursor->offset;
+
 	return lseek(cursor->fd,
          cursor->db->root + sizeof(libretrodb_header_t),
          SEEK_SET);
 }
 
+/**
+ * libretrodb_cursor_skip:
+ * @cursor              : Handle to mapped database cursor.
+ *
+ * Skips over items the query rejects by looking at their encoding
+ * only, leaving cursor->offset at the next item to decode.
+ *
+ * Returns: 1 if the next item is known to match, otherwise 0.
+ **/
+static int libretrodb_cursor_skip(libretrodb_cursor_t *cursor)
+{
+   for (;;)
+   {
+      size_t pos = cursor->offset;
+      int match  = libretrodb_query_filter_buf(cursor->query,
+            cursor->db->map, cursor->db->map_size, &pos);
+
+      if (match != 0)
+         return match > 0;
+
+      cursor->offset = pos;
+   }
+}
+
 int libretrodb_cursor_read_item(libretrodb_cursor_t *cursor,
       struct rmsgpack_dom_value * out)
 {
    int rv;
+   int match = 0;
 
    if (cursor->eof)
       return EOF;
 
+   if (cursor->indexed)
+   {
+      while (cursor->index_pos < cursor->index_count)
+      {
+         rv = libretrodb_read_entry(cursor->db,
+               cursor->index_items[cursor->index_pos++], out);
+         if (rv < 0)
+            return rv;
+
+         if (libretrodb_query_filter(cursor->query, out))
+            return 0;
+         rmsgpack_dom_value_free(out);
+      }
+
+      cursor->eof = 1;
+      return EOF;
+   }
+
 retry:
-   rv = rmsgpack_dom_read(cursor->fd, out);
+   if (cursor->db->map)
+   {
+      size_t pos;
+
+      if (cursor->query)
+         match = libretrodb_cursor_skip(cursor);
+
+      pos = cursor->offset;
+      rv  = rmsgpack_dom_read_buf(cursor->db->map,
+            cursor->db->map_size, &pos, out);
+      cursor->offset = pos;
+   }
+   else
+      rv = rmsgpack_dom_read(cursor->fd, out);
+
    if (rv < 0)
       return rv;
 
@@ -316,12 +865,83 @@ retry:
       return EOF;
    }
 
-   if (cursor->query)
+   if (cursor->query && !match)
    {
       if (!libretrodb_query_filter(cursor->query, out))
+      {
+         rmsgpack_dom_value_free(out);
          goto retry;
+      }
+   }
+
+   return 0;
+}
+
+/**
+ * libretrodb_cursor_read_item_view:
+ * @cursor              : Handle to database cursor.
+ * @out                 : Next matching item.
+ *
+ * Like libretrodb_cursor_read_item(), but when the database is
+ * memory-mapped the item is decoded in place: its strings and
+ * binaries point into the mapping and are NOT NUL-terminated.
+ * @out is owned by the cursor and stays valid until the next read
+ * or until the cursor is closed; do not free it.
+ *
+ * Returns: 0 if successful, EOF at the end, otherwise negative.
+ **/
+int libretrodb_cursor_read_item_view(libretrodb_cursor_t *cursor,
+      struct rmsgpack_dom_value *out)
+{
+   int rv;
+   int match = 0;
+
+   if (!cursor->db->map)
+   {
+      rmsgpack_dom_value_free(&cursor->item);
+      cursor->item.type = RDT_NULL;
+
+      if ((rv = libretrodb_cursor_read_item(cursor, &cursor->item)) == 0)
+         *out = cursor->item;
+      return rv;
    }
 
+   if (cursor->eof)
+      return EOF;
+
+   do
+   {
+      size_t pos;
+
+      if (cursor->indexed)
+      {
+         if (cursor->index_pos >= cursor->index_count)
+         {
+            cursor->eof = 1;
+            return EOF;
+         }
+         cursor->offset = cursor->index_items[cursor->index_pos++];
+      }
+      else if (cursor->query)
+         match = libretrodb_cursor_skip(cursor);
+
+      pos = cursor->offset;
+      rv  = rmsgpack_dom_read_view(cursor->db->map, cursor->db->map_size,
+            &pos, &cursor->scratch, &cursor->item);
+      cursor->offset = pos;
+
+      if (rv < 0)
+         return rv;
+
+      if (cursor->item.type == RDT_NULL)
+      {
+         cursor->eof = 1;
+         return EOF;
+      }
+   } while (cursor->query && !match &&
+         !libretrodb_query_filter(cursor->query, &cursor->item));
+
+   *out = cursor->item;
    return 0;
 }
 
@@ -336,7 +956,13 @@ void libretrodb_cursor_close(libretrodb_cursor_t *cursor)
    if (!cursor)
       return;
 
-	close(cursor->fd);
+   if (cursor->db && !cursor->db->map)
+      rmsgpack_dom_value_free(&cursor->item);
+   cursor->item.type = RDT_NULL;
+   rmsgpack_dom_scratch_free(&cursor->scratch);
+
+   if (cursor->fd != -1)
+      close(cursor->fd);
 	cursor->is_valid = 0;
 	cursor->fd = -1;
 	cursor->eof = 1;
@@ -345,9 +971,80 @@ void libretrodb_cursor_close(libretrodb_cursor_t *cursor)
 	if (cursor->query)
 		libretrodb_query_free(cursor->query);
 
+	free(cursor->index_items);
+	cursor->index_items = NULL;
+	cursor->index_count = 0;
+	cursor->indexed     = 0;
 	cursor->query = NULL;
 }
 
+/**
+ * libretrodb_cursor_use_index:
+ * @cursor              : Handle to database cursor.
+ *
+ * If the query requires a field to equal a literal (or, for string
+ * indexes, to start with one) and the database has an index of the
+ * same name, looks the literal up once so the cursor only visits the
+ * matching items instead of scanning.
+ **/
+static int libretrodb_cmp_offset(const void *a, const void *b)
+{
+   uint64_t x = *(const uint64_t*)a;
+   uint64_t y = *(const uint64_t*)b;
+   return x < y ? -1 : x > y;
+}
+
+static void libretrodb_cursor_use_index(libretrodb_cursor_t *cursor)
+{
+   unsigned i, match;
+   const char *field;
+   const void *key;
+   size_t key_len;
+
+   for (i = 0; libretrodb_query_index_key(cursor->query, i,
+            &field, &key, &key_len, &match) == 0; i++)
+   {
+      int found;
+      uint64_t *items = NULL;
+      struct libretrodb_lookup *l = libretrodb_lookup_get(cursor->db, field);
+
+      if (!l)
+         continue;
+
+      if (!l->key_size)
+      {
+         found = libretrodb_find_strings(cursor->db, field,
+               (const char*)key, key_len, match, &items);
+         if (found < 0)
+            continue;
+
+         /* Visit matches in database order, like a scan would. */
+         qsort(items, found, sizeof(*items), libretrodb_cmp_offset);
+      }
+      else
+      {
+         if (match != LIBRETRODB_MATCH_EXACT || l->key_size != key_len)
+            continue;
+
+         items = (uint64_t*)malloc(sizeof(*items));
+         if (!items)
+            continue;
+
+         found = libretrodb_find_entries(cursor->db, field, key, 1, items);
+         if (found < 0)
+         {
+            free(items);
+            continue;
+         }
+      }
+
+      cursor->indexed     = 1;
+      cursor->index_items = items;
+      cursor->index_count = found;
+      return;
+   }
+}
+
 /**
  * libretrodb_cursor_open:
  * @db                  : Handle to database.
@@ -361,56 +1058,298 @@ void libretrodb_cursor_close(libretrodb_cursor_t *cursor)
 int libretrodb_cursor_open(libretrodb_t *db, libretrodb_cursor_t *cursor,
       libretrodb_query_t *q)
 {
-   cursor->fd = dup(db->fd);
+   memset(&cursor->scratch, 0, sizeof(cursor->scratch));
+   cursor->item.type = RDT_NULL;
+   cursor->fd        = -1;
 
-   if (cursor->fd == -1)
+   /* Mapped databases are read straight from memory. */
+   if (!db->map && (cursor->fd = dup(db->fd)) == -1)
       return -errno;
 
    cursor->db = db;
    cursor->is_valid = 1;
-   libretrodb_cursor_reset(cursor);
    cursor->query = q;
+   cursor->indexed     = 0;
+   cursor->index_items = NULL;
+   cursor->index_count = 0;
 
    if (q)
+   {
       libretrodb_query_inc_ref(q);
+      libretrodb_cursor_use_index(cursor);
+   }
+
+   /* After the index probe, which moves the shared file offset. */
+   libretrodb_cursor_reset(cursor);
+   return 0;
+}
+
+/**
+ * libretrodb_sort_index:
+ * @records             : Index records, @key_size key bytes followed
+ *                        by a uint64_t item offset each.
+ * @count               : Number of records.
+ * @key_size            : Size of the key part of a record.
+ *
+ * Sorts @records by key in memcmp() order with an LSD radix sort,
+ * one stable counting pass per key byte.
+ *
+ * Returns: 0 on success, -ENOMEM if the scratch buffer
+ * cannot be allocated.
+ **/
+static int libretrodb_sort_index(uint8_t *records, uint64_t count,
+      uint8_t key_size)
+{
+   int byte;
+   uint64_t i;
+   size_t rec_size = key_size + sizeof(uint64_t);
+   uint8_t *src    = records;
+   uint8_t *dst    = (uint8_t*)malloc(count * rec_size);
+   uint8_t *tmp    = dst;
+
+   if (!dst)
+      return -ENOMEM;
+
+   for (byte = key_size - 1; byte >= 0; byte--)
+   {
+      uint64_t buckets[256];
+      uint64_t pos = 0;
+      uint8_t *swap;
 
+      memset(buckets, 0, sizeof(buckets));
+      for (i = 0; i < count; i++)
+         buckets[src[i * rec_size + byte]]++;
+
+      /* Every key shares this byte, the pass would be a copy. */
+      if (buckets[src[byte]] == count)
+         continue;
+
+      for (i = 0; i < 256; i++)
+      {
+         uint64_t n = buckets[i];
+         buckets[i] = pos;
+         pos       += n;
+      }
+
+      for (i = 0; i < count; i++)
+      {
+         const uint8_t *rec = src + i * rec_size;
+         memcpy(dst + buckets[rec[byte]]++ * rec_size, rec, rec_size);
+      }
+
+      swap = src;
+      src  = dst;
+      dst  = swap;
+   }
+
+   if (src != records)
+      memcpy(records, src, count * rec_size);
+
+   free(tmp);
    return 0;
 }
 
-static int node_iter(void * value, void * ctx)
+static int libretrodb_write_all(int fd, const uint8_t *buff, uint64_t len)
 {
-	struct node_iter_ctx *nictx = (struct node_iter_ctx*)ctx;
+   while (len)
+   {
+      ssize_t rv = write(fd, buff, len > 0x40000000 ? 0x40000000 : len);
 
-	if (write(nictx->db->fd, value,
-            nictx->idx->key_size + sizeof(uint64_t)) > 0)
-		return 0;
+      if (rv <= 0)
+         return -errno;
+
+      buff += rv;
+      len  -= rv;
+   }
+
+   return 0;
+}
 
-	return -1;
+static uint64_t libretrodb_cursor_tell(libretrodb_cursor_t *cursor)
+{
+   if (cursor->db->map)
+      return cursor->offset;
+	return lseek(cursor->fd, 0, SEEK_CUR);
 }
 
-static uint64_t libretrodb_tell(libretrodb_t *db)
+struct libretrodb_string_sort
+{
+   const char *str;
+   struct libretrodb_string_slot slot;
+};
+
+static int libretrodb_string_sort_cmp(const void *a, const void *b)
 {
-	return lseek(db->fd, 0, SEEK_CUR);
+   const struct libretrodb_string_sort *x =
+      (const struct libretrodb_string_sort*)a;
+   const struct libretrodb_string_sort *y =
+      (const struct libretrodb_string_sort*)b;
+   uint32_t n = x->slot.len < y->slot.len ? x->slot.len : y->slot.len;
+   int rv     = memcmp(x->str, y->str, n);
+
+   if (rv)
+      return rv;
+   if (x->slot.len == y->slot.len)
+      return x->slot.item < y->slot.item ? -1 : 1;
+   return x->slot.len < y->slot.len ? -1 : 1;
+}
+
+/**
+ * libretrodb_create_string_index:
+ * @db                  : Handle to database.
+ * @name                : Name of the new index.
+ * @field_name          : String field to index.
+ *
+ * Writes an index of case-folded strings for
+ * libretrodb_find_strings(). Unlike binary indexes, values may
+ * repeat and items without the field are left out.
+ *
+ * Returns: 0 if successful, otherwise negative.
+ **/
+static int libretrodb_create_string_index(libretrodb_t *db,
+      const char *name, const char *field_name)
+{
+	int rv = 0;
+	struct rmsgpack_dom_value key;
+	struct rmsgpack_dom_value item;
+	struct rmsgpack_dom_value *field;
+	libretrodb_index_t idx;
+	libretrodb_cursor_t cur;
+	struct libretrodb_string_slot *slots = NULL;
+	struct libretrodb_string_sort *sorted = NULL;
+	char *pool = NULL;
+	uint64_t count = 0, capacity = 0;
+	uint64_t pool_size = 0, pool_capacity = 0;
+	uint64_t item_loc, i;
+
+	item.type    = RDT_NULL;
+	cur.is_valid = 0;
+
+	if (libretrodb_cursor_open(db, &cur, NULL) != 0)
+		return -1;
+
+	item_loc = libretrodb_cursor_tell(&cur);
+
+	key.type        = RDT_STRING;
+	key.string.len  = strlen(field_name);
+	key.string.buff = (char *) field_name;
+
+	while (libretrodb_cursor_read_item(&cur, &item) == 0)
+   {
+      field = rmsgpack_dom_value_map_value(&item, &key);
+
+      if (field && field->type == RDT_STRING)
+      {
+         if (count == capacity)
+         {
+            struct libretrodb_string_slot *tmp;
+
+            capacity = capacity ? capacity * 2 : 1024;
+            tmp      = (struct libretrodb_string_slot*)realloc(slots,
+                  capacity * sizeof(*slots));
+            if (!tmp)
+            {
+               rv = -ENOMEM;
+               goto clean;
+            }
+            slots = tmp;
+         }
+
+         while (pool_size + field->string.len > pool_capacity)
+         {
+            char *tmp;
+
+            pool_capacity = pool_capacity ? pool_capacity * 2 : 64 * 1024;
+            tmp           = (char*)realloc(pool, pool_capacity);
+            if (!tmp)
+            {
+               rv = -ENOMEM;
+               goto clean;
+            }
+            pool = tmp;
+         }
+
+         if (pool_size + field->string.len > UINT32_MAX)
+         {
+            rv = -E2BIG;
+            goto clean;
+         }
+
+         for (i = 0; i < field->string.len; i++)
+            pool[pool_size + i] = libretrodb_fold(field->string.buff[i]);
+
+         slots[count].item   = item_loc;
+         slots[count].offset = pool_size;
+         slots[count].len    = field->string.len;
+         pool_size          += field->string.len;
+         count++;
+      }
+
+      rmsgpack_dom_value_free(&item);
+      item_loc = libretrodb_cursor_tell(&cur);
+   }
+
+   sorted = (struct libretrodb_string_sort*)malloc(
+         (count ? count : 1) * sizeof(*sorted));
+   if (!sorted)
+   {
+      rv = -ENOMEM;
+      goto clean;
+   }
+
+   for (i = 0; i < count; i++)
+   {
+      sorted[i].str  = pool + slots[i].offset;
+      sorted[i].slot = slots[i];
+   }
+   qsort(sorted, count, sizeof(*sorted), libretrodb_string_sort_cmp);
+
+   for (i = 0; i < count; i++)
+      slots[i] = sorted[i].slot;
+
+	lseek(db->fd, 0, SEEK_END);
+	strncpy(idx.name, name, 50);
+
+	idx.name[49] = '\0';
+	idx.key_size = 0;
+	idx.next     = sizeof(uint64_t) + count * sizeof(*slots) + pool_size;
+	libretrodb_write_index_header(db->fd, &idx);
+
+   if ((rv = libretrodb_write_all(db->fd, (const uint8_t*)&count,
+               sizeof(count))) == 0 &&
+         (rv = libretrodb_write_all(db->fd, (const uint8_t*)slots,
+               count * sizeof(*slots))) == 0)
+      rv = libretrodb_write_all(db->fd, (const uint8_t*)pool, pool_size);
+
+clean:
+	rmsgpack_dom_value_free(&item);
+	free(sorted);
+	free(slots);
+	free(pool);
+	if (cur.is_valid)
+		libretrodb_cursor_close(&cur);
+	return rv;
 }
 
 int libretrodb_create_index(libretrodb_t *db,
       const char *name, const char *field_name)
 {
-	int rv;
-	struct node_iter_ctx nictx;
+	int rv = 0;
 	struct rmsgpack_dom_value key;
 	libretrodb_index_t idx;
 	struct rmsgpack_dom_value item;
 	struct rmsgpack_dom_value * field;
-	struct bintree tree;
 	libretrodb_cursor_t cur;
-	uint64_t idx_header_offset;
-	void * buff = NULL;
-	uint64_t * buff_u64 = NULL;
+	uint8_t *records = NULL;
+	uint64_t count = 0;
+	uint64_t capacity = 0;
+	size_t rec_size = 0;
 	uint8_t field_size = 0;
-	uint64_t item_loc = libretrodb_tell(db);
+	uint64_t item_loc;
+	uint64_t i;
 
-	bintree_new(&tree, node_compare, &field_size);
+	item.type    = RDT_NULL;
+	cur.is_valid = 0;
 
 	if (libretrodb_cursor_open(db, &cur, NULL) != 0)
    {
@@ -418,12 +1357,15 @@ int libretrodb_create_index(libretrodb_t *db,
 		goto clean;
 	}
 
+	item_loc = libretrodb_cursor_tell(&cur);
+
 	key.type = RDT_STRING;
 	key.string.len = strlen(field_name);
 
 	/* We know we aren't going to change it */
 	key.string.buff = (char *) field_name;
 
+   /* Collect every key into one flat array of fixed-size records. */
 	while (libretrodb_cursor_read_item(&cur, &item) == 0)
    {
 		if (item.type != RDT_MAP)
@@ -442,6 +1384,13 @@ int libretrodb_create_index(libretrodb_t *db,
 			goto clean;
 		}
 
+		if (count == 0 && field->type == RDT_STRING)
+      {
+         rmsgpack_dom_value_free(&item);
+         libretrodb_cursor_close(&cur);
+         return libretrodb_create_string_index(db, name, field_name);
+      }
+
 		if (field->type != RDT_BINARY)
       {
 			rv = -EINVAL;
@@ -457,7 +1406,10 @@ int libretrodb_create_index(libretrodb_t *db,
 		}
 
 		if (field_size == 0)
+      {
 			field_size = field->binary.len;
+         rec_size   = field_size + sizeof(uint64_t);
+      }
 		else if (field->binary.len != field_size)
       {
 			rv = -EINVAL;
@@ -465,52 +1417,73 @@ int libretrodb_create_index(libretrodb_t *db,
 			goto clean;
 		}
 
-		buff = malloc(field_size + sizeof(uint64_t));
-		if (!buff)
+      if (count == capacity)
       {
-			rv = -ENOMEM;
-			goto clean;
-		}
+         uint8_t *tmp;
+
+         capacity = capacity ? capacity * 2 :
+            (db->count ? db->count : 1024);
+         tmp = (uint8_t*)realloc(records, capacity * rec_size);
+
+         if (!tmp)
+         {
+            rv = -ENOMEM;
+            goto clean;
+         }
+         records = tmp;
+      }
+
+		memcpy(records + count * rec_size, field->binary.buff, field_size);
+		memcpy(records + count * rec_size + field_size,
+            &item_loc, sizeof(uint64_t));
+      count++;
 
-		memcpy(buff, field->binary.buff, field_size);
+		rmsgpack_dom_value_free(&item);
+		item_loc = libretrodb_cursor_tell(&cur);
+	}
 
-		buff_u64 = (uint64_t *)buff + field_size;
+   if (count)
+   {
+      rv = libretrodb_sort_index(records, count, field_size);
+      if (rv != 0)
+         goto clean;
+   }
 
-		memcpy(buff_u64, &item_loc, sizeof(uint64_t));
+   for (i = 1; i < count; i++)
+   {
+      const uint8_t *rec = records + i * rec_size;
 
-		if (bintree_insert(&tree, buff) != 0)
+      if (memcmp(rec - rec_size, rec, field_size) == 0)
       {
-			printf("Value is not unique: ");
-			rmsgpack_dom_value_print(field);
-			printf("\n");
-			rv = -EINVAL;
-			goto clean;
-		}
-		buff = NULL;
-		rmsgpack_dom_value_free(&item);
-		item_loc = libretrodb_tell(db);
-	}
+         struct rmsgpack_dom_value dup;
+
+         dup.type        = RDT_BINARY;
+         dup.binary.len  = field_size;
+         dup.binary.buff = (char*)rec;
 
-	(void)rv;
-	(void)idx_header_offset;
+         printf("Value is not unique: ");
+         rmsgpack_dom_value_print(&dup);
+         printf("\n");
+         rv = -EINVAL;
+         goto clean;
+      }
+   }
 
-	idx_header_offset = lseek(db->fd, 0, SEEK_END);
+	lseek(db->fd, 0, SEEK_END);
 	strncpy(idx.name, name, 50);
 
 	idx.name[49] = '\0';
 	idx.key_size = field_size;
-	idx.next = db->count * (field_size + sizeof(uint64_t));
+	idx.next = count * rec_size;
 	libretrodb_write_index_header(db->fd, &idx);
 
-	nictx.db = db;
-	nictx.idx = &idx;
-	bintree_iterate(&tree, node_iter, &nictx);
-	bintree_free(&tree);
+   /* Written in a single pass, already in lookup order. */
+   rv = libretrodb_write_all(db->fd, records, count * rec_size);
+
 clean:
 	rmsgpack_dom_value_free(&item);
-	if (buff)
-		free(buff);
+	free(records);
 	if (cur.is_valid)
 		libretrodb_cursor_close(&cur);
-	return 0;
+	return rv;
 }
@@ -17,6 +17,8 @@ extern "C" {
 
 typedef struct libretrodb_query libretrodb_query_t;
 
+struct libretrodb_lookup;
+
 typedef struct libretrodb
 {
 	int fd;
@@ -24,6 +26,11 @@ typedef struct libretrodb
 	uint64_t count;
 	uint64_t first_index_offset;
    char path[1024];
+   /* Read-only mapping of the file, NULL when unavailable. */
+   const uint8_t *map;
+   uint64_t map_size;
+   /* Indexes loaded by lookups so far. */
+   struct libretrodb_lookup *lookups;
 } libretrodb_t;
 
 typedef struct libretrodb_index
@@ -51,6 +58,17 @@ typedef struct libretrodb_cursor
 	int eof;
 	libretrodb_query_t * query;
 	libretrodb_t * db;
+   /* Read position in db->map. */
+   uint64_t offset;
+   /* Backs the values returned by libretrodb_cursor_read_item_view(). */
+   struct rmsgpack_dom_scratch scratch;
+   struct rmsgpack_dom_value item;
+   /* Set when the query was resolved through an index: the cursor
+    * then only visits the index_count items in index_items. */
+   int indexed;
+   uint64_t *index_items;
+   size_t index_count;
+   size_t index_pos;
 } libretrodb_cursor_t;
 
 typedef int (* libretrodb_value_provider)(void * ctx,
@@ -73,6 +91,20 @@ int libretrodb_find_entry(
         struct rmsgpack_dom_value * out
 );
 
+int libretrodb_find_entries(libretrodb_t * db, const char *index_name,
+      const void *keys, size_t count, uint64_t *offsets);
+
+int libretrodb_read_entry(libretrodb_t * db, uint64_t offset,
+      struct rmsgpack_dom_value * out);
+
+/* Match modes of libretrodb_find_strings(). */
+#define LIBRETRODB_MATCH_EXACT     0
+#define LIBRETRODB_MATCH_PREFIX    1
+#define LIBRETRODB_MATCH_SUBSTRING 2
+
+int libretrodb_find_strings(libretrodb_t * db, const char *index_name,
+      const char *str, size_t len, unsigned match, uint64_t **offsets);
+
 /**
  * libretrodb_cursor_open:
  * @db                  : Handle to database.
@@ -119,6 +151,22 @@ void libretrodb_query_free(void *q);
 int libretrodb_cursor_read_item(libretrodb_cursor_t * cursor,
       struct rmsgpack_dom_value * out);
 
+/**
+ * libretrodb_cursor_read_item_view:
+ * @cursor              : Handle to database cursor.
+ * @out                 : Next matching item.
+ *
+ * Like libretrodb_cursor_read_item(), but when the database is
+ * memory-mapped the item is decoded in place: its strings and
+ * binaries point into the mapping and are NOT NUL-terminated.
+ * @out is owned by the cursor and stays valid until the next read
+ * or until the cursor is closed; do not free it.
+ *
+ * Returns: 0 if successful, EOF at the end, otherwise negative.
+ **/
+int libretrodb_cursor_read_item_view(libretrodb_cursor_t * cursor,
+      struct rmsgpack_dom_value * out);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,351 @@
+/* Times the main libretrodb operations on synthetic databases.
+ *
+ * Usage: libretrodb_bench [record count] [scratch db path]
+ *
+ * Without a record count, databases of 10k, 100k and 1M records
+ * are generated in turn. Every record looks like a typical game
+ * entry: a unique name and 4-byte crc, a description, a publisher
+ * shared by 1 in 50 records and a release year shared by 1 in 30. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "libretrodb.h"
+#include "query.h"
+#include "rmsgpack_dom.h"
+
+#define BENCH_LOOKUPS 100000
+
+struct bench_provider
+{
+	uint32_t count;
+	uint32_t next;
+};
+
+static const char *bench_queries[] = {
+	"{releaseyear:1985}",
+	"{publisher:'Pub 7',releaseyear:1987}",
+	"{name:glob('Game 0001*')}",
+	"{name:glob('*77')}",
+	"{description:'Description of game 42'}",
+};
+
+static double bench_now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void bench_report(const char *what, double start, uint64_t ops)
+{
+	double elapsed = bench_now() - start;
+
+	printf("  %-44s %10.2f ms", what, elapsed * 1000.0);
+	if (ops)
+		printf(" %10.1f ns/op", elapsed * 1e9 / ops);
+	printf("\n");
+}
+
+static uint32_t bench_crc(uint32_t i)
+{
+	return i * 2654435761u;
+}
+
+static void bench_set_string(struct rmsgpack_dom_value *v, const char *str)
+{
+	v->type = RDT_STRING;
+	v->string.len = strlen(str);
+	v->string.buff = strdup(str);
+}
+
+static int bench_provide(void *ctx, struct rmsgpack_dom_value *out)
+{
+	char buf[64];
+	uint32_t crc;
+	struct rmsgpack_dom_pair *items;
+	struct bench_provider *p = (struct bench_provider *)ctx;
+
+	/* libretrodb_create() hands back the previous record and only
+	 * frees the last one itself. */
+	rmsgpack_dom_value_free(out);
+	memset(out, 0, sizeof(*out));
+
+	if (p->next >= p->count)
+		return 1;
+
+	items = (struct rmsgpack_dom_pair *)calloc(5, sizeof(*items));
+	if (!items)
+		return -1;
+
+	out->type = RDT_MAP;
+	out->map.len = 5;
+	out->map.items = items;
+
+	bench_set_string(&items[0].key, "name");
+	snprintf(buf, sizeof(buf), "Game %06u", p->next);
+	bench_set_string(&items[0].value, buf);
+
+	bench_set_string(&items[1].key, "description");
+	snprintf(buf, sizeof(buf), "Description of game %u", p->next);
+	bench_set_string(&items[1].value, buf);
+
+	bench_set_string(&items[2].key, "crc");
+	crc = bench_crc(p->next);
+	items[2].value.type = RDT_BINARY;
+	items[2].value.binary.len = sizeof(crc);
+	items[2].value.binary.buff = (char *)malloc(sizeof(crc));
+	memcpy(items[2].value.binary.buff, &crc, sizeof(crc));
+
+	bench_set_string(&items[3].key, "releaseyear");
+	items[3].value.type = RDT_UINT;
+	items[3].value.uint_ = 1980 + p->next % 30;
+
+	bench_set_string(&items[4].key, "publisher");
+	snprintf(buf, sizeof(buf), "Pub %u", p->next % 50);
+	bench_set_string(&items[4].value, buf);
+
+	p->next++;
+	return 0;
+}
+
+static int bench_create(const char *path, uint32_t count)
+{
+	int rv;
+	double start;
+	struct bench_provider provider;
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	if (fd < 0)
+	{
+		perror(path);
+		return -1;
+	}
+
+	provider.count = count;
+	provider.next = 0;
+
+	start = bench_now();
+	rv = libretrodb_create(fd, bench_provide, &provider);
+	bench_report("libretrodb_create", start, count);
+
+	close(fd);
+	return rv < 0 ? -1 : 0;
+}
+
+static int bench_indexes(const char *path, uint32_t count)
+{
+	libretrodb_t db;
+	double start;
+
+	if (libretrodb_open(path, &db) != 0)
+		return -1;
+
+	start = bench_now();
+	if (libretrodb_create_index(&db, "crc", "crc") != 0)
+		goto error;
+	bench_report("libretrodb_create_index (binary)", start, count);
+
+	start = bench_now();
+	if (libretrodb_create_index(&db, "name", "name") != 0)
+		goto error;
+	bench_report("libretrodb_create_index (string)", start, count);
+
+	libretrodb_close(&db);
+	return 0;
+
+error:
+	libretrodb_close(&db);
+	return -1;
+}
+
+static int bench_lookups(libretrodb_t *db, uint32_t count)
+{
+	uint32_t i;
+	double start;
+	uint32_t found = 0;
+	uint32_t keys[8];
+	uint64_t offsets[8];
+	struct rmsgpack_dom_value item;
+
+	/* The first lookup loads the index. */
+	start = bench_now();
+	keys[0] = bench_crc(0);
+	if (libretrodb_find_entry(db, "crc", keys, &item) != 0)
+		return -1;
+	rmsgpack_dom_value_free(&item);
+	bench_report("first libretrodb_find_entry (loads index)", start, 1);
+
+	start = bench_now();
+	for (i = 0; i < BENCH_LOOKUPS; i++)
+	{
+		uint32_t key = bench_crc((i * 7919u) % count);
+
+		if (libretrodb_find_entry(db, "crc", &key, &item) == 0)
+		{
+			found++;
+			rmsgpack_dom_value_free(&item);
+		}
+	}
+	bench_report("libretrodb_find_entry", start, BENCH_LOOKUPS);
+
+	start = bench_now();
+	for (i = 0; i < BENCH_LOOKUPS; i += 8)
+	{
+		unsigned j;
+
+		for (j = 0; j < 8; j++)
+			keys[j] = bench_crc(((i + j) * 7919u) % count);
+		if (libretrodb_find_entries(db, "crc", keys, 8, offsets) < 0)
+			return -1;
+	}
+	bench_report("libretrodb_find_entries (batches of 8)", start,
+			BENCH_LOOKUPS);
+
+	if (found != BENCH_LOOKUPS)
+	{
+		fprintf(stderr, "find_entry: found %u of %u keys\n",
+				found, BENCH_LOOKUPS);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int bench_scan(libretrodb_t *db, uint32_t count)
+{
+	unsigned i;
+	double start;
+	uint64_t n = 0;
+	libretrodb_cursor_t cur;
+	struct rmsgpack_dom_value item;
+	libretrodb_query_t *q[sizeof(bench_queries) / sizeof(bench_queries[0])];
+
+	if (libretrodb_cursor_open(db, &cur, NULL) != 0)
+		return -1;
+
+	start = bench_now();
+	while (libretrodb_cursor_read_item(&cur, &item) == 0)
+	{
+		rmsgpack_dom_value_free(&item);
+		n++;
+	}
+	bench_report("cursor iteration (read_item)", start, n);
+
+	libretrodb_cursor_reset(&cur);
+	start = bench_now();
+	while (libretrodb_cursor_read_item_view(&cur, &item) == 0)
+		;
+	bench_report("cursor iteration (read_item_view)", start, n);
+
+	for (i = 0; i < sizeof(bench_queries) / sizeof(bench_queries[0]); i++)
+	{
+		const char *error = NULL;
+
+		q[i] = (libretrodb_query_t *)libretrodb_query_compile(db,
+				bench_queries[i], strlen(bench_queries[i]), &error);
+		if (!q[i])
+		{
+			fprintf(stderr, "%s: %s\n", bench_queries[i], error);
+			libretrodb_cursor_close(&cur);
+			return -1;
+		}
+	}
+
+	/* The filter alone, on items already decoded. */
+	libretrodb_cursor_reset(&cur);
+	start = bench_now();
+	while (libretrodb_cursor_read_item_view(&cur, &item) == 0)
+		for (i = 0; i < sizeof(q) / sizeof(q[0]); i++)
+			libretrodb_query_filter(q[i], &item);
+	bench_report("libretrodb_query_filter (all queries)", start,
+			n * (sizeof(q) / sizeof(q[0])));
+
+	libretrodb_cursor_close(&cur);
+
+	/* Whole queries, as the menu runs them. */
+	for (i = 0; i < sizeof(q) / sizeof(q[0]); i++)
+	{
+		char what[64];
+		uint64_t matches = 0;
+
+		start = bench_now();
+		if (libretrodb_cursor_open(db, &cur, q[i]) != 0)
+			return -1;
+		while (libretrodb_cursor_read_item_view(&cur, &item) == 0)
+			matches++;
+		snprintf(what, sizeof(what), "%s%s", bench_queries[i],
+				cur.indexed ? " [indexed]" : "");
+		libretrodb_cursor_close(&cur);
+		bench_report(what, start, count);
+		libretrodb_query_free(q[i]);
+	}
+
+	return 0;
+}
+
+static int bench_run(const char *path, uint32_t count)
+{
+	int rv;
+	libretrodb_t db;
+
+	if (!count)
+		return -1;
+
+	printf("%u records:\n", count);
+
+	if (bench_create(path, count) != 0 || bench_indexes(path, count) != 0)
+		return -1;
+
+	if (libretrodb_open(path, &db) != 0)
+		return -1;
+
+	rv = bench_lookups(&db, count);
+	if (rv == 0)
+		rv = bench_scan(&db, count);
+
+	libretrodb_close(&db);
+	return rv;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned i;
+	static const uint32_t counts[] = { 10000, 100000, 1000000 };
+	const char *path = "libretrodb_bench.rdb";
+	unsigned long count = 0;
+	int rv = 0;
+
+	if (argc > 1)
+	{
+		char *end = NULL;
+
+		count = strtoul(argv[1], &end, 0);
+		if (end == argv[1] || *end || !count || count > UINT32_MAX)
+		{
+			fprintf(stderr,
+					"Usage: %s [record count] [scratch db path]\n",
+					argv[0]);
+			return 1;
+		}
+	}
+
+	if (argc > 2)
+		path = argv[2];
+
+	if (count)
+		rv = bench_run(path, count);
+	else
+		for (i = 0; i < sizeof(counts) / sizeof(counts[0]) && rv == 0; i++)
+			rv = bench_run(path, counts[i]);
+
+	unlink(path);
+
+	if (rv != 0)
+		fprintf(stderr, "Benchmark failed.\n");
+	return rv != 0;
+}
@@ -0,0 +1,365 @@
+/* Fuzz driver for the msgpack readers and the query parser.
+ *
+ * The first input byte selects the target, the rest is its input:
+ *   0: rmsgpack_dom_read() from a file descriptor
+ *   1: rmsgpack_dom_read_buf() and rmsgpack_dom_read_view()
+ *   2: libretrodb_query_compile(), then every query entry point
+ *      against a sample item
+ *   3: the sample queries against the input as an item, through
+ *      libretrodb_query_filter_buf() and libretrodb_query_filter()
+ *
+ * Built with LIBRETRODB_LIBFUZZER it is a libFuzzer target. Otherwise
+ * it runs the files given on the command line, or without arguments
+ * a deeply nested item followed by a fixed number of random
+ * mutations of a built-in corpus:
+ *
+ *   libretrodb_fuzz [-n iterations] [-s seed] [files...]
+ *
+ * Build with sanitizers (make libretrodb_fuzz) so that memory errors
+ * abort the run. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libretrodb.h"
+#include "query.h"
+#include "rmsgpack_dom.h"
+
+enum fuzz_target
+{
+	FUZZ_DOM_READ = 0,
+	FUZZ_DOM_READ_BUF,
+	FUZZ_QUERY,
+	FUZZ_QUERY_ITEM,
+
+	FUZZ_TARGET_LAST
+};
+
+#define FUZZ_MAX_INPUT 4096
+
+/* Far deeper than any reader may recurse. */
+#define FUZZ_DEEP_NESTING (4 * 1024 * 1024)
+
+static const char *fuzz_queries[] = {
+	"{name:'Game 000042'}",
+	"{name:glob('Game 0001*'),releaseyear:1985}",
+	"{crc:b'2a000000'}",
+	"{publisher:or('Pub 7','Pub 8')}",
+	"{releaseyear:between(1980,1990),users:2}",
+	"{serial:glob('SLUS-*'),rumble:true}",
+	"{nested:{a:[1,2,3]}}",
+};
+
+/* A game entry as the converters write it, as msgpack. */
+static const unsigned char fuzz_item[] = {
+	0x86,
+	0xa4, 'n', 'a', 'm', 'e',
+	0xab, 'G', 'a', 'm', 'e', ' ', '0', '0', '0', '0', '4', '2',
+	0xa3, 'c', 'r', 'c',
+	0xc4, 0x04, 0x2a, 0x00, 0x00, 0x00,
+	0xab, 'r', 'e', 'l', 'e', 'a', 's', 'e', 'y', 'e', 'a', 'r',
+	0xcd, 0x07, 0xc1,
+	0xa9, 'p', 'u', 'b', 'l', 'i', 's', 'h', 'e', 'r',
+	0xa5, 'P', 'u', 'b', ' ', '7',
+	0xa5, 'u', 's', 'e', 'r', 's',
+	0x02,
+	0xa6, 'n', 'e', 's', 't', 'e', 'd',
+	0x81, 0xa1, 'a', 0x93, 0x01, 0x02, 0x03,
+};
+
+static FILE *fuzz_file;
+
+/* Corrupt lengths ask for huge allocations: the readers must fail
+ * cleanly on them, and quickly rather than mapping gigabytes. */
+const char *__asan_default_options(void)
+{
+	return "allocator_may_return_null=1:max_allocation_size_mb=64";
+}
+
+static void fuzz_dom_read(const uint8_t *data, size_t size)
+{
+	struct rmsgpack_dom_value value;
+	int fd;
+
+	if (!fuzz_file && !(fuzz_file = tmpfile()))
+		return;
+	fd = fileno(fuzz_file);
+
+	if (ftruncate(fd, 0) != 0 || pwrite(fd, data, size, 0) != (ssize_t)size)
+		return;
+	lseek(fd, 0, SEEK_SET);
+
+	while (rmsgpack_dom_read(fd, &value) >= 0)
+	{
+		int type = value.type;
+
+		rmsgpack_dom_value_free(&value);
+		if (type == RDT_NULL)
+			break;
+	}
+}
+
+static void fuzz_dom_read_buf(const uint8_t *data, size_t size)
+{
+	size_t offset = 0;
+	struct rmsgpack_dom_value value;
+	struct rmsgpack_dom_scratch scratch;
+
+	while (offset < size &&
+			rmsgpack_dom_read_buf(data, size, &offset, &value) >= 0)
+		rmsgpack_dom_value_free(&value);
+
+	memset(&scratch, 0, sizeof(scratch));
+	offset = 0;
+	while (offset < size && rmsgpack_dom_read_view(data, size, &offset,
+				&scratch, &value) >= 0)
+		;
+	rmsgpack_dom_scratch_free(&scratch);
+}
+
+static void fuzz_query(const uint8_t *data, size_t size)
+{
+	unsigned i, match;
+	size_t offset = 0, key_len;
+	const char *field, *error = NULL;
+	const void *key;
+	struct rmsgpack_dom_value item;
+	libretrodb_query_t *q = (libretrodb_query_t *)libretrodb_query_compile(
+			NULL, (const char *)data, size, &error);
+
+	if (!q)
+		return;
+
+	if (rmsgpack_dom_read_buf(fuzz_item, sizeof(fuzz_item),
+				&offset, &item) >= 0)
+	{
+		libretrodb_query_filter(q, &item);
+		rmsgpack_dom_value_free(&item);
+	}
+
+	offset = 0;
+	libretrodb_query_filter_buf(q, fuzz_item, sizeof(fuzz_item), &offset);
+
+	for (i = 0; libretrodb_query_index_key(q, i, &field, &key,
+				&key_len, &match) == 0; i++)
+		;
+
+	libretrodb_query_free(q);
+}
+
+static void fuzz_query_item(const uint8_t *data, size_t size)
+{
+	unsigned i;
+	const char *error = NULL;
+
+	for (i = 0; i < sizeof(fuzz_queries) / sizeof(fuzz_queries[0]); i++)
+	{
+		size_t offset = 0;
+		struct rmsgpack_dom_value item;
+		libretrodb_query_t *q = (libretrodb_query_t *)libretrodb_query_compile(
+				NULL, fuzz_queries[i], strlen(fuzz_queries[i]), &error);
+
+		if (!q)
+			continue;
+
+		/* Undecided items get decoded, as libretrodb_cursor_read_item
+		 * does. */
+		if (libretrodb_query_filter_buf(q, data, size, &offset) < 0 &&
+				rmsgpack_dom_read_buf(data, size, &offset, &item) >= 0)
+		{
+			libretrodb_query_filter(q, &item);
+			rmsgpack_dom_value_free(&item);
+		}
+
+		libretrodb_query_free(q);
+	}
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	if (!size)
+		return 0;
+
+	switch (data[0] % FUZZ_TARGET_LAST)
+	{
+		case FUZZ_DOM_READ:
+			fuzz_dom_read(data + 1, size - 1);
+			break;
+		case FUZZ_DOM_READ_BUF:
+			fuzz_dom_read_buf(data + 1, size - 1);
+			break;
+		case FUZZ_QUERY:
+			fuzz_query(data + 1, size - 1);
+			break;
+		case FUZZ_QUERY_ITEM:
+			fuzz_query_item(data + 1, size - 1);
+			break;
+	}
+
+	return 0;
+}
+
+#ifndef LIBRETRODB_LIBFUZZER
+static size_t fuzz_seed(unsigned target, unsigned index, uint8_t *out)
+{
+	const void *src = fuzz_item;
+	size_t len = sizeof(fuzz_item);
+
+	if (target == FUZZ_QUERY)
+	{
+		src = fuzz_queries[index %
+			(sizeof(fuzz_queries) / sizeof(fuzz_queries[0]))];
+		len = strlen((const char *)src);
+	}
+
+	out[0] = target;
+	memcpy(out + 1, src, len);
+	return len + 1;
+}
+
+/* Flips, overwrites, inserts or deletes a few bytes, keeping the
+ * target selector intact. */
+static size_t fuzz_mutate(uint8_t *data, size_t size)
+{
+	static const uint8_t interesting[] = {
+		0x00, 0x7f, 0x80, 0xff, 0xc0, 0xc4, 0xcc, 0xcf, 0xd3, 0xdb,
+		0xdc, 0xdd, 0xde, 0xdf, '{', '}', '(', ')', '\'', ',', ':', '*'
+	};
+	unsigned n = 1 + rand() % 4;
+
+	while (n--)
+	{
+		size_t pos = 1 + rand() % size;
+
+		switch (rand() % 5)
+		{
+			case 0:
+				if (pos < size)
+					data[pos] ^= 1 << (rand() % 8);
+				break;
+			case 1:
+				if (pos < size)
+					data[pos] = rand();
+				break;
+			case 2:
+				if (pos < size)
+					data[pos] = interesting[rand() % sizeof(interesting)];
+				break;
+			case 3:
+				if (size < FUZZ_MAX_INPUT)
+				{
+					memmove(data + pos + 1, data + pos, size - pos);
+					data[pos] = interesting[rand() % sizeof(interesting)];
+					size++;
+				}
+				break;
+			case 4:
+				if (pos < size)
+				{
+					memmove(data + pos, data + pos + 1, size - pos - 1);
+					size--;
+				}
+				break;
+		}
+
+		if (size < 2)
+			break;
+	}
+
+	return size;
+}
+
+/* A map whose only value is an array nested millions deep: the
+ * readers must reject it rather than run out of stack. */
+static int fuzz_deep_nesting(void)
+{
+	unsigned target;
+	size_t size = 4 + FUZZ_DEEP_NESTING + 1;
+	uint8_t *data = (uint8_t *)malloc(size);
+
+	if (!data)
+		return 1;
+
+	data[1] = 0x81;
+	data[2] = 0xa1;
+	data[3] = 'x';
+	memset(data + 4, 0x91, FUZZ_DEEP_NESTING);
+	data[size - 1] = 0xc0;
+
+	for (target = FUZZ_DOM_READ_BUF; target < FUZZ_TARGET_LAST; target++)
+	{
+		if (target == FUZZ_QUERY)
+			continue;
+		data[0] = target;
+		LLVMFuzzerTestOneInput(data, size);
+	}
+
+	free(data);
+	return 0;
+}
+
+static int fuzz_run_file(const char *path)
+{
+	uint8_t data[FUZZ_MAX_INPUT];
+	size_t size;
+	FILE *file = fopen(path, "rb");
+
+	if (!file)
+	{
+		perror(path);
+		return 1;
+	}
+
+	size = fread(data, 1, sizeof(data), file);
+	fclose(file);
+
+	LLVMFuzzerTestOneInput(data, size);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int i;
+	unsigned long n, iterations = 200000;
+	unsigned seed = 1;
+	uint8_t data[FUZZ_MAX_INPUT + 1];
+
+	for (i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			iterations = strtoul(argv[++i], NULL, 0);
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+			seed = strtoul(argv[++i], NULL, 0);
+		else
+			break;
+	}
+
+	if (i < argc)
+	{
+		int rv = 0;
+
+		for (; i < argc; i++)
+			rv |= fuzz_run_file(argv[i]);
+		return rv;
+	}
+
+	if (fuzz_deep_nesting())
+		return 1;
+
+	srand(seed);
+
+	for (n = 0; n < iterations; n++)
+	{
+		size_t size = fuzz_seed(n % FUZZ_TARGET_LAST,
+				n / FUZZ_TARGET_LAST, data);
+
+		size = fuzz_mutate(data, size);
+		LLVMFuzzerTestOneInput(data, size);
+	}
+
+	printf("%lu inputs, no crashes.\n", iterations);
+	return 0;
+}
+#endif
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "libretrodb.h"
@@ -20,6 +21,7 @@ int main(int argc, char ** argv)
       printf("\tlist\n");
       printf("\tcreate-index <index name> <field name>\n");
       printf("\tfind <query expression>\n");
+      printf("\tsearch <index name> <exact|prefix|substring> <text>\n");
       return 1;
    }
 
@@ -51,6 +53,8 @@ int main(int argc, char ** argv)
          printf("\n");
          rmsgpack_dom_value_free(&item);
       }
+
+      libretrodb_cursor_close(&cur);
    }
    else if (strcmp(command, "find") == 0)
    {
@@ -82,6 +86,53 @@ int main(int argc, char ** argv)
          printf("\n");
          rmsgpack_dom_value_free(&item);
       }
+
+      libretrodb_cursor_close(&cur);
+      libretrodb_query_free(q);
+   }
+   else if (strcmp(command, "search") == 0)
+   {
+      int i, count;
+      unsigned match;
+      uint64_t *offsets = NULL;
+
+      if (argc != 6)
+      {
+         printf("Usage: %s <db file> search <index name> <exact|prefix|substring> <text>\n", argv[0]);
+         return 1;
+      }
+
+      if (strcmp(argv[4], "exact") == 0)
+         match = LIBRETRODB_MATCH_EXACT;
+      else if (strcmp(argv[4], "prefix") == 0)
+         match = LIBRETRODB_MATCH_PREFIX;
+      else if (strcmp(argv[4], "substring") == 0)
+         match = LIBRETRODB_MATCH_SUBSTRING;
+      else
+      {
+         printf("Unknown match kind %s\n", argv[4]);
+         return 1;
+      }
+
+      count = libretrodb_find_strings(&db, argv[3], argv[5],
+            strlen(argv[5]), match, &offsets);
+
+      if (count < 0)
+      {
+         printf("Could not search index %s\n", argv[3]);
+         return 1;
+      }
+
+      for (i = 0; i < count; i++)
+      {
+         if (libretrodb_read_entry(&db, offsets[i], &item) != 0)
+            continue;
+         rmsgpack_dom_value_print(&item);
+         printf("\n");
+         rmsgpack_dom_value_free(&item);
+      }
+
+      free(offsets);
    }
    else if (strcmp(command, "create-index") == 0)
    {
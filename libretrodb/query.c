@@ -7,9 +7,11 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <string.h>
+#include <errno.h>
 
 #include "libretrodb.h"
 
+#include "rmsgpack.h"
 #include "rmsgpack_dom.h"
 #include <compat/fnmatch.h>
 
@@ -58,6 +60,18 @@ static void raise_expected_string(off_t where, const char ** error)
    *error = tmp_error_buff;
 }
 
+static void raise_expected_value(off_t where, const char ** error)
+{
+   snprintf(tmp_error_buff, MAX_ERROR_LEN,
+#ifdef _WIN32
+         "%I64u::Expected value",
+#else
+         "%llu::Expected value",
+#endif
+         (unsigned long long)where);
+   *error = tmp_error_buff;
+}
+
 static void raise_unexpected_eof(off_t where, const char ** error)
 {
    snprintf(tmp_error_buff, MAX_ERROR_LEN,
@@ -165,12 +179,28 @@ static void argument_free(struct argument *arg)
 
    for (i = 0; i < arg->invocation.argc; i++)
       argument_free(&arg->invocation.argv[i]);
+   free(arg->invocation.argv);
 }
 
+/* Tokens nested deeper than this make the raw filter fall back
+ * to decoding the item. */
+#define QUERY_RAW_MAX_DEPTH 32
+
+/* A root-level "{field: predicate}" pair, checked by
+ * libretrodb_query_filter_buf() straight on encoded items. */
+struct query_pred
+{
+	const struct rmsgpack_dom_value *field;
+	const struct argument *arg;
+};
+
 struct query
 {
 	unsigned ref_count;
 	struct invocation root;
+	/* Flat predicate list, only set when root is a table. */
+	struct query_pred preds[MAX_ARGS / 2];
+	unsigned pred_count;
 };
 
 struct registered_func
@@ -321,6 +351,8 @@ static struct rmsgpack_dom_value q_glob(struct rmsgpack_dom_value input,
       unsigned argc, const struct argument * argv)
 {
    struct rmsgpack_dom_value res;
+   char tmp[256];
+   char *str  = NULL;
    unsigned i = 0;
 
    res.type = RDT_BOOL;
@@ -334,11 +366,31 @@ static struct rmsgpack_dom_value q_glob(struct rmsgpack_dom_value input,
       return res;
    if (input.type != RDT_STRING)
       return res;
+
+   /* Strings of mapped items are not NUL-terminated. */
+   if (input.string.len < sizeof(tmp))
+   {
+      memcpy(tmp, input.string.buff, input.string.len);
+      tmp[input.string.len] = '\0';
+      str = tmp;
+   }
+   else
+   {
+      str = (char*)malloc(input.string.len + 1);
+      if (!str)
+         return res;
+      memcpy(str, input.string.buff, input.string.len);
+      str[input.string.len] = '\0';
+   }
+
    res.bool_ = rl_fnmatch(
          argv[0].value.string.buff,
-         input.string.buff,
+         str,
          0
          ) == 0;
+
+   if (str != tmp)
+      free(str);
    return res;
 }
 
@@ -520,6 +572,56 @@ static struct buffer parse_string(struct buffer buff,
    return buff;
 }
 
+static int hex_digit(char c)
+{
+   if (c >= '0' && c <= '9')
+      return c - '0';
+   if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+   if (c >= 'A' && c <= 'F')
+      return c - 'A' + 10;
+   return -1;
+}
+
+/* b'0123abcd' is a binary value given as hex digits. */
+static struct buffer parse_binary(struct buffer buff,
+      struct rmsgpack_dom_value *value, const char **error)
+{
+   unsigned i;
+   off_t start;
+
+   buff.offset++;
+   start = buff.offset;
+   buff  = parse_string(buff, value, error);
+
+   if (*error)
+      return buff;
+
+   if (value->string.len % 2)
+      goto invalid;
+
+   for (i = 0; i < value->string.len; i += 2)
+   {
+      int hi = hex_digit(value->string.buff[i]);
+      int lo = hex_digit(value->string.buff[i + 1]);
+
+      if (hi < 0 || lo < 0)
+         goto invalid;
+
+      value->string.buff[i / 2] = (char)((hi << 4) | lo);
+   }
+
+   value->type       = RDT_BINARY;
+   value->binary.len = value->string.len / 2;
+   return buff;
+
+invalid:
+   free(value->string.buff);
+   value->type = RDT_NULL;
+   raise_expected_string(start, error);
+   return buff;
+}
+
 static struct buffer parse_integer(struct buffer buff,
       struct rmsgpack_dom_value *value, const char **error)
 {
@@ -563,10 +665,14 @@ static struct buffer parse_value(struct buffer buff,
       value->type = RDT_BOOL;
       value->bool_ = 0;
    }
+   else if (peek(buff, "b\"") || peek(buff, "b'"))
+      buff = parse_binary(buff, value, error);
    else if (peek(buff, "\"") || peek(buff, "'"))
       buff = parse_string(buff, value, error);
    else if (isdigit(buff.data[buff.offset]))
       buff = parse_integer(buff, value, error);
+   else
+      raise_expected_value(buff.offset, error);
    return buff;
 }
 
@@ -618,6 +724,7 @@ static struct buffer parse_method_call(struct buffer buff,
    unsigned argi = 0;
    struct registered_func * rf = registered_functions;
 
+   memset(args, 0, sizeof(struct argument) * MAX_ARGS);
    invocation->func = NULL;
 
    buff = get_ident(buff, &func_name, &func_name_len, error);
@@ -821,6 +928,8 @@ static struct buffer parse_argument(struct buffer buff,
             peek(buff, "nil")
             || peek(buff, "true")
             || peek(buff, "false")
+            || peek(buff, "b\"")
+            || peek(buff, "b'")
             )
       )
    {
@@ -853,6 +962,30 @@ void libretrodb_query_free(void *q)
 
 	for (i = 0; i < real_q->root.argc; i++)
 		argument_free(&real_q->root.argv[i]);
+	free(real_q->root.argv);
+	free(real_q);
+}
+
+/* Flattens a root table into its field/predicate pairs. */
+static void query_compile_preds(struct query *q)
+{
+   unsigned i;
+
+   if (q->root.func != all_map || q->root.argc % 2)
+      return;
+
+   for (i = 0; i < q->root.argc; i += 2)
+   {
+      if (q->root.argv[i].type != AT_VALUE)
+         return;
+   }
+
+   for (i = 0; i < q->root.argc; i += 2)
+   {
+      q->preds[i / 2].field = &q->root.argv[i].value;
+      q->preds[i / 2].arg   = &q->root.argv[i + 1];
+   }
+   q->pred_count = q->root.argc / 2;
 }
 
 void *libretrodb_query_compile(libretrodb_t *db,
@@ -861,8 +994,13 @@ void *libretrodb_query_compile(libretrodb_t *db,
    struct buffer buff;
    struct query *q = (struct query*)malloc(sizeof(struct query));
 
+   *error = NULL;
+
    if (!q)
-      goto clean;
+   {
+      raise_enomem(error);
+      return NULL;
+   }
 
    memset(q, 0, sizeof(struct query));
 
@@ -870,7 +1008,6 @@ void *libretrodb_query_compile(libretrodb_t *db,
    buff.data    = query;
    buff.len     = buff_len;
    buff.offset  = 0;
-   *error       = NULL;
 
    buff = chomp(buff);
 
@@ -881,7 +1018,11 @@ void *libretrodb_query_compile(libretrodb_t *db,
          goto clean;
    }
    else if (isalpha(buff.data[buff.offset]))
+   {
       buff = parse_method_call(buff, &q->root, error);
+      if (*error)
+         goto clean;
+   }
 
    buff = expect_eof(buff, error);
    if (*error)
@@ -890,14 +1031,15 @@ void *libretrodb_query_compile(libretrodb_t *db,
    if (!q->root.func)
    {
       raise_unexpected_eof(buff.offset, error);
-      return NULL;
+      goto clean;
    }
-   goto success;
-clean:
-   if (q)
-      libretrodb_query_free(q);
-success:
+
+   query_compile_preds(q);
    return q;
+
+clean:
+   libretrodb_query_free(q);
+   return NULL;
 }
 
 void libretrodb_query_inc_ref(libretrodb_query_t *q)
@@ -914,3 +1056,335 @@ int libretrodb_query_filter(libretrodb_query_t *q,
    struct rmsgpack_dom_value res = inv.func(*v, inv.argc, inv.argv);
    return (res.type == RDT_BOOL && res.bool_);
 }
+
+/* Classifies glob('pattern') for index lookups: a pattern without
+ * wildcards is an exact match and one whose only wildcard is a
+ * trailing '*' is a prefix match. Returns the key length used,
+ * or -1 if the pattern needs a scan. */
+static int query_glob_key(const struct rmsgpack_dom_value *pattern,
+      unsigned *match)
+{
+   uint32_t i;
+   uint32_t len = pattern->string.len;
+
+   *match = LIBRETRODB_MATCH_EXACT;
+
+   if (len && pattern->string.buff[len - 1] == '*')
+   {
+      *match = LIBRETRODB_MATCH_PREFIX;
+      len--;
+   }
+
+   for (i = 0; i < len; i++)
+   {
+      switch (pattern->string.buff[i])
+      {
+         case '*':
+         case '?':
+         case '[':
+         case '\\':
+            return -1;
+      }
+   }
+
+   return (int)len;
+}
+
+/**
+ * libretrodb_query_index_key:
+ * @q                   : Compiled query.
+ * @i                   : Which candidate to return.
+ * @field               : NUL-terminated field name.
+ * @key                 : Value the field must match.
+ * @key_len             : Size of @key.
+ * @match               : LIBRETRODB_MATCH_EXACT or LIBRETRODB_MATCH_PREFIX.
+ *
+ * Enumerates the "{field: literal}" equalities and the
+ * "{field: glob('literal*')}" prefixes every match must satisfy, so
+ * a cursor can resolve the query through an index on one of those
+ * fields instead of a scan.
+ *
+ * Returns: 0 if candidate @i exists, otherwise -1.
+ **/
+int libretrodb_query_index_key(libretrodb_query_t *q, unsigned i,
+      const char **field, const void **key, size_t *key_len,
+      unsigned *match)
+{
+   unsigned j;
+   struct query *rq = (struct query*)q;
+
+   for (j = 0; j < rq->pred_count; j++)
+   {
+      const struct argument *arg = rq->preds[j].arg;
+      const struct rmsgpack_dom_value *value;
+      int len;
+
+      if (rq->preds[j].field->type != RDT_STRING)
+         continue;
+
+      if (arg->type == AT_VALUE)
+      {
+         value = &arg->value;
+         if (value->type != RDT_BINARY && value->type != RDT_STRING)
+            continue;
+         *match = LIBRETRODB_MATCH_EXACT;
+         len    = value->binary.len;
+      }
+      else if (arg->invocation.func == q_glob &&
+            arg->invocation.argc == 1 &&
+            arg->invocation.argv[0].type == AT_VALUE &&
+            arg->invocation.argv[0].value.type == RDT_STRING)
+      {
+         value = &arg->invocation.argv[0].value;
+         if ((len = query_glob_key(value, match)) < 0)
+            continue;
+      }
+      else
+         continue;
+
+      if (i--)
+         continue;
+
+      *field   = rq->preds[j].field->string.buff;
+      *key     = value->binary.buff;
+      *key_len = len;
+      return 0;
+   }
+
+   return -1;
+}
+
+struct query_raw_state
+{
+   const struct query *q;
+   /* Tokens left in each open container, the item itself first. */
+   uint64_t remaining[QUERY_RAW_MAX_DEPTH];
+   unsigned depth;
+   int is_key;
+   int fallback;
+   /* Predicates whose field is the current root-level key. */
+   uint32_t keyed;
+   uint32_t seen;
+   uint32_t result;
+};
+
+static int query_pred_eval(const struct argument *arg,
+      struct rmsgpack_dom_value input)
+{
+   struct rmsgpack_dom_value res;
+
+   if (arg->type == AT_VALUE)
+      res = equals(input, 1, arg);
+   else
+      res = is_true(arg->invocation.func(input,
+               arg->invocation.argc, arg->invocation.argv), 0, NULL);
+
+   return res.bool_;
+}
+
+static int query_raw_token(struct query_raw_state *s,
+      struct rmsgpack_dom_value *v, uint64_t children)
+{
+   unsigned i;
+
+   if (s->fallback)
+      return -EINVAL;
+
+   if (s->depth == 0)
+   {
+      /* The item itself. */
+      if (v->type != RDT_MAP)
+      {
+         s->fallback = 1;
+         return -EINVAL;
+      }
+   }
+   else
+   {
+      if (s->depth == 1)
+      {
+         if (s->is_key)
+         {
+            s->keyed = 0;
+            for (i = 0; i < s->q->pred_count; i++)
+            {
+               if (rmsgpack_dom_value_cmp(s->q->preds[i].field, v) == 0)
+                  s->keyed |= 1u << i;
+            }
+         }
+         else if (s->keyed)
+         {
+            /* Predicates over containers need the decoded item. */
+            if (v->type == RDT_MAP || v->type == RDT_ARRAY)
+            {
+               s->fallback = 1;
+               return -EINVAL;
+            }
+
+            for (i = 0; i < s->q->pred_count; i++)
+            {
+               if (!(s->keyed & (1u << i)))
+                  continue;
+
+               s->seen |= 1u << i;
+               if (query_pred_eval(s->q->preds[i].arg, *v))
+                  s->result |= 1u << i;
+               else
+                  s->result &= ~(1u << i);
+            }
+         }
+
+         s->is_key = !s->is_key;
+      }
+
+      s->remaining[s->depth - 1]--;
+   }
+
+   if (children)
+   {
+      if (s->depth >= QUERY_RAW_MAX_DEPTH)
+      {
+         s->fallback = 1;
+         return -EINVAL;
+      }
+      s->remaining[s->depth++] = children;
+   }
+
+   while (s->depth > 0 && s->remaining[s->depth - 1] == 0)
+      s->depth--;
+
+   return 0;
+}
+
+static int query_raw_nil(void *data)
+{
+   struct rmsgpack_dom_value v;
+   v.type = RDT_NULL;
+   return query_raw_token((struct query_raw_state*)data, &v, 0);
+}
+
+static int query_raw_bool(int value, void *data)
+{
+   struct rmsgpack_dom_value v;
+   v.type  = RDT_BOOL;
+   v.bool_ = value;
+   return query_raw_token((struct query_raw_state*)data, &v, 0);
+}
+
+static int query_raw_int(int64_t value, void *data)
+{
+   struct rmsgpack_dom_value v;
+   v.type = RDT_INT;
+   v.int_ = value;
+   return query_raw_token((struct query_raw_state*)data, &v, 0);
+}
+
+static int query_raw_uint(uint64_t value, void *data)
+{
+   struct rmsgpack_dom_value v;
+   v.type  = RDT_UINT;
+   v.uint_ = value;
+   return query_raw_token((struct query_raw_state*)data, &v, 0);
+}
+
+static int query_raw_string(char *value, uint32_t len, void *data)
+{
+   struct rmsgpack_dom_value v;
+   v.type        = RDT_STRING;
+   v.string.buff = value;
+   v.string.len  = len;
+   return query_raw_token((struct query_raw_state*)data, &v, 0);
+}
+
+static int query_raw_bin(void *value, uint32_t len, void *data)
+{
+   struct rmsgpack_dom_value v;
+   v.type        = RDT_BINARY;
+   v.binary.buff = (char*)value;
+   v.binary.len  = len;
+   return query_raw_token((struct query_raw_state*)data, &v, 0);
+}
+
+static int query_raw_map_start(uint32_t len, void *data)
+{
+   struct rmsgpack_dom_value v;
+   v.type = RDT_MAP;
+   return query_raw_token((struct query_raw_state*)data, &v,
+         (uint64_t)len * 2);
+}
+
+static int query_raw_array_start(uint32_t len, void *data)
+{
+   struct rmsgpack_dom_value v;
+   v.type = RDT_ARRAY;
+   return query_raw_token((struct query_raw_state*)data, &v, len);
+}
+
+static struct rmsgpack_read_callbacks query_raw_callbacks = {
+   query_raw_nil,
+   query_raw_bool,
+   query_raw_int,
+   query_raw_uint,
+   query_raw_string,
+   query_raw_bin,
+   query_raw_map_start,
+   query_raw_array_start
+};
+
+/**
+ * libretrodb_query_filter_buf:
+ * @q                   : Compiled query.
+ * @buf                 : Encoded items.
+ * @size                : Size of @buf.
+ * @offset              : Offset of the item to test, advanced past it
+ *                        when the item was decided.
+ *
+ * Tests the item at *@offset against a table query by walking its
+ * msgpack encoding, without building a DOM for it.
+ *
+ * Returns: 1 if the item matches, 0 if it does not, or -1 if
+ * it has to be decoded and checked with libretrodb_query_filter().
+ **/
+int libretrodb_query_filter_buf(libretrodb_query_t *q,
+      const void *buf, size_t size, size_t *offset)
+{
+   unsigned i;
+   struct query_raw_state s;
+   size_t pos            = *offset;
+   const struct query *rq = (const struct query*)q;
+
+   if (!rq->pred_count)
+      return -1;
+
+   memset(&s, 0, sizeof(s));
+   s.q      = rq;
+   s.is_key = 1;
+
+   if (rmsgpack_read_buf(buf, size, &pos, &query_raw_callbacks, &s) < 0
+         || s.fallback)
+      return -1;
+
+   for (i = 0; i < rq->pred_count; i++)
+   {
+      struct rmsgpack_dom_value nil_value;
+
+      if (s.seen & (1u << i))
+      {
+         if (!(s.result & (1u << i)))
+            goto no_match;
+         continue;
+      }
+
+      /* All missing fields are nil */
+      nil_value.type = RDT_NULL;
+      if (!query_pred_eval(rq->preds[i].arg, nil_value))
+         goto no_match;
+   }
+
+   *offset = pos;
+   return 1;
+
+no_match:
+   *offset = pos;
+   return 0;
+}
@@ -10,4 +10,11 @@ void libretrodb_query_dec_ref(libretrodb_query_t *q);
 int libretrodb_query_filter(libretrodb_query_t *q,
       struct rmsgpack_dom_value * v);
 
+int libretrodb_query_filter_buf(libretrodb_query_t *q,
+      const void *buf, size_t size, size_t *offset);
+
+int libretrodb_query_index_key(libretrodb_query_t *q, unsigned i,
+      const char **field, const void **key, size_t *key_len,
+      unsigned *match);
+
 #endif
@@ -20,6 +20,7 @@
 #include <errno.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/types.h>
 
 #include "libretrodb_endian.h"
 
@@ -328,13 +329,65 @@ int rmsgpack_write_uint(int fd, uint64_t value)
    return written;
 }
 
-static int read_uint(int fd, uint64_t *out, size_t size)
+/* Reads exactly @size bytes, so that truncated input fails
+ * instead of leaving the rest of the value uninitialized. */
+static int read_exact(int fd, void *buf, size_t size)
+{
+   while (size)
+   {
+      ssize_t rv = read(fd, buf, size);
+
+      if (rv < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         return -errno;
+      }
+      if (rv == 0)
+         return -EINVAL;
+
+      buf   = (char *)buf + rv;
+      size -= rv;
+   }
+
+   return 0;
+}
+
+/* Lengths and counts come straight from the input. Before acting
+ * on a large one, make sure the file still holds at least @len
+ * bytes, so that corrupt input fails instead of asking for a huge
+ * allocation. Descriptors that can't seek are not checked. */
+#define RMSGPACK_CHECKED_LEN 4096
+
+static int check_remaining(int fd, uint64_t len)
 {
-   uint64_t tmp;
+   off_t cur, end;
+
+   if (len < RMSGPACK_CHECKED_LEN)
+      return 0;
 
-   if (read(fd, &tmp, size) == -1)
+   cur = lseek(fd, 0, SEEK_CUR);
+   if (cur < 0)
+      return 0;
+
+   end = lseek(fd, 0, SEEK_END);
+   if (lseek(fd, cur, SEEK_SET) < 0)
       return -errno;
 
+   if (end >= 0 && (uint64_t)(end - cur) < len)
+      return -EINVAL;
+
+   return 0;
+}
+
+static int read_uint(int fd, uint64_t *out, size_t size)
+{
+   int rv;
+   uint64_t tmp = 0;
+
+   if ((rv = read_exact(fd, &tmp, size)) < 0)
+      return rv;
+
    switch (size)
    {
       case 1:
@@ -355,13 +408,14 @@ static int read_uint(int fd, uint64_t *out, size_t size)
 
 static int read_int(int fd, int64_t *out, size_t size)
 {
+   int rv;
    uint8_t tmp8 = 0;
    uint16_t tmp16;
    uint32_t tmp32;
-   uint64_t tmp64;
+   uint64_t tmp64 = 0;
 
-   if (read(fd, &tmp64, size) == -1)
-      return -errno;
+   if ((rv = read_exact(fd, &tmp64, size)) < 0)
+      return rv;
 
    (void)tmp8;
 
@@ -388,17 +442,23 @@ static int read_int(int fd, int64_t *out, size_t size)
 
 static int read_buff(int fd, size_t size, char **pbuff, uint64_t *len)
 {
+   int rv;
    uint64_t tmp_len = 0;
 
-   if (read_uint(fd, &tmp_len, size) == -1)
-      return -errno;
+   if ((rv = read_uint(fd, &tmp_len, size)) < 0)
+      return rv;
+
+   if ((rv = check_remaining(fd, tmp_len)) < 0)
+      return rv;
 
    *pbuff = (char *)calloc(tmp_len + 1, sizeof(char));
+   if (!*pbuff)
+      return -ENOMEM;
 
-   if (read(fd, *pbuff, tmp_len) == -1)
+   if ((rv = read_exact(fd, *pbuff, tmp_len)) < 0)
    {
       free(*pbuff);
-      return -errno;
+      return rv;
    }
 
    *len = tmp_len;
@@ -455,8 +515,8 @@ int rmsgpack_read(int fd,
    uint8_t type      = 0;
    char *buff        = NULL;
 
-   if (read(fd, &type, sizeof(uint8_t)) == -1)
-      return -errno;
+   if ((rv = read_exact(fd, &type, sizeof(uint8_t))) < 0)
+      return rv;
 
    if (type < MPF_FIXMAP)
    {
@@ -480,10 +540,10 @@ int rmsgpack_read(int fd,
       buff = (char *)calloc(tmp_len + 1, sizeof(char));
       if (!buff)
          return -ENOMEM;
-      if (read(fd, buff, tmp_len) == -1)
+      if ((rv = read_exact(fd, buff, tmp_len)) < 0)
       {
          free(buff);
-         return -errno;
+         return rv;
       }
       buff[tmp_len] = '\0';
       if (!callbacks->read_string)
@@ -523,6 +583,7 @@ int rmsgpack_read(int fd,
 
          if (callbacks->read_bin)
             return callbacks->read_bin(buff, tmp_len, data);
+         free(buff);
          break;
       case 0xcc:
       case 0xcd:
@@ -530,8 +591,8 @@ int rmsgpack_read(int fd,
       case 0xcf:
          tmp_len = 1ULL << (type - 0xcc);
          tmp_uint = 0;
-         if (read_uint(fd, &tmp_uint, tmp_len) == -1)
-            return -errno;
+         if ((rv = read_uint(fd, &tmp_uint, tmp_len)) < 0)
+            return rv;
 
          if (callbacks->read_uint)
             return callbacks->read_uint(tmp_uint, data);
@@ -542,8 +603,8 @@ int rmsgpack_read(int fd,
       case 0xd3:
          tmp_len = 1ULL << (type - 0xd0);
          tmp_int = 0;
-         if (read_int(fd, &tmp_int, tmp_len) == -1)
-            return -errno;
+         if ((rv = read_int(fd, &tmp_int, tmp_len)) < 0)
+            return rv;
 
          if (callbacks->read_int)
             return callbacks->read_int(tmp_int, data);
@@ -556,20 +617,278 @@ int rmsgpack_read(int fd,
 
          if (callbacks->read_string)
             return callbacks->read_string(buff, tmp_len, data);
+         free(buff);
          break;
       case 0xdc:
       case 0xdd:
-         if (read_uint(fd, &tmp_len, 2<<(type - 0xdc)) == -1)
-            return -errno;
+         if ((rv = read_uint(fd, &tmp_len, 2<<(type - 0xdc))) < 0)
+            return rv;
+
+         /* Every element takes at least a byte. */
+         if ((rv = check_remaining(fd, tmp_len)) < 0)
+            return rv;
 
          return read_array(fd, tmp_len, callbacks, data);
       case 0xde:
       case 0xdf:
-         if (read_uint(fd, &tmp_len, 2<<(type - 0xde)) == -1)
-            return -errno;
+         if ((rv = read_uint(fd, &tmp_len, 2<<(type - 0xde))) < 0)
+            return rv;
+
+         /* Every key and value takes at least a byte. */
+         if ((rv = check_remaining(fd, tmp_len * 2)) < 0)
+            return rv;
 
          return read_map(fd, tmp_len, callbacks, data);
    }
 
    return 0;
 }
+
+static int buf_read_uint(const uint8_t *buf, size_t size, size_t *offset,
+      uint64_t *out, size_t len)
+{
+   size_t i;
+   uint64_t value = 0;
+
+   if (len > size - *offset)
+      return -EINVAL;
+
+   for (i = 0; i < len; i++)
+      value = (value << 8) | buf[*offset + i];
+
+   *offset += len;
+   *out     = value;
+   return 0;
+}
+
+static int buf_read_int(const uint8_t *buf, size_t size, size_t *offset,
+      int64_t *out, size_t len)
+{
+   uint64_t value = 0;
+
+   if (buf_read_uint(buf, size, offset, &value, len) < 0)
+      return -EINVAL;
+
+   switch (len)
+   {
+      case 1:
+         *out = (int8_t)value;
+         break;
+      case 2:
+         *out = (int16_t)value;
+         break;
+      case 4:
+         *out = (int32_t)value;
+         break;
+      default:
+         *out = (int64_t)value;
+         break;
+   }
+   return 0;
+}
+
+static int buf_read_buff(const uint8_t *buf, size_t size, size_t *offset,
+      size_t len_size, char **pbuff, uint64_t *len)
+{
+   if (buf_read_uint(buf, size, offset, len, len_size) < 0)
+      return -EINVAL;
+   if (*len > size - *offset)
+      return -EINVAL;
+
+   *pbuff   = (char*)buf + *offset;
+   *offset += *len;
+   return 0;
+}
+
+/* Containers nested deeper than this are rejected, so that
+ * corrupt input can't recurse until the stack runs out. It is not
+ * below the DOM reader's own limit. */
+#define RMSGPACK_MAX_DEPTH 128
+
+static int buf_read_value(const uint8_t *buf, size_t size, size_t *offset,
+      struct rmsgpack_read_callbacks *callbacks, void *data, unsigned depth);
+
+static int buf_read_map(const uint8_t *buf, size_t size, size_t *offset,
+      uint32_t len, struct rmsgpack_read_callbacks *callbacks, void *data,
+      unsigned depth)
+{
+   int rv;
+   unsigned i;
+
+   if (len > size - *offset || depth >= RMSGPACK_MAX_DEPTH)
+      return -EINVAL;
+
+   if (callbacks->read_map_start &&
+         (rv = callbacks->read_map_start(len, data)) < 0)
+      return rv;
+
+   for (i = 0; i < len; i++)
+   {
+      if ((rv = buf_read_value(buf, size, offset, callbacks, data,
+                  depth + 1)) < 0)
+         return rv;
+      if ((rv = buf_read_value(buf, size, offset, callbacks, data,
+                  depth + 1)) < 0)
+         return rv;
+   }
+
+   return 0;
+}
+
+static int buf_read_array(const uint8_t *buf, size_t size, size_t *offset,
+      uint32_t len, struct rmsgpack_read_callbacks *callbacks, void *data,
+      unsigned depth)
+{
+   int rv;
+   unsigned i;
+
+   if (len > size - *offset || depth >= RMSGPACK_MAX_DEPTH)
+      return -EINVAL;
+
+   if (callbacks->read_array_start &&
+         (rv = callbacks->read_array_start(len, data)) < 0)
+      return rv;
+
+   for (i = 0; i < len; i++)
+   {
+      if ((rv = buf_read_value(buf, size, offset, callbacks, data,
+                  depth + 1)) < 0)
+         return rv;
+   }
+
+   return 0;
+}
+
+static int buf_read_value(const uint8_t *buf, size_t size, size_t *offset,
+      struct rmsgpack_read_callbacks *callbacks, void *data, unsigned depth)
+{
+   int rv;
+   uint64_t tmp_len   = 0;
+   uint64_t tmp_uint  = 0;
+   int64_t tmp_int    = 0;
+   uint8_t type       = 0;
+   char *buff         = NULL;
+
+   if (*offset >= size)
+      return -EINVAL;
+
+   type = buf[(*offset)++];
+
+   if (type < MPF_FIXMAP)
+   {
+      if (!callbacks->read_int)
+         return 0;
+      return callbacks->read_int(type, data);
+   }
+   else if (type < MPF_FIXARRAY)
+      return buf_read_map(buf, size, offset, type - MPF_FIXMAP,
+            callbacks, data, depth);
+   else if (type < MPF_FIXSTR)
+      return buf_read_array(buf, size, offset, type - MPF_FIXARRAY,
+            callbacks, data, depth);
+   else if (type < MPF_NIL)
+   {
+      tmp_len = type - MPF_FIXSTR;
+      if (tmp_len > size - *offset)
+         return -EINVAL;
+
+      buff     = (char*)buf + *offset;
+      *offset += tmp_len;
+
+      if (!callbacks->read_string)
+         return 0;
+      return callbacks->read_string(buff, tmp_len, data);
+   }
+   else if (type > MPF_MAP32)
+   {
+      if (!callbacks->read_int)
+         return 0;
+      return callbacks->read_int(type - 0xff - 1, data);
+   }
+
+   switch (type)
+   {
+      case 0xc0:
+         if (callbacks->read_nil)
+            return callbacks->read_nil(data);
+         break;
+      case 0xc2:
+         if (callbacks->read_bool)
+            return callbacks->read_bool(0, data);
+         break;
+      case 0xc3:
+         if (callbacks->read_bool)
+            return callbacks->read_bool(1, data);
+         break;
+      case 0xc4:
+      case 0xc5:
+      case 0xc6:
+         if ((rv = buf_read_buff(buf, size, offset, 1<<(type - 0xc4),
+                     &buff, &tmp_len)) < 0)
+            return rv;
+
+         if (callbacks->read_bin)
+            return callbacks->read_bin(buff, tmp_len, data);
+         break;
+      case 0xcc:
+      case 0xcd:
+      case 0xce:
+      case 0xcf:
+         if (buf_read_uint(buf, size, offset, &tmp_uint,
+                  1ULL << (type - 0xcc)) < 0)
+            return -EINVAL;
+
+         if (callbacks->read_uint)
+            return callbacks->read_uint(tmp_uint, data);
+         break;
+      case 0xd0:
+      case 0xd1:
+      case 0xd2:
+      case 0xd3:
+         if (buf_read_int(buf, size, offset, &tmp_int,
+                  1ULL << (type - 0xd0)) < 0)
+            return -EINVAL;
+
+         if (callbacks->read_int)
+            return callbacks->read_int(tmp_int, data);
+         break;
+      case 0xd9:
+      case 0xda:
+      case 0xdb:
+         if ((rv = buf_read_buff(buf, size, offset, 1<<(type - 0xd9),
+                     &buff, &tmp_len)) < 0)
+            return rv;
+
+         if (callbacks->read_string)
+            return callbacks->read_string(buff, tmp_len, data);
+         break;
+      case 0xdc:
+      case 0xdd:
+         if (buf_read_uint(buf, size, offset, &tmp_len,
+                  2<<(type - 0xdc)) < 0)
+            return -EINVAL;
+
+         return buf_read_array(buf, size, offset, tmp_len, callbacks, data,
+               depth);
+      case 0xde:
+      case 0xdf:
+         if (buf_read_uint(buf, size, offset, &tmp_len,
+                  2<<(type - 0xde)) < 0)
+            return -EINVAL;
+
+         return buf_read_map(buf, size, offset, tmp_len, callbacks, data,
+               depth);
+      default:
+         /* Float and ext types are not supported. */
+         return -EINVAL;
+   }
+
+   return 0;
+}
+
+int rmsgpack_read_buf(const void *buf, size_t size, size_t *offset,
+      struct rmsgpack_read_callbacks *callbacks, void *data)
+{
+   return buf_read_value((const uint8_t*)buf, size, offset,
+         callbacks, data, 0);
+}
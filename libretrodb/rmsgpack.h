@@ -1,6 +1,7 @@
 #ifndef __RARCHDB_MSGPACK_H__
 #define __RARCHDB_MSGPACK_H__
 
+#include <stddef.h>
 #include <stdint.h>
 
 struct rmsgpack_read_callbacks {
@@ -76,5 +77,18 @@ int rmsgpack_read(
         void * data
 );
 
+/* Same as rmsgpack_read() but decodes the value starting at *offset
+ * in an in-memory buffer of @size bytes and advances *offset past it.
+ * String and binary payloads are handed to the callbacks as pointers
+ * into @buf: they are not NUL-terminated and must not be freed.
+ * Containers nested too deeply fail with -EINVAL. */
+int rmsgpack_read_buf(
+        const void * buf,
+        size_t size,
+        size_t * offset,
+        struct rmsgpack_read_callbacks * callbacks,
+        void * data
+);
+
 #endif
 
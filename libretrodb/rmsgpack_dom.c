@@ -15,8 +15,58 @@ struct dom_reader_state
 {
 	int i;
 	struct rmsgpack_dom_value *stack[MAX_DEPTH];
+	/* Copy strings and binaries handed out by the reader. */
+	int copy;
+	/* Allocate maps and arrays from here instead of the heap. */
+	struct rmsgpack_dom_scratch *scratch;
+	int scratch_full;
 };
 
+static void *dom_reader_state_alloc(struct dom_reader_state *s,
+      size_t count, size_t size)
+{
+   void *ptr;
+   struct rmsgpack_dom_scratch *scratch = s->scratch;
+
+   if (!scratch)
+      return calloc(count, size);
+
+   if (size && count > (scratch->size - scratch->used) / size)
+   {
+      s->scratch_full = 1;
+      return NULL;
+   }
+
+   size = (count * size + 7) & ~(size_t)7;
+
+   if (size > scratch->size - scratch->used)
+   {
+      s->scratch_full = 1;
+      return NULL;
+   }
+
+   ptr = scratch->data + scratch->used;
+   scratch->used += size;
+   return ptr;
+}
+
+static char *dom_reader_state_buff(struct dom_reader_state *s,
+      char *value, uint32_t len)
+{
+   char *buff;
+
+   if (!s->copy)
+      return value;
+
+   buff = (char*)malloc(len + 1);
+   if (!buff)
+      return NULL;
+
+   memcpy(buff, value, len);
+   buff[len] = '\0';
+   return buff;
+}
+
 static struct rmsgpack_dom_value *dom_reader_state_pop(
       struct dom_reader_state *s)
 {
@@ -85,8 +135,8 @@ static int dom_read_string(char *value, uint32_t len, void *data)
 
    v->type = RDT_STRING;
    v->string.len = len;
-   v->string.buff = value;
-   return 0;
+   v->string.buff = dom_reader_state_buff(dom_state, value, len);
+   return v->string.buff ? 0 : -ENOMEM;
 }
 
 static int dom_read_bin(void *value, uint32_t len, void *data)
@@ -97,8 +147,8 @@ static int dom_read_bin(void *value, uint32_t len, void *data)
    
    v->type = RDT_BINARY;
    v->binary.len = len;
-   v->binary.buff = (char *)value;
-   return 0;
+   v->binary.buff = dom_reader_state_buff(dom_state, (char*)value, len);
+   return v->binary.buff ? 0 : -ENOMEM;
 }
 
 static int dom_read_map_start(uint32_t len, void *data)
@@ -109,15 +159,21 @@ static int dom_read_map_start(uint32_t len, void *data)
    struct rmsgpack_dom_value *v = dom_reader_state_pop(dom_state);
 
    v->type = RDT_MAP;
-   v->map.len = len;
+   v->map.len = 0;
    v->map.items = NULL;
 
-   items = (struct rmsgpack_dom_pair *)calloc(len,
-         sizeof(struct rmsgpack_dom_pair));
+   /* Every pair is pushed below, so a count the stack cannot hold
+    * fails here instead of after a huge allocation. */
+   if (len > (MAX_DEPTH - 1 - dom_state->i) / 2)
+      return -ENOMEM;
+
+   items = (struct rmsgpack_dom_pair *)dom_reader_state_alloc(dom_state,
+         len, sizeof(struct rmsgpack_dom_pair));
 
    if (!items)
       return -ENOMEM;
 
+   v->map.len = len;
    v->map.items = items;
 
    for (i = 0; i < len; i++)
@@ -139,14 +195,19 @@ static int dom_read_array_start(uint32_t len, void *data)
 	struct rmsgpack_dom_value *items   = NULL;
 
 	v->type = RDT_ARRAY;
-	v->array.len = len;
+	v->array.len = 0;
 	v->array.items = NULL;
 
-	items = (struct rmsgpack_dom_value *)calloc(len, sizeof(struct rmsgpack_dom_pair));
+	if (len > MAX_DEPTH - 1 - dom_state->i)
+		return -ENOMEM;
+
+	items = (struct rmsgpack_dom_value *)dom_reader_state_alloc(dom_state,
+         len, sizeof(struct rmsgpack_dom_value));
 
 	if (!items)
 		return -ENOMEM;
 
+	v->array.len = len;
 	v->array.items = items;
 
 	for (i = 0; i < len; i++)
@@ -397,6 +458,10 @@ int rmsgpack_dom_read(int fd, struct rmsgpack_dom_value *out)
 
    s.i        = 0;
    s.stack[0] = out;
+   s.copy     = 0;
+   s.scratch  = NULL;
+   s.scratch_full = 0;
+   out->type  = RDT_NULL;
 
    rv = rmsgpack_read(fd, &dom_reader_callbacks, &s);
 
@@ -406,6 +471,83 @@ int rmsgpack_dom_read(int fd, struct rmsgpack_dom_value *out)
    return rv;
 }
 
+int rmsgpack_dom_read_buf(const void *buf, size_t size, size_t *offset,
+      struct rmsgpack_dom_value *out)
+{
+   struct dom_reader_state s;
+   int rv = 0;
+
+   s.i        = 0;
+   s.stack[0] = out;
+   s.copy     = 1;
+   s.scratch  = NULL;
+   s.scratch_full = 0;
+   out->type  = RDT_NULL;
+
+   rv = rmsgpack_read_buf(buf, size, offset, &dom_reader_callbacks, &s);
+
+   if (rv < 0)
+      rmsgpack_dom_value_free(out);
+
+   return rv;
+}
+
+void rmsgpack_dom_scratch_free(struct rmsgpack_dom_scratch *scratch)
+{
+   free(scratch->data);
+   scratch->data = NULL;
+   scratch->size = 0;
+   scratch->used = 0;
+}
+
+int rmsgpack_dom_read_view(const void *buf, size_t size, size_t *offset,
+      struct rmsgpack_dom_scratch *scratch, struct rmsgpack_dom_value *out)
+{
+   struct dom_reader_state s;
+   size_t start = *offset;
+   int rv       = 0;
+
+   for (;;)
+   {
+      s.i            = 0;
+      s.stack[0]     = out;
+      s.copy         = 0;
+      s.scratch      = scratch;
+      s.scratch_full = 0;
+      scratch->used  = 0;
+      out->type      = RDT_NULL;
+
+      rv = rmsgpack_read_buf(buf, size, offset, &dom_reader_callbacks, &s);
+
+      /* Ran out of scratch space, grow it and decode again. */
+      if (rv == -ENOMEM && s.scratch_full)
+      {
+         size_t new_size = scratch->size ? scratch->size * 2 : 4096;
+         char *data;
+
+         /* Every value takes at least one byte of input. */
+         if (scratch->size > (size - start) *
+               sizeof(struct rmsgpack_dom_pair) + 4096)
+            break;
+
+         data = (char*)realloc(scratch->data, new_size);
+         if (!data)
+            break;
+
+         scratch->data = data;
+         scratch->size = new_size;
+         *offset       = start;
+         continue;
+      }
+      break;
+   }
+
+   if (rv < 0)
+      out->type = RDT_NULL;
+
+   return rv;
+}
+
 int rmsgpack_dom_read_into(int fd, ...)
 {
    va_list ap;
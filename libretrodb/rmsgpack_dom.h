@@ -1,6 +1,7 @@
 #ifndef __RARCHDB_MSGPACK_DOM_H__
 #define __RARCHDB_MSGPACK_DOM_H__
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -71,6 +72,37 @@ int rmsgpack_dom_write(
 
 int rmsgpack_dom_read_into(int fd, ...);
 
+/* Backing store for the maps and arrays of values decoded by
+ * rmsgpack_dom_read_view(). Zero-initialize before first use. */
+struct rmsgpack_dom_scratch {
+	char * data;
+	size_t size;
+	size_t used;
+};
+
+void rmsgpack_dom_scratch_free(struct rmsgpack_dom_scratch * scratch);
+
+/* Decodes the value at *offset in @buf into a newly allocated DOM,
+ * like rmsgpack_dom_read(), and advances *offset past it. */
+int rmsgpack_dom_read_buf(
+        const void * buf,
+        size_t size,
+        size_t * offset,
+        struct rmsgpack_dom_value * out
+);
+
+/* Decodes the value at *offset in @buf without copying: strings and
+ * binaries point into @buf and are NOT NUL-terminated, maps and arrays
+ * live in @scratch. The result stays valid until @scratch is reused
+ * and must not be passed to rmsgpack_dom_value_free(). */
+int rmsgpack_dom_read_view(
+        const void * buf,
+        size_t size,
+        size_t * offset,
+        struct rmsgpack_dom_scratch * scratch,
+        struct rmsgpack_dom_value * out
+);
+
 #ifdef __cplusplus
 }
 #endif
@@ -54,22 +54,32 @@ int menu_entries_push_query(libretrodb_t *db,
    unsigned i;
    struct rmsgpack_dom_value item;
     
-   while (libretrodb_cursor_read_item(cur, &item) == 0)
+   while (libretrodb_cursor_read_item_view(cur, &item) == 0)
    {
       if (item.type != RDT_MAP)
          continue;
         
       for (i = 0; i < item.map.len; i++)
       {
+         char name[PATH_MAX_LENGTH];
+         size_t len;
          struct rmsgpack_dom_value *key = &item.map.items[i].key;
          struct rmsgpack_dom_value *val = &item.map.items[i].value;
-            
-         if (!strcmp(key->string.buff, "name"))
-         {
-            menu_list_push(list, val->string.buff, db->path,
-            MENU_FILE_RDB_ENTRY, 0);
+
+         if (key->type != RDT_STRING || key->string.len != 4
+               || memcmp(key->string.buff, "name", 4))
+            continue;
+         if (val->type != RDT_STRING)
             break;
-         }
+
+         /* Item strings are not NUL-terminated. */
+         len = val->string.len < sizeof(name) ?
+            val->string.len : sizeof(name) - 1;
+         memcpy(name, val->string.buff, len);
+         name[len] = '\0';
+         menu_list_push(list, name, db->path,
+               MENU_FILE_RDB_ENTRY, 0);
+         break;
       }
    }
     
@@ -169,6 +179,8 @@ int menu_entries_push_cores_list(file_list_t *list, core_info_t *info,
 
    if (!push_databases_enable)
       return 0;
+
+   core_info_expand(info);
    if (!info->databases_list)
       return 0;
 
@@ -618,7 +618,7 @@ static int deferred_push_core_information(void *data, void *userdata,
    info = (core_info_t*)g_extern.core_info_current;
    menu_list_clear(list);
 
-   if (info->data)
+   if (info->has_info)
    {
       char tmp[PATH_MAX_LENGTH];
 
@@ -1454,14 +1454,11 @@ static int action_ok_save_state(const char *path,
  * call each other. */
 static char core_updater_path[PATH_MAX_LENGTH];
 
-static bool zlib_extract_core_callback(const char *name, const char *valid_exts,
-      const uint8_t *cdata, unsigned cmode, uint32_t csize, uint32_t size,
-      uint32_t crc32, void *userdata)
+static bool zlib_extract_core_callback(const char *name, char *path,
+      size_t path_size, void *userdata)
 {
-   char path[PATH_MAX_LENGTH];
-
    /* Make directory */
-   fill_pathname_join(path, (const char*)userdata, name, sizeof(path));
+   fill_pathname_join(path, (const char*)userdata, name, path_size);
    path_basedir(path);
 
    if (!path_mkdir(path))
@@ -1472,21 +1469,14 @@ static bool zlib_extract_core_callback(const char *name, const char *valid_exts,
 
    /* Ignore directories. */
    if (name[strlen(name) - 1] == '/' || name[strlen(name) - 1] == '\\')
+   {
+      *path = '\0';
       return true;
+   }
 
-   fill_pathname_join(path, (const char*)userdata, name, sizeof(path));
+   fill_pathname_join(path, (const char*)userdata, name, path_size);
 
-   RARCH_LOG("path is: %s, CRC32: 0x%x\n", path, crc32);
-
-   switch (cmode)
-   {
-      case 0: /* Uncompressed */
-         write_file(path, cdata, size);
-         break;
-      case 8: /* Deflate */
-         zlib_inflate_data_to_file(path, valid_exts, cdata, csize, size, crc32);
-         break;
-   }
+   RARCH_LOG("path is: %s\n", path);
 
    return true;
 }
@@ -1526,8 +1516,7 @@ static int cb_core_updater_download(void *data_, size_t len)
 
    if (!strcasecmp(file_ext,"zip"))
    {
-      if (!zlib_parse_file(output_path, NULL, zlib_extract_core_callback,
-
+      if (!zlib_extract_archive(output_path, zlib_extract_core_callback,
                (void*)g_settings.libretro_directory))
          RARCH_LOG("Could not process ZIP file.\n");
    }
@@ -2577,7 +2566,7 @@ static int deferred_push_core_information(void *data, void *userdata,
    info = (core_info_t*)g_extern.core_info_current;
    menu_list_clear(list);
 
-   if (info->data)
+   if (info->has_info)
    {
       char tmp[PATH_MAX_LENGTH];
 
@@ -21,6 +21,38 @@
 #include <string.h>
 #include "general.h"
 #include "dynamic.h"
+#include "content.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#if defined(_WIN32) && !defined(_XBOX)
+#include <io.h>
+#elif !defined(RARCH_CONSOLE)
+#include <unistd.h>
+#endif
+
+/* BSV2 record layout, all values little-endian:
+ *
+ * Frame:    uint16 count, int16 input[count]
+ * Keyframe: uint16 BSV2_KEYFRAME, uint32 frame, uint32 flags,
+ *           uint32 size, uint8 state[size]
+ *
+ * On close, the index trailer is appended:
+ *           { uint32 frame, uint32 offset_lo, uint32 offset_hi }[count],
+ *           uint32 BSV2_INDEX_MAGIC, uint32 count, uint32 frames
+ *
+ * A file without trailer is indexed by scanning it. */
+#define BSV2_KEYFRAME 0xffff
+#define BSV2_MAX_INPUTS 0xfffe
+#define BSV2_FLAG_ZLIB 1
+
+struct bsv_keyframe
+{
+   uint32_t frame;
+   uint64_t offset;
+};
 
 struct bsv_movie
 {
@@ -40,11 +72,320 @@ struct bsv_movie
    bool playback;
    bool first_rewind;
    bool did_rewind;
+
+   /* BSV2 only. */
+   bool v2;
+   bool eof;
+   uint32_t frame;
+   uint64_t stream_end;
+
+   int16_t *input;
+   size_t input_count;
+   size_t input_ptr;
+   size_t input_size;
+
+   struct bsv_keyframe *keyframes;
+   size_t keyframes_count;
+   size_t keyframes_size;
+
+   /* Scratch buffer for (de)compressing keyframes. */
+   uint8_t *keyframe_buf;
+   size_t keyframe_buf_size;
 };
 
+static bool bsv_read16(FILE *file, uint16_t *val)
+{
+   if (fread(val, sizeof(*val), 1, file) != 1)
+      return false;
+   *val = swap_if_big16(*val);
+   return true;
+}
+
+static bool bsv_read32(FILE *file, uint32_t *val)
+{
+   if (fread(val, sizeof(*val), 1, file) != 1)
+      return false;
+   *val = swap_if_big32(*val);
+   return true;
+}
+
+static void bsv_write16(FILE *file, uint16_t val)
+{
+   val = swap_if_big16(val);
+   fwrite(&val, sizeof(val), 1, file);
+}
+
+static void bsv_write32(FILE *file, uint32_t val)
+{
+   val = swap_if_big32(val);
+   fwrite(&val, sizeof(val), 1, file);
+}
+
+static bool bsv_movie_push_keyframe(bsv_movie_t *handle,
+      uint32_t frame, uint64_t offset)
+{
+   if (handle->keyframes_count >= handle->keyframes_size)
+   {
+      size_t new_size = handle->keyframes_size * 2 + 16;
+      struct bsv_keyframe *keyframes = (struct bsv_keyframe*)
+         realloc(handle->keyframes, new_size * sizeof(*keyframes));
+
+      if (!keyframes)
+         return false;
+
+      handle->keyframes      = keyframes;
+      handle->keyframes_size = new_size;
+   }
+
+   handle->keyframes[handle->keyframes_count].frame  = frame;
+   handle->keyframes[handle->keyframes_count].offset = offset;
+   handle->keyframes_count++;
+   return true;
+}
+
+static bool bsv_movie_init_v2(bsv_movie_t *handle)
+{
+   handle->v2                = true;
+   handle->keyframe_buf_size = handle->state_size;
+#ifdef HAVE_ZLIB
+   handle->keyframe_buf_size = compressBound(handle->state_size);
+#endif
+
+   if (!handle->keyframe_buf_size)
+      return true;
+
+   handle->keyframe_buf = (uint8_t*)malloc(handle->keyframe_buf_size);
+   return handle->keyframe_buf != NULL;
+}
+
+/**
+ * bsv_movie_read_index:
+ * @handle             : movie handle
+ *
+ * Reads the keyframe index trailer. 
+ *
+ * Returns: true (1) if the file has a valid trailer, otherwise false (0).
+ **/
+static bool bsv_movie_read_index(bsv_movie_t *handle)
+{
+   uint32_t i, magic, count, frames;
+   long end;
+
+   if (fseek(handle->file, -3 * (long)sizeof(uint32_t), SEEK_END) != 0)
+      return false;
+
+   end = ftell(handle->file);
+
+   if (!bsv_read32(handle->file, &magic) || magic != BSV2_INDEX_MAGIC
+         || !bsv_read32(handle->file, &count)
+         || !bsv_read32(handle->file, &frames))
+      return false;
+
+   if ((uint64_t)count * 3 * sizeof(uint32_t) >
+         (uint64_t)(end - handle->min_file_pos))
+      return false;
+
+   handle->stream_end = end - (uint64_t)count * 3 * sizeof(uint32_t);
+   fseek(handle->file, handle->stream_end, SEEK_SET);
+
+   for (i = 0; i < count; i++)
+   {
+      uint32_t frame, lo, hi;
+
+      if (!bsv_read32(handle->file, &frame)
+            || !bsv_read32(handle->file, &lo)
+            || !bsv_read32(handle->file, &hi))
+         return false;
+
+      if (!bsv_movie_push_keyframe(handle, frame,
+               ((uint64_t)hi << 32) | lo))
+         return false;
+   }
+
+   RARCH_LOG("BSV2: %u frames, %u keyframes.\n", frames, count);
+   return true;
+}
+
+/**
+ * bsv_movie_scan_index:
+ * @handle             : movie handle
+ *
+ * Builds the keyframe index by walking all records, for 
+ * recordings which were not closed properly.
+ **/
+static void bsv_movie_scan_index(bsv_movie_t *handle)
+{
+   uint32_t frames = 0;
+
+   handle->keyframes_count = 0;
+   fseek(handle->file, handle->min_file_pos, SEEK_SET);
+   handle->stream_end = handle->min_file_pos;
+
+   for (;;)
+   {
+      uint16_t count;
+      long pos = ftell(handle->file);
+
+      if (!bsv_read16(handle->file, &count))
+         break;
+
+      if (count == BSV2_KEYFRAME)
+      {
+         uint32_t frame, flags, size;
+
+         if (!bsv_read32(handle->file, &frame)
+               || !bsv_read32(handle->file, &flags)
+               || !bsv_read32(handle->file, &size)
+               || fseek(handle->file, size, SEEK_CUR) != 0)
+            break;
+
+         if (!bsv_movie_push_keyframe(handle, frame, pos))
+            break;
+      }
+      else
+      {
+         if (fseek(handle->file, count * sizeof(int16_t), SEEK_CUR) != 0)
+            break;
+         frames++;
+      }
+
+      handle->stream_end = ftell(handle->file);
+   }
+
+   /* fseek past the end succeeds, don't trust the last record. */
+   fseek(handle->file, 0, SEEK_END);
+   if ((uint64_t)ftell(handle->file) < handle->stream_end)
+      handle->stream_end = ftell(handle->file);
+
+   RARCH_WARN("BSV2 file has no index, scanned %u frames, %u keyframes.\n",
+         frames, (unsigned)handle->keyframes_count);
+}
+
+static void bsv_movie_write_index(bsv_movie_t *handle)
+{
+   size_t i;
+   long pos;
+
+   for (i = 0; i < handle->keyframes_count; i++)
+   {
+      bsv_write32(handle->file, handle->keyframes[i].frame);
+      bsv_write32(handle->file, (uint32_t)handle->keyframes[i].offset);
+      bsv_write32(handle->file, (uint32_t)(handle->keyframes[i].offset >> 32));
+   }
+
+   bsv_write32(handle->file, BSV2_INDEX_MAGIC);
+   bsv_write32(handle->file, handle->keyframes_count);
+   bsv_write32(handle->file, handle->frame);
+
+   /* Get rid of data recorded before a rewind. */
+   fflush(handle->file);
+   pos = ftell(handle->file);
+#if defined(_WIN32) && !defined(_XBOX)
+   _chsize(_fileno(handle->file), pos);
+#elif !defined(RARCH_CONSOLE)
+   if (ftruncate(fileno(handle->file), pos) != 0)
+      RARCH_WARN("Failed to truncate BSV2 file.\n");
+#endif
+}
+
+static void bsv_movie_write_keyframe(bsv_movie_t *handle)
+{
+   const uint8_t *data = handle->state;
+   uint32_t flags      = 0;
+   uint32_t size       = handle->state_size;
+   long pos            = ftell(handle->file);
+
+   if (!handle->state_size || !handle->state || !handle->keyframe_buf)
+      return;
+
+   if (!pretro_serialize(handle->state, handle->state_size))
+      return;
+
+#ifdef HAVE_ZLIB
+   {
+      uLongf compressed_size = handle->keyframe_buf_size;
+
+      /* Keep the raw state if it doesn't shrink. */
+      if (compress2(handle->keyframe_buf, &compressed_size,
+               handle->state, handle->state_size, Z_BEST_SPEED) == Z_OK
+            && compressed_size < handle->state_size)
+      {
+         data  = handle->keyframe_buf;
+         flags = BSV2_FLAG_ZLIB;
+         size  = compressed_size;
+      }
+   }
+#endif
+
+   bsv_write16(handle->file, BSV2_KEYFRAME);
+   bsv_write32(handle->file, handle->frame);
+   bsv_write32(handle->file, flags);
+   bsv_write32(handle->file, size);
+   if (fwrite(data, 1, size, handle->file) != size)
+   {
+      RARCH_ERR("Couldn't write BSV2 keyframe of frame %u.\n", handle->frame);
+      return;
+   }
+
+   bsv_movie_push_keyframe(handle, handle->frame, pos);
+}
+
+/**
+ * bsv_movie_load_keyframe:
+ * @handle             : movie handle
+ * @keyframe           : keyframe to load
+ *
+ * Loads the state of @keyframe into the core and positions
+ * the file at the frame record following it.
+ *
+ * Returns: true (1) if successful, otherwise false (0).
+ **/
+static bool bsv_movie_load_keyframe(bsv_movie_t *handle,
+      const struct bsv_keyframe *keyframe)
+{
+   uint16_t marker;
+   uint32_t frame, flags, size;
+
+   if (fseek(handle->file, keyframe->offset, SEEK_SET) != 0
+         || !bsv_read16(handle->file, &marker) || marker != BSV2_KEYFRAME
+         || !bsv_read32(handle->file, &frame)
+         || !bsv_read32(handle->file, &flags)
+         || !bsv_read32(handle->file, &size)
+         || size > handle->keyframe_buf_size
+         || fread(handle->keyframe_buf, 1, size, handle->file) != size)
+   {
+      RARCH_ERR("Couldn't read BSV2 keyframe of frame %u.\n", keyframe->frame);
+      return false;
+   }
+
+   if (flags & BSV2_FLAG_ZLIB)
+   {
+#ifdef HAVE_ZLIB
+      uLongf state_size = handle->state_size;
+      uint8_t *state    = (uint8_t*)malloc(handle->state_size);
+      bool ret          = false;
+
+      if (state && uncompress(state, &state_size,
+               handle->keyframe_buf, size) == Z_OK
+            && state_size == handle->state_size)
+         ret = pretro_unserialize(state, handle->state_size);
+
+      free(state);
+      return ret;
+#else
+      RARCH_ERR("BSV2 keyframe is compressed, but zlib support is missing.\n");
+      return false;
+#endif
+   }
+
+   return size == handle->state_size
+      && pretro_unserialize(handle->keyframe_buf, size);
+}
+
 static bool init_playback(bsv_movie_t *handle, const char *path)
 {
    uint32_t state_size;
+   uint32_t magic;
    uint32_t header[4] = {0};
 
    handle->playback = true;
@@ -63,14 +404,17 @@ static bool init_playback(bsv_movie_t *handle, const char *path)
 
    /* Compatibility with old implementation that
     * used incorrect documentation. */
-   if (swap_if_little32(header[MAGIC_INDEX]) != BSV_MAGIC
-         && swap_if_big32(header[MAGIC_INDEX]) != BSV_MAGIC)
+   magic = swap_if_little32(header[MAGIC_INDEX]);
+   if (magic != BSV_MAGIC && magic != BSV2_MAGIC)
+      magic = swap_if_big32(header[MAGIC_INDEX]);
+
+   if (magic != BSV_MAGIC && magic != BSV2_MAGIC)
    {
-      RARCH_ERR("Movie file is not a valid BSV1 file.\n");
+      RARCH_ERR("Movie file is not a valid BSV1 or BSV2 file.\n");
       return false;
    }
 
-   if (swap_if_big32(header[CRC_INDEX]) != g_extern.content_crc)
+   if (swap_if_big32(header[CRC_INDEX]) != content_get_crc())
       RARCH_WARN("CRC32 checksum mismatch between content file and saved content checksum in replay file header; replay highly likely to desync on playback.\n");
 
    state_size = swap_if_big32(header[STATE_SIZE_INDEX]);
@@ -96,6 +440,17 @@ static bool init_playback(bsv_movie_t *handle, const char *path)
 
    handle->min_file_pos = sizeof(header) + state_size;
 
+   if (magic == BSV2_MAGIC)
+   {
+      if (!bsv_movie_init_v2(handle))
+         return false;
+
+      if (!bsv_movie_read_index(handle))
+         bsv_movie_scan_index(handle);
+
+      fseek(handle->file, handle->min_file_pos, SEEK_SET);
+   }
+
    return true;
 }
 
@@ -113,10 +468,10 @@ static bool init_record(bsv_movie_t *handle, const char *path)
 
 
    /* This value is supposed to show up as
-    * BSV1 in a HEX editor, big-endian. */
-   header[MAGIC_INDEX] = swap_if_little32(BSV_MAGIC);
+    * BSV2 in a HEX editor, big-endian. */
+   header[MAGIC_INDEX] = swap_if_little32(BSV2_MAGIC);
 
-   header[CRC_INDEX] = swap_if_big32(g_extern.content_crc);
+   header[CRC_INDEX] = swap_if_big32(content_get_crc());
 
    state_size = pretro_serialize_size();
 
@@ -136,7 +491,7 @@ static bool init_record(bsv_movie_t *handle, const char *path)
       fwrite(handle->state, 1, state_size, handle->file);
    }
 
-   return true;
+   return bsv_movie_init_v2(handle);
 }
 
 void bsv_movie_free(bsv_movie_t *handle)
@@ -145,14 +500,33 @@ void bsv_movie_free(bsv_movie_t *handle)
       return;
 
    if (handle->file)
+   {
+      if (handle->v2 && !handle->playback)
+         bsv_movie_write_index(handle);
       fclose(handle->file);
+   }
    free(handle->state);
    free(handle->frame_pos);
+   free(handle->input);
+   free(handle->keyframes);
+   free(handle->keyframe_buf);
    free(handle);
 }
 
 bool bsv_movie_get_input(bsv_movie_t *handle, int16_t *input)
 {
+   if (handle->v2)
+   {
+      if (handle->eof)
+         return false;
+
+      /* Core polls more input than was recorded. Likely desynced. */
+      *input = 0;
+      if (handle->input_ptr < handle->input_count)
+         *input = handle->input[handle->input_ptr++];
+      return true;
+   }
+
    if (fread(input, sizeof(int16_t), 1, handle->file) != 1)
       return false;
 
@@ -162,6 +536,30 @@ bool bsv_movie_get_input(bsv_movie_t *handle, int16_t *input)
 
 void bsv_movie_set_input(bsv_movie_t *handle, int16_t input)
 {
+   if (handle->v2)
+   {
+      if (handle->input_count >= handle->input_size)
+      {
+         size_t new_size = handle->input_size * 2 + 64;
+         int16_t *buf    = NULL;
+
+         if (new_size > BSV2_MAX_INPUTS)
+            new_size = BSV2_MAX_INPUTS;
+         if (handle->input_count >= new_size)
+            return;
+
+         buf = (int16_t*)realloc(handle->input, new_size * sizeof(int16_t));
+         if (!buf)
+            return;
+
+         handle->input      = buf;
+         handle->input_size = new_size;
+      }
+
+      handle->input[handle->input_count++] = input;
+      return;
+   }
+
    input = swap_if_big16(input);
    fwrite(&input, sizeof(int16_t), 1, handle->file);
 }
@@ -195,11 +593,88 @@ error:
    return NULL;
 }
 
+/**
+ * bsv_movie_read_frame:
+ * @handle             : movie handle
+ *
+ * Reads input recorded for the next frame, skipping keyframes.
+ **/
+static void bsv_movie_read_frame(bsv_movie_t *handle)
+{
+   uint16_t count;
+
+   handle->input_count = 0;
+   handle->input_ptr   = 0;
+
+   for (;;)
+   {
+      if ((uint64_t)ftell(handle->file) >= handle->stream_end
+            || !bsv_read16(handle->file, &count))
+      {
+         handle->eof = true;
+         return;
+      }
+
+      if (count != BSV2_KEYFRAME)
+         break;
+
+      {
+         uint32_t frame, flags, size;
+         if (!bsv_read32(handle->file, &frame)
+               || !bsv_read32(handle->file, &flags)
+               || !bsv_read32(handle->file, &size)
+               || fseek(handle->file, size, SEEK_CUR) != 0)
+         {
+            handle->eof = true;
+            return;
+         }
+      }
+   }
+
+   if (count > handle->input_size)
+   {
+      int16_t *buf = (int16_t*)realloc(handle->input, count * sizeof(int16_t));
+      if (!buf)
+      {
+         handle->eof = true;
+         return;
+      }
+
+      handle->input      = buf;
+      handle->input_size = count;
+   }
+
+   if (fread(handle->input, sizeof(int16_t), count, handle->file) != count)
+   {
+      handle->eof = true;
+      return;
+   }
+
+   for (handle->input_count = 0; handle->input_count < count;
+         handle->input_count++)
+      handle->input[handle->input_count] =
+         swap_if_big16(handle->input[handle->input_count]);
+}
+
 void bsv_movie_set_frame_start(bsv_movie_t *handle)
 {
    if (!handle)
       return;
+
+   if (handle->v2 && !handle->playback)
+   {
+      if (handle->frame && handle->frame % BSV2_KEYFRAME_INTERVAL == 0
+            && (!handle->keyframes_count || handle->keyframes[
+               handle->keyframes_count - 1].frame < handle->frame))
+         bsv_movie_write_keyframe(handle);
+
+      handle->input_count = 0;
+   }
+
    handle->frame_pos[handle->frame_ptr] = ftell(handle->file);
+
+   if (handle->v2 && handle->playback)
+      bsv_movie_read_frame(handle);
 }
 
 void bsv_movie_set_frame_end(bsv_movie_t *handle)
@@ -207,6 +682,16 @@ void bsv_movie_set_frame_end(bsv_movie_t *handle)
    if (!handle)
       return;
 
+   if (handle->v2 && !handle->playback)
+   {
+      size_t i;
+
+      bsv_write16(handle->file, handle->input_count);
+      for (i = 0; i < handle->input_count; i++)
+         bsv_write16(handle->file, handle->input[i]);
+   }
+
+   handle->frame++;
    handle->frame_ptr = (handle->frame_ptr + 1) & handle->frame_mask;
 
    handle->first_rewind = !handle->did_rewind;
@@ -221,24 +706,28 @@ void bsv_movie_frame_rewind(bsv_movie_t *handle)
    {
       /* If we're at the beginning... */
       handle->frame_ptr = 0;
+      handle->frame     = 0;
       fseek(handle->file, handle->min_file_pos, SEEK_SET);
    }
    else
    {
+      unsigned frames = handle->first_rewind ? 1 : 2;
+
       /* First time rewind is performed, the old frame is simply replayed.
        * However, playing back that frame caused us to read data, and push
        * data to the ring buffer.
        *
        * Sucessively rewinding frames, we need to rewind past the read data,
        * plus another. */
-      handle->frame_ptr = (handle->frame_ptr -
-            (handle->first_rewind ? 1 : 2)) & handle->frame_mask;
+      handle->frame_ptr = (handle->frame_ptr - frames) & handle->frame_mask;
+      handle->frame     = handle->frame > frames ? handle->frame - frames : 0;
       fseek(handle->file, handle->frame_pos[handle->frame_ptr], SEEK_SET);
    }
 
    if (ftell(handle->file) <= (long)handle->min_file_pos)
    {
       /* We rewound past the beginning. */
+      handle->frame = 0;
 
       if (!handle->playback)
       {
@@ -251,5 +740,111 @@ void bsv_movie_frame_rewind(bsv_movie_t *handle)
       else
          fseek(handle->file, handle->min_file_pos, SEEK_SET);
    }
+
+   handle->eof = false;
+
+   /* Keyframes after this point will be recorded again. */
+   if (!handle->playback)
+   {
+      long pos = ftell(handle->file);
+      while (handle->keyframes_count && handle->keyframes[
+            handle->keyframes_count - 1].offset >= (uint64_t)pos)
+         handle->keyframes_count--;
+   }
+}
+
+uint32_t bsv_movie_get_frame(bsv_movie_t *handle)
+{
+   return handle ? handle->frame : 0;
+}
+
+static void bsv_movie_video_dummy(const void *data, unsigned width,
+      unsigned height, size_t pitch)
+{
 }
 
+static void bsv_movie_audio_dummy(int16_t left, int16_t right)
+{
+}
+
+static size_t bsv_movie_audio_batch_dummy(const int16_t *data,
+      size_t frames)
+{
+   return frames;
+}
+
+/**
+ * bsv_movie_seek:
+ * @handle             : movie handle, must be playing back a BSV2 file.
+ * @frame              : frame to seek to.
+ *
+ * Loads the closest keyframe preceding @frame and replays
+ * recorded input up to it without video or audio output.
+ *
+ * Returns: true (1) if successful, otherwise false (0).
+ **/
+bool bsv_movie_seek(bsv_movie_t *handle, uint32_t frame)
+{
+   size_t lo = 0, hi;
+   const struct bsv_keyframe *keyframe = NULL;
+
+   if (!handle || !handle->v2 || !handle->playback)
+      return false;
+
+   /* Last keyframe at or before frame. */
+   hi = handle->keyframes_count;
+   while (lo < hi)
+   {
+      size_t mid = lo + (hi - lo) / 2;
+      if (handle->keyframes[mid].frame <= frame)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+
+   if (lo)
+      keyframe = &handle->keyframes[lo - 1];
+
+   /* Going forward from where we are is cheaper. */
+   if (handle->frame <= frame && !handle->eof
+         && (!keyframe || keyframe->frame <= handle->frame))
+      keyframe = NULL;
+   else if (keyframe)
+   {
+      if (!bsv_movie_load_keyframe(handle, keyframe))
+         return false;
+      handle->frame = keyframe->frame;
+   }
+   else
+   {
+      if (handle->state_size && !pretro_unserialize(handle->state,
+               handle->state_size))
+         return false;
+      fseek(handle->file, handle->min_file_pos, SEEK_SET);
+      handle->frame = 0;
+   }
+
+   memset(handle->frame_pos, 0, (handle->frame_mask + 1) * sizeof(size_t));
+   handle->frame_ptr    = 0;
+   handle->frame_pos[0] = ftell(handle->file);
+   handle->eof          = false;
+
+   pretro_set_video_refresh(bsv_movie_video_dummy);
+   pretro_set_audio_sample(bsv_movie_audio_dummy);
+   pretro_set_audio_sample_batch(bsv_movie_audio_batch_dummy);
+
+   while (handle->frame < frame)
+   {
+      bsv_movie_set_frame_start(handle);
+      if (handle->eof)
+         break;
+      pretro_run();
+      bsv_movie_set_frame_end(handle);
+   }
+
+   pretro_set_video_refresh(driver.retro_ctx.frame_cb);
+   pretro_set_audio_sample(driver.retro_ctx.sample_cb);
+   pretro_set_audio_sample_batch(driver.retro_ctx.sample_batch_cb);
+
+   return handle->frame == frame;
+}
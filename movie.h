@@ -26,6 +26,13 @@ extern "C" {
 #include <boolean.h>
 
 #define BSV_MAGIC 0x42535631
+/* BSV2: per-frame input records, periodic savestate keyframes
+ * and a keyframe index trailer. */
+#define BSV2_MAGIC 0x42535632
+#define BSV2_INDEX_MAGIC 0x42535649
+
+/* Frames between embedded keyframes in BSV2 recordings. */
+#define BSV2_KEYFRAME_INTERVAL 600
 
 #define MAGIC_INDEX 0
 #define SERIALIZER_INDEX 1
@@ -55,6 +62,21 @@ void bsv_movie_set_frame_end(bsv_movie_t *handle);
 
 void bsv_movie_frame_rewind(bsv_movie_t *handle);
 
+/**
+ * bsv_movie_seek:
+ * @handle             : movie handle, must be playing back a BSV2 file.
+ * @frame              : frame to seek to.
+ *
+ * Loads the closest keyframe preceding @frame and replays
+ * recorded input up to it without video or audio output.
+ *
+ * Returns: true (1) if successful, otherwise false (0).
+ **/
+bool bsv_movie_seek(bsv_movie_t *handle, uint32_t frame);
+
+/* Current frame of recording or playback. */
+uint32_t bsv_movie_get_frame(bsv_movie_t *handle);
+
 void bsv_movie_free(bsv_movie_t *handle);
 
 #ifdef __cplusplus
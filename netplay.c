@@ -23,7 +23,13 @@
 #include "general.h"
 #include "autosave.h"
 #include "dynamic.h"
+#include "content.h"
+#include "hash.h"
+#include "performance.h"
 #include <queues/message_queue.h>
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
 #include <stdlib.h>
 #include <string.h>
 
@@ -45,6 +51,61 @@ struct delta_frame
 #define NETPLAY_CMD_ACK 0
 #define NETPLAY_CMD_NAK 1
 #define NETPLAY_CMD_FLIP_PLAYERS 2
+/* Not acknowledged. Can be pushed by the peer at any time. */
+#define NETPLAY_CMD_CRC 3
+#define NETPLAY_CMD_LOAD_SAVESTATE 4
+#define NETPLAY_CMD_PING 5
+#define NETPLAY_CMD_PONG 6
+
+#define NETPLAY_PING_INTERVAL 60
+
+/* Injected network conditions (--netplay-sim-delay/--netplay-sim-loss).
+ * Only applies to the UDP input stream. */
+#define NETPLAY_SIM_QUEUE 256
+#define NETPLAY_SIM_POLL_USEC 1000
+
+/* A confirmed state is hashed every NETPLAY_CRC_INTERVAL frames.
+ * Client sends its hashes to the host, which compares them against
+ * its own and pushes a state to the client if they differ. */
+#define NETPLAY_CRC_INTERVAL 120
+#define NETPLAY_CRC_HISTORY 8
+
+struct netplay_crc
+{
+   uint32_t frame;
+   uint32_t local;
+   uint32_t remote;
+   bool has_local;
+   bool has_remote;
+};
+
+struct netplay_sim_packet
+{
+   retro_time_t due;
+   uint32_t data[UDP_FRAME_PACKETS * 2];
+};
+
+struct netplay_stats
+{
+   /* Frames where simulated input turned out to be wrong. */
+   uint32_t mispredicted;
+   /* Frames where the prediction was confirmed. */
+   uint32_t predicted;
+   uint32_t rollbacks;
+   uint32_t rollback_frames;
+   uint32_t rollback_max;
+   retro_time_t replay_usec;
+   retro_time_t rtt_usec;
+   retro_time_t rtt_min_usec;
+   retro_time_t rtt_max_usec;
+};
+
+enum netplay_crc_job
+{
+   NETPLAY_CRC_IDLE = 0,
+   NETPLAY_CRC_PENDING,
+   NETPLAY_CRC_DONE
+};
 
 #define PREV_PTR(x) ((x) == 0 ? netplay->buffer_size - 1 : (x) - 1)
 #define NEXT_PTR(x) ((x + 1) % netplay->buffer_size)
@@ -112,6 +173,41 @@ struct netplay
     * well after flip_frame before allowing another flip. */
    bool flip;
    uint32_t flip_frame;
+
+   /* Desync detection.
+    * crc_frame is the next frame whose confirmed state will be hashed. */
+   uint32_t crc_frame;
+   struct netplay_crc crcs[NETPLAY_CRC_HISTORY];
+   /* Host: a mismatch was found, push a state after this frame. */
+   bool desync;
+
+   /* Worker hashing a copy of the state. */
+   void *crc_state;
+   uint32_t crc_job_frame;
+   uint32_t crc_job_result;
+   enum netplay_crc_job crc_job;
+#ifdef HAVE_THREADS
+   sthread_t *crc_thread;
+   slock_t *crc_lock;
+   scond_t *crc_cond;
+   bool crc_quit;
+#endif
+
+   /* Client: state received from host, applied once its frame
+    * can be replayed from. */
+   void *resync_state;
+   uint32_t resync_frame;
+   bool has_resync;
+
+   struct netplay_stats stats;
+
+   /* Injected delay and loss. */
+   retro_time_t sim_delay_usec;
+   unsigned sim_loss;
+   uint32_t sim_seed;
+   struct netplay_sim_packet *sim_queue;
+   size_t sim_queue_ptr;
+   size_t sim_queue_size;
 };
 
 /**
@@ -150,7 +246,8 @@ static bool netplay_can_poll(netplay_t *netplay)
    return netplay->can_poll;
 }
 
-static bool send_chunk(netplay_t *netplay)
+static bool send_chunk_data(netplay_t *netplay, const uint32_t *data,
+      size_t size)
 {
    const struct sockaddr *addr = NULL;
 
@@ -161,9 +258,8 @@ static bool send_chunk(netplay_t *netplay)
 
    if (addr)
    {
-      if (sendto(netplay->udp_fd, (const char*)netplay->packet_buffer,
-               sizeof(netplay->packet_buffer), 0, addr,
-               sizeof(struct sockaddr)) != sizeof(netplay->packet_buffer))
+      if (sendto(netplay->udp_fd, (const char*)data, size, 0, addr,
+               sizeof(struct sockaddr)) != (ssize_t)size)
       {
          warn_hangup();
          netplay->has_connection = false;
@@ -173,6 +269,67 @@ static bool send_chunk(netplay_t *netplay)
    return true;
 }
 
+/**
+ * netplay_sim_flush:
+ * @netplay              : pointer to netplay object
+ *
+ * Sends delayed packets which are due.
+ *
+ * Returns: true (1) if packets are still queued, otherwise false (0).
+ **/
+static bool netplay_sim_flush(netplay_t *netplay)
+{
+   retro_time_t now;
+
+   if (!netplay->sim_queue_size)
+      return false;
+
+   now = rarch_get_time_usec();
+
+   while (netplay->sim_queue_size)
+   {
+      struct netplay_sim_packet *pkt = &netplay->sim_queue[
+         netplay->sim_queue_ptr];
+
+      if (pkt->due > now)
+         return true;
+
+      if (!send_chunk_data(netplay, pkt->data, sizeof(pkt->data)))
+         return false;
+
+      netplay->sim_queue_ptr = (netplay->sim_queue_ptr + 1) % NETPLAY_SIM_QUEUE;
+      netplay->sim_queue_size--;
+   }
+
+   return false;
+}
+
+static bool send_chunk(netplay_t *netplay)
+{
+   struct netplay_sim_packet *pkt;
+
+   if (!netplay->sim_queue)
+      return send_chunk_data(netplay, netplay->packet_buffer,
+            sizeof(netplay->packet_buffer));
+
+   /* Fixed seed, so runs with the same settings drop the same packets. */
+   netplay->sim_seed = netplay->sim_seed * 1103515245 + 12345;
+   if (((netplay->sim_seed >> 16) % 100) < netplay->sim_loss)
+      return true;
+
+   if (netplay->sim_queue_size == NETPLAY_SIM_QUEUE)
+      return true;
+
+   pkt = &netplay->sim_queue[(netplay->sim_queue_ptr
+         + netplay->sim_queue_size) % NETPLAY_SIM_QUEUE];
+   pkt->due = rarch_get_time_usec() + netplay->sim_delay_usec;
+   memcpy(pkt->data, netplay->packet_buffer, sizeof(pkt->data));
+   netplay->sim_queue_size++;
+
+   netplay_sim_flush(netplay);
+   return netplay->has_connection;
+}
+
 /**
  * get_self_input_state:
  * @netplay              : pointer to netplay object
@@ -230,26 +387,40 @@ static bool netplay_cmd_nak(netplay_t *netplay)
    return socket_send_all_blocking(netplay->fd, &cmd, sizeof(cmd));
 }
 
-static bool netplay_get_response(netplay_t *netplay)
+static void netplay_crc_check(netplay_t *netplay, struct netplay_crc *crc);
+static bool netplay_send_cmd(netplay_t *netplay, uint32_t cmd,
+      const void *data, size_t size);
+
+static void netplay_update_rtt(netplay_t *netplay, retro_time_t rtt)
 {
-   uint32_t response;
-   if (!socket_receive_all_blocking(netplay->fd, &response, sizeof(response)))
-      return false;
+   struct netplay_stats *stats = &netplay->stats;
 
-   return ntohl(response) == NETPLAY_CMD_ACK;
+   if (rtt < 0)
+      return;
+
+   stats->rtt_usec = rtt;
+   if (!stats->rtt_min_usec || rtt < stats->rtt_min_usec)
+      stats->rtt_min_usec = rtt;
+   if (rtt > stats->rtt_max_usec)
+      stats->rtt_max_usec = rtt;
 }
 
-static bool netplay_get_cmd(netplay_t *netplay)
+/**
+ * netplay_process_cmd:
+ * @netplay              : pointer to netplay object
+ * @cmd                  : command header as received (host byte order)
+ *
+ * Reads the payload of a command and acts upon it.
+ *
+ * Returns: false (0) if the connection should be dropped.
+ **/
+static bool netplay_process_cmd(netplay_t *netplay, uint32_t cmd)
 {
-   uint32_t cmd, flip_frame;
-   size_t cmd_size;
-
-   if (!socket_receive_all_blocking(netplay->fd, &cmd, sizeof(cmd)))
-      return false;
-
-   cmd = ntohl(cmd);
+   uint32_t flip_frame;
+   uint32_t payload[2];
+   struct netplay_crc *crc;
+   size_t cmd_size = cmd & 0xffff;
 
-   cmd_size = cmd & 0xffff;
    cmd = cmd >> 16;
 
    switch (cmd)
@@ -283,6 +454,70 @@ static bool netplay_get_cmd(netplay_t *netplay)
 
          return netplay_cmd_ack(netplay);
 
+      case NETPLAY_CMD_CRC:
+         if (cmd_size != sizeof(payload)
+               || !socket_receive_all_blocking(netplay->fd, payload, sizeof(payload)))
+         {
+            RARCH_ERR("Failed to receive CMD_CRC.\n");
+            return false;
+         }
+
+         payload[0] = ntohl(payload[0]);
+         crc = &netplay->crcs[payload[0] % NETPLAY_CRC_HISTORY];
+         if (crc->frame != payload[0])
+         {
+            memset(crc, 0, sizeof(*crc));
+            crc->frame = payload[0];
+         }
+         crc->remote     = ntohl(payload[1]);
+         crc->has_remote = true;
+         netplay_crc_check(netplay, crc);
+         return true;
+
+      case NETPLAY_CMD_LOAD_SAVESTATE:
+         /* Payload is frame and state size, the state itself follows. */
+         if (cmd_size != sizeof(payload)
+               || !socket_receive_all_blocking(netplay->fd, payload, sizeof(payload)))
+         {
+            RARCH_ERR("Failed to receive CMD_LOAD_SAVESTATE.\n");
+            return false;
+         }
+
+         if (ntohl(payload[1]) != netplay->state_size || !netplay->resync_state)
+         {
+            RARCH_ERR("CMD_LOAD_SAVESTATE has unexpected state size.\n");
+            return false;
+         }
+
+         if (!socket_receive_all_blocking(netplay->fd,
+                  netplay->resync_state, netplay->state_size))
+         {
+            RARCH_ERR("Failed to receive state from host.\n");
+            return false;
+         }
+
+         netplay->resync_frame = ntohl(payload[0]);
+         netplay->has_resync   = true;
+         return true;
+
+      case NETPLAY_CMD_PING:
+      case NETPLAY_CMD_PONG:
+         /* Payload is the sender's timestamp, echoed back with PONG. */
+         if (cmd_size != sizeof(payload)
+               || !socket_receive_all_blocking(netplay->fd, payload, sizeof(payload)))
+         {
+            RARCH_ERR("Failed to receive CMD_PING.\n");
+            return false;
+         }
+
+         if (cmd == NETPLAY_CMD_PING)
+            return netplay_send_cmd(netplay, NETPLAY_CMD_PONG,
+                  payload, sizeof(payload));
+
+         netplay_update_rtt(netplay, rarch_get_time_usec() -
+               (((retro_time_t)ntohl(payload[0]) << 32) | ntohl(payload[1])));
+         return true;
+
       default:
          break;
    }
@@ -291,6 +526,38 @@ static bool netplay_get_cmd(netplay_t *netplay)
    return netplay_cmd_nak(netplay);
 }
 
+static bool netplay_get_response(netplay_t *netplay)
+{
+   uint32_t response;
+
+   for (;;)
+   {
+      if (!socket_receive_all_blocking(netplay->fd, &response, sizeof(response)))
+         return false;
+
+      response = ntohl(response);
+
+      if (response == NETPLAY_CMD_ACK)
+         return true;
+      if (response == NETPLAY_CMD_NAK)
+         return false;
+
+      /* The peer pushed a command while we were waiting. */
+      if (!netplay_process_cmd(netplay, response))
+         return false;
+   }
+}
+
+static bool netplay_get_cmd(netplay_t *netplay)
+{
+   uint32_t cmd;
+
+   if (!socket_receive_all_blocking(netplay->fd, &cmd, sizeof(cmd)))
+      return false;
+
+   return netplay_process_cmd(netplay, ntohl(cmd));
+}
+
 #define MAX_RETRIES 16
 #define RETRY_MS 500
 
@@ -309,8 +576,13 @@ static int poll_input(netplay_t *netplay, bool block)
        * Technically possible for select() to modify tmp_tv, so 
        * we go paranoia mode. */
       struct timeval tmp_tv = tv;
+      bool sim_pending = netplay_sim_flush(netplay);
 
-      netplay->timeout_cnt++;
+      /* Wake up in time to send our delayed packets. */
+      if (sim_pending && block)
+         tmp_tv.tv_usec = NETPLAY_SIM_POLL_USEC;
+      else
+         netplay->timeout_cnt++;
 
       FD_ZERO(&fds);
       FD_SET(netplay->udp_fd, &fds);
@@ -327,7 +599,7 @@ static int poll_input(netplay_t *netplay, bool block)
       if (FD_ISSET(netplay->udp_fd, &fds))
          return 1;
 
-      if (!block)
+      if (!block || sim_pending)
          continue;
 
       if (!send_chunk(netplay))
@@ -476,7 +748,12 @@ void input_poll_net(void)
 {
    netplay_t *netplay = (netplay_t*)driver.netplay_data;
    if (!netplay_should_skip(netplay) && netplay_can_poll(netplay))
+   {
+      RARCH_PERFORMANCE_INIT(netplay_poll_input);
+      RARCH_PERFORMANCE_START(netplay_poll_input);
       netplay_poll(netplay);
+      RARCH_PERFORMANCE_STOP(netplay_poll_input);
+   }
 }
 
 void video_frame_net(const void *data, unsigned width,
@@ -880,7 +1157,7 @@ static bool send_info(netplay_t *netplay)
    char msg[512];
    void *sram = NULL;
    uint32_t header[3] = {
-      htonl(g_extern.content_crc),
+      htonl(content_get_crc()),
       htonl(implementation_magic_value()),
       htonl(pretro_get_memory_size(RETRO_MEMORY_SAVE_RAM))
    };
@@ -929,7 +1206,7 @@ static bool get_info(netplay_t *netplay)
       return false;
    }
 
-   if (g_extern.content_crc != ntohl(header[0]))
+   if (content_get_crc() != ntohl(header[0]))
    {
       RARCH_ERR("Content CRC32s differ. Cannot use different games.\n");
       return false;
@@ -990,7 +1267,7 @@ static uint32_t *bsv_header_generate(size_t *size, uint32_t magic)
 
    bsv_header[MAGIC_INDEX] = swap_if_little32(BSV_MAGIC);
    bsv_header[SERIALIZER_INDEX] = swap_if_big32(magic);
-   bsv_header[CRC_INDEX] = swap_if_big32(g_extern.content_crc);
+   bsv_header[CRC_INDEX] = swap_if_big32(content_get_crc());
    bsv_header[STATE_SIZE_INDEX] = swap_if_big32(serialize_size);
 
    if (serialize_size && !pretro_serialize(header + 4, serialize_size))
@@ -1023,10 +1300,10 @@ static bool bsv_parse_header(const uint32_t *header, uint32_t magic)
    }
 
    in_crc = swap_if_big32(header[CRC_INDEX]);
-   if (in_crc != g_extern.content_crc)
+   if (in_crc != content_get_crc())
    {
       RARCH_ERR("CRC32 mismatch, got 0x%x, expected 0x%x.\n", in_crc,
-            g_extern.content_crc);
+            content_get_crc());
       return false;
    }
 
@@ -1127,6 +1404,83 @@ static bool init_buffers(netplay_t *netplay)
    return true;
 }
 
+#ifdef HAVE_THREADS
+static void netplay_crc_thread(void *data)
+{
+   netplay_t *netplay = (netplay_t*)data;
+
+   slock_lock(netplay->crc_lock);
+
+   for (;;)
+   {
+      while (!netplay->crc_quit && netplay->crc_job != NETPLAY_CRC_PENDING)
+         scond_wait(netplay->crc_cond, netplay->crc_lock);
+
+      if (netplay->crc_quit)
+         break;
+
+      /* crc_state belongs to us until the job is marked done. */
+      slock_unlock(netplay->crc_lock);
+      netplay->crc_job_result = crc32_calculate(
+            (const uint8_t*)netplay->crc_state, netplay->state_size);
+      slock_lock(netplay->crc_lock);
+
+      netplay->crc_job = NETPLAY_CRC_DONE;
+   }
+
+   slock_unlock(netplay->crc_lock);
+}
+#endif
+
+static bool init_crc(netplay_t *netplay)
+{
+   netplay->crc_frame = NETPLAY_CRC_INTERVAL;
+
+   if (!netplay->state_size)
+      return true;
+
+   netplay->crc_state    = malloc(netplay->state_size);
+   netplay->resync_state = malloc(netplay->state_size);
+
+   if (!netplay->crc_state || !netplay->resync_state)
+      return false;
+
+#ifdef HAVE_THREADS
+   netplay->crc_lock   = slock_new();
+   netplay->crc_cond   = scond_new();
+   if (!netplay->crc_lock || !netplay->crc_cond)
+      return false;
+
+   netplay->crc_thread = sthread_create(netplay_crc_thread, netplay);
+   if (!netplay->crc_thread)
+      return false;
+#endif
+
+   return true;
+}
+
+static void deinit_crc(netplay_t *netplay)
+{
+#ifdef HAVE_THREADS
+   if (netplay->crc_thread)
+   {
+      slock_lock(netplay->crc_lock);
+      netplay->crc_quit = true;
+      scond_signal(netplay->crc_cond);
+      slock_unlock(netplay->crc_lock);
+      sthread_join(netplay->crc_thread);
+   }
+
+   if (netplay->crc_lock)
+      slock_free(netplay->crc_lock);
+   if (netplay->crc_cond)
+      scond_free(netplay->crc_cond);
+#endif
+
+   free(netplay->crc_state);
+   free(netplay->resync_state);
+}
+
 /**
  * netplay_new:
  * @server               : IP address of server.
@@ -1199,6 +1553,23 @@ netplay_t *netplay_new(const char *server, uint16_t port,
       if (!init_buffers(netplay))
          goto error;
 
+      if (!init_crc(netplay))
+         goto error;
+
+      if (g_extern.netplay_sim_delay_ms || g_extern.netplay_sim_loss)
+      {
+         netplay->sim_delay_usec = g_extern.netplay_sim_delay_ms * 1000LL;
+         netplay->sim_loss       = g_extern.netplay_sim_loss;
+         netplay->sim_seed       = 1;
+         netplay->sim_queue      = (struct netplay_sim_packet*)
+            calloc(NETPLAY_SIM_QUEUE, sizeof(*netplay->sim_queue));
+         if (!netplay->sim_queue)
+            goto error;
+
+         RARCH_LOG("Netplay: Injecting %u ms delay, %u%% packet loss.\n",
+               g_extern.netplay_sim_delay_ms, netplay->sim_loss);
+      }
+
       netplay->has_connection = true;
    }
 
@@ -1229,6 +1600,210 @@ static bool netplay_send_cmd(netplay_t *netplay, uint32_t cmd,
    return true;
 }
 
+static void netplay_crc_check(netplay_t *netplay, struct netplay_crc *crc)
+{
+   if (!crc->has_local || !crc->has_remote)
+      return;
+
+   if (crc->local != crc->remote)
+   {
+      RARCH_WARN("Netplay desync detected on frame %u (0x%08x != 0x%08x).\n",
+            crc->frame, crc->local, crc->remote);
+      netplay->desync = true;
+   }
+
+   crc->has_local  = false;
+   crc->has_remote = false;
+}
+
+/**
+ * netplay_crc_result:
+ * @netplay              : pointer to netplay object
+ * @frame                : frame which was hashed
+ * @value                : hash of the state of @frame
+ *
+ * The client forwards its own hashes to the host,
+ * the host compares them against the hashes it got.
+ **/
+static void netplay_crc_result(netplay_t *netplay,
+      uint32_t frame, uint32_t value)
+{
+   struct netplay_crc *crc = &netplay->crcs[frame % NETPLAY_CRC_HISTORY];
+
+   if (netplay->port == 0)
+   {
+      uint32_t payload[2];
+
+      payload[0] = htonl(frame);
+      payload[1] = htonl(value);
+
+      if (!netplay_send_cmd(netplay, NETPLAY_CMD_CRC,
+               payload, sizeof(payload)))
+      {
+         warn_hangup();
+         netplay->has_connection = false;
+      }
+      return;
+   }
+
+   if (crc->frame != frame)
+   {
+      memset(crc, 0, sizeof(*crc));
+      crc->frame = frame;
+   }
+
+   crc->local     = value;
+   crc->has_local = true;
+   netplay_crc_check(netplay, crc);
+}
+
+/**
+ * netplay_crc_poll:
+ * @netplay              : pointer to netplay object
+ *
+ * Collects a finished hash and schedules hashing of the next 
+ * confirmed state, if due. Only states which precede 
+ * other_frame_count have been computed from real input of both users.
+ **/
+static void netplay_crc_poll(netplay_t *netplay)
+{
+   bool done = false, busy;
+   uint32_t frame = 0, value = 0;
+
+   if (!netplay->crc_state)
+      return;
+
+#ifdef HAVE_THREADS
+   slock_lock(netplay->crc_lock);
+#endif
+   if (netplay->crc_job == NETPLAY_CRC_DONE)
+   {
+      done  = true;
+      frame = netplay->crc_job_frame;
+      value = netplay->crc_job_result;
+      netplay->crc_job = NETPLAY_CRC_IDLE;
+   }
+   busy = netplay->crc_job != NETPLAY_CRC_IDLE;
+#ifdef HAVE_THREADS
+   slock_unlock(netplay->crc_lock);
+#endif
+
+   if (done)
+      netplay_crc_result(netplay, frame, value);
+
+   /* State is already overwritten in the ring buffer. */
+   while (netplay->crc_frame + netplay->buffer_size <= netplay->frame_count)
+      netplay->crc_frame += NETPLAY_CRC_INTERVAL;
+
+   if (netplay->crc_frame >= netplay->frame_count
+         || netplay->crc_frame > netplay->other_frame_count)
+      return;
+
+   /* Still busy, skip this one. */
+   if (busy)
+   {
+      netplay->crc_frame += NETPLAY_CRC_INTERVAL;
+      return;
+   }
+
+   memcpy(netplay->crc_state,
+         netplay->buffer[netplay->crc_frame % netplay->buffer_size].state,
+         netplay->state_size);
+   netplay->crc_job_frame = netplay->crc_frame;
+   netplay->crc_frame    += NETPLAY_CRC_INTERVAL;
+
+#ifdef HAVE_THREADS
+   slock_lock(netplay->crc_lock);
+   netplay->crc_job = NETPLAY_CRC_PENDING;
+   scond_signal(netplay->crc_cond);
+   slock_unlock(netplay->crc_lock);
+#else
+   netplay->crc_job_result = crc32_calculate(
+         (const uint8_t*)netplay->crc_state, netplay->state_size);
+   netplay->crc_job = NETPLAY_CRC_DONE;
+#endif
+}
+
+/**
+ * netplay_send_savestate:
+ * @netplay              : pointer to netplay object
+ *
+ * Host only. Pushes the latest confirmed state to the client,
+ * which replays its recorded input on top of it.
+ **/
+static void netplay_send_savestate(netplay_t *netplay)
+{
+   uint32_t payload[2];
+   uint32_t frame = netplay->other_frame_count;
+
+   if (frame >= netplay->frame_count)
+      frame = netplay->frame_count - 1;
+
+   /* Try again on next mismatch. */
+   if (frame + netplay->buffer_size <= netplay->frame_count)
+      return;
+
+   netplay->desync = false;
+   memset(netplay->crcs, 0, sizeof(netplay->crcs));
+
+   payload[0] = htonl(frame);
+   payload[1] = htonl(netplay->state_size);
+
+   if (!netplay_send_cmd(netplay, NETPLAY_CMD_LOAD_SAVESTATE,
+            payload, sizeof(payload))
+         || !socket_send_all_blocking(netplay->fd,
+            netplay->buffer[frame % netplay->buffer_size].state,
+            netplay->state_size))
+   {
+      warn_hangup();
+      netplay->has_connection = false;
+      return;
+   }
+
+   RARCH_LOG("Netplay desync, sent state of frame %u to client.\n", frame);
+   msg_queue_push(g_extern.msg_queue, "Netplay desync, resyncing.", 1, 180);
+}
+
+/**
+ * netplay_apply_resync:
+ * @netplay              : pointer to netplay object
+ *
+ * Client only. Loads the state pushed by the host into the ring buffer
+ * and rewinds to it, so the post-frame replay runs from there.
+ *
+ * Returns: true (1) if a replay is required, otherwise false (0).
+ **/
+static bool netplay_apply_resync(netplay_t *netplay)
+{
+   uint32_t frame = netplay->resync_frame;
+
+   if (!netplay->has_resync)
+      return false;
+
+   if (frame + netplay->buffer_size <= netplay->frame_count)
+   {
+      RARCH_WARN("Netplay state from host is too old, dropping it.\n");
+      netplay->has_resync = false;
+      return false;
+   }
+
+   /* Not reached yet, or we haven't got the input to replay from it. */
+   if (frame >= netplay->frame_count || frame > netplay->read_frame_count)
+      return false;
+
+   netplay->has_resync = false;
+
+   memcpy(netplay->buffer[frame % netplay->buffer_size].state,
+         netplay->resync_state, netplay->state_size);
+   netplay->other_ptr         = frame % netplay->buffer_size;
+   netplay->other_frame_count = frame;
+   memset(netplay->crcs, 0, sizeof(netplay->crcs));
+
+   RARCH_LOG("Netplay resynced to frame %u.\n", frame);
+   msg_queue_push(g_extern.msg_queue, "Netplay resynced with host.", 1, 180);
+   return true;
+}
+
 /**
  * netplay_flip_users:
  * @netplay              : pointer to netplay object
@@ -1284,6 +1859,58 @@ error:
    msg_queue_push(g_extern.msg_queue, msg, 1, 180);
 }
 
+/**
+ * netplay_get_stats:
+ * @netplay              : pointer to netplay object
+ * @s                    : output string
+ * @len                  : size of @s
+ *
+ * Describes prediction, rollback and round-trip statistics
+ * of the current session.
+ *
+ * Returns: true (1) if stats are available, otherwise false (0).
+ **/
+bool netplay_get_stats(netplay_t *netplay, char *s, size_t len)
+{
+   const struct netplay_stats *stats;
+   unsigned predictions;
+
+   if (!netplay || netplay->spectate)
+      return false;
+
+   stats       = &netplay->stats;
+   predictions = stats->predicted + stats->mispredicted;
+
+   snprintf(s, len,
+         "Netplay: RTT %u ms (%u-%u), lag %u frames, mispredicted %u/%u, "
+         "rollbacks %u (avg %.1f, max %u frames), replay %.2f ms/rollback",
+         (unsigned)(stats->rtt_usec / 1000),
+         (unsigned)(stats->rtt_min_usec / 1000),
+         (unsigned)(stats->rtt_max_usec / 1000),
+         netplay->frame_count - netplay->read_frame_count,
+         stats->mispredicted, predictions,
+         stats->rollbacks,
+         stats->rollbacks ?
+         (float)stats->rollback_frames / stats->rollbacks : 0.0f,
+         stats->rollback_max,
+         stats->rollbacks ?
+         stats->replay_usec / 1000.0 / stats->rollbacks : 0.0);
+
+   return true;
+}
+
+static void netplay_log_stats(netplay_t *netplay)
+{
+   char msg[512];
+
+   if (!netplay_get_stats(netplay, msg, sizeof(msg)))
+      return;
+
+   RARCH_LOG("%s.\n", msg);
+   RARCH_LOG("Netplay: %u frames, %u frames replayed.\n",
+         netplay->frame_count, netplay->stats.rollback_frames);
+}
+
 /**
  * netplay_free:
  * @netplay              : pointer to netplay object
@@ -1308,6 +1935,10 @@ void netplay_free(netplay_t *netplay)
    {
       socket_close(netplay->udp_fd);
 
+      netplay_log_stats(netplay);
+      deinit_crc(netplay);
+      free(netplay->sim_queue);
+
       for (i = 0; i < netplay->buffer_size; i++)
          free(netplay->buffer[i].state);
 
@@ -1495,6 +2126,34 @@ void netplay_pre_frame(netplay_t *netplay)
       netplay_pre_frame_net(netplay);
 }
 
+static void netplay_post_frame_crc(netplay_t *netplay)
+{
+   if (!netplay->has_connection)
+      return;
+
+   if (netplay->frame_count % NETPLAY_PING_INTERVAL == 0)
+   {
+      uint32_t payload[2];
+      retro_time_t now = rarch_get_time_usec();
+
+      payload[0] = htonl((uint32_t)(now >> 32));
+      payload[1] = htonl((uint32_t)now);
+
+      if (!netplay_send_cmd(netplay, NETPLAY_CMD_PING,
+               payload, sizeof(payload)))
+      {
+         warn_hangup();
+         netplay->has_connection = false;
+         return;
+      }
+   }
+
+   netplay_crc_poll(netplay);
+
+   if (netplay->desync && netplay->has_connection)
+      netplay_send_savestate(netplay);
+}
+
 /**
  * netplay_post_frame_net:   
  * @netplay              : pointer to netplay object
@@ -1504,28 +2163,50 @@ void netplay_pre_frame(netplay_t *netplay)
  **/
 static void netplay_post_frame_net(netplay_t *netplay)
 {
+   bool resync;
+
    netplay->frame_count++;
 
+   resync = netplay_apply_resync(netplay);
+
    /* Nothing to do... */
-   if (netplay->other_frame_count == netplay->read_frame_count)
+   if (!resync && netplay->other_frame_count == netplay->read_frame_count)
+   {
+      netplay_post_frame_crc(netplay);
       return;
+   }
 
    /* Skip ahead if we predicted correctly.
     * Skip until our simulation failed. */
-   while (netplay->other_frame_count < netplay->read_frame_count)
+   while (!resync && netplay->other_frame_count < netplay->read_frame_count)
    {
       const struct delta_frame *ptr = &netplay->buffer[netplay->other_ptr];
 
       if ((ptr->simulated_input_state != ptr->real_input_state)
             && !ptr->used_real)
+      {
+         netplay->stats.mispredicted++;
          break;
+      }
+      if (!ptr->used_real)
+         netplay->stats.predicted++;
       netplay->other_ptr = NEXT_PTR(netplay->other_ptr);
       netplay->other_frame_count++;
    }
 
-   if (netplay->other_frame_count < netplay->read_frame_count)
+   if (resync || netplay->other_frame_count < netplay->read_frame_count)
    {
       bool first = true;
+      uint32_t depth = netplay->frame_count - netplay->other_frame_count;
+      retro_time_t start = rarch_get_time_usec();
+
+      RARCH_PERFORMANCE_INIT(netplay_replay);
+      RARCH_PERFORMANCE_START(netplay_replay);
+
+      netplay->stats.rollbacks++;
+      netplay->stats.rollback_frames += depth;
+      if (depth > netplay->stats.rollback_max)
+         netplay->stats.rollback_max = depth;
 
       /* Replay frames. */
       netplay->is_replay = true;
@@ -1554,7 +2235,12 @@ static void netplay_post_frame_net(netplay_t *netplay)
       netplay->other_ptr = netplay->read_ptr;
       netplay->other_frame_count = netplay->read_frame_count;
       netplay->is_replay = false;
+
+      RARCH_PERFORMANCE_STOP(netplay_replay);
+      netplay->stats.replay_usec += rarch_get_time_usec() - start;
    }
+
+   netplay_post_frame_crc(netplay);
 }
 
 /**
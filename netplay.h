@@ -98,5 +98,18 @@ void netplay_pre_frame(netplay_t *handle);
  **/
 void netplay_post_frame(netplay_t *handle);
 
+/**
+ * netplay_get_stats:
+ * @netplay              : pointer to netplay object
+ * @s                    : output string
+ * @len                  : size of @s
+ *
+ * Describes prediction, rollback and round-trip statistics
+ * of the current session.
+ *
+ * Returns: true (1) if stats are available, otherwise false (0).
+ **/
+bool netplay_get_stats(netplay_t *handle, char *s, size_t len);
+
 #endif
 
@@ -24,6 +24,114 @@
 #include <stdint.h>
 #include <string.h>
 
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+/* Sources at least this large are checksummed on a second thread
+ * while the patch is being applied. */
+#define PATCH_CRC_THREAD_MIN_SIZE (1024 * 1024)
+
+struct patch_crc_job
+{
+   const uint8_t *data;
+   size_t size;
+   uint32_t crc;
+#ifdef HAVE_THREADS
+   sthread_t *thread;
+#endif
+};
+
+#ifdef HAVE_THREADS
+static void patch_crc_thread(void *data)
+{
+   struct patch_crc_job *job = (struct patch_crc_job*)data;
+   job->crc = crc32_calculate(job->data, job->size);
+}
+#endif
+
+/**
+ * patch_crc_start:
+ * @job          : checksum job.
+ * @data         : buffer to checksum.
+ * @size         : size of @data.
+ *
+ * Starts computing the CRC32 of @data. Large buffers are
+ * checksummed on a worker thread, the caller must not
+ * modify @data until patch_crc_finish returns.
+ **/
+static void patch_crc_start(struct patch_crc_job *job,
+      const uint8_t *data, size_t size)
+{
+   job->data = data;
+   job->size = size;
+   job->crc  = 0;
+#ifdef HAVE_THREADS
+   job->thread = NULL;
+   if (size >= PATCH_CRC_THREAD_MIN_SIZE)
+      job->thread = sthread_create(patch_crc_thread, job);
+#endif
+}
+
+/**
+ * patch_crc_finish:
+ * @job          : checksum job started with patch_crc_start.
+ *
+ * Returns: CRC32 of the job's buffer.
+ **/
+static uint32_t patch_crc_finish(struct patch_crc_job *job)
+{
+#ifdef HAVE_THREADS
+   if (job->thread)
+   {
+      sthread_join(job->thread);
+      job->thread = NULL;
+      return job->crc;
+   }
+#endif
+   return crc32_calculate(job->data, job->size);
+}
+
+static uint32_t patch_read_le32(const uint8_t *data)
+{
+   return (uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+      ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+/**
+ * patch_decode:
+ * @data         : patch data.
+ * @offset       : read position, advanced past the number.
+ * @end          : end of the readable region of @data.
+ * @out          : decoded number.
+ *
+ * Decodes a variable-length number as used by BPS and UPS.
+ *
+ * Returns: true if a complete number was read before @end.
+ **/
+static bool patch_decode(const uint8_t *data, size_t *offset,
+      size_t end, uint64_t *out)
+{
+   unsigned i;
+   uint64_t value = 0, shift = 1;
+
+   /* More than 10 bytes would overflow 64 bits. */
+   for (i = 0; i < 10 && *offset < end; i++)
+   {
+      uint8_t x = data[(*offset)++];
+      value += (x & 0x7f) * shift;
+      if (x & 0x80)
+      {
+         *out = value;
+         return true;
+      }
+      shift <<= 7;
+      value += shift;
+   }
+
+   return false;
+}
+
 enum bps_mode
 {
    SOURCE_READ = 0,
@@ -34,43 +142,89 @@ enum bps_mode
 
 struct bps_data
 {
-   const uint8_t *modify_data, *source_data; 
+   const uint8_t *modify_data, *source_data;
    uint8_t *target_data;
    size_t modify_length, source_length, target_length;
    size_t modify_offset, source_offset, target_offset;
-   uint32_t modify_checksum, source_checksum, target_checksum;
-
-   size_t source_relative_offset, target_relative_offset, output_offset;
+   size_t output_offset;
 };
 
-static uint8_t bps_read(struct bps_data *bps)
+static patch_error_t bps_read_header(struct bps_data *bps,
+      uint64_t *source_size, uint64_t *target_size)
 {
-   uint8_t data = bps->modify_data[bps->modify_offset++];
-   bps->modify_checksum = crc32_adjust(bps->modify_checksum, data);
-   return data;
+   uint64_t markup_size;
+   size_t end;
+
+   if (bps->modify_length < 19)
+      return PATCH_PATCH_TOO_SMALL;
+
+   if (memcmp(bps->modify_data, "BPS1", 4) != 0)
+      return PATCH_PATCH_INVALID_HEADER;
+
+   end = bps->modify_length - 12;
+   bps->modify_offset = 4;
+
+   if (!patch_decode(bps->modify_data, &bps->modify_offset, end, source_size)
+         || !patch_decode(bps->modify_data, &bps->modify_offset, end,
+            target_size)
+         || !patch_decode(bps->modify_data, &bps->modify_offset, end,
+            &markup_size)
+         || markup_size > end - bps->modify_offset)
+      return PATCH_PATCH_INVALID_HEADER;
+
+   bps->modify_offset += markup_size;
+   return PATCH_SUCCESS;
 }
 
-static uint64_t bps_decode(struct bps_data *bps)
+/**
+ * bps_adjust_offset:
+ * @offset       : relative offset to adjust.
+ * @delta        : encoded displacement, the low bit is the sign.
+ * @limit        : exclusive upper bound of the adjusted offset.
+ *
+ * Returns: true if the adjusted offset lies in [0, @limit).
+ **/
+static bool bps_adjust_offset(size_t *offset, uint64_t delta, size_t limit)
 {
-   uint64_t data = 0, shift = 1;
+   uint64_t magnitude = delta >> 1;
 
-   for (;;)
+   if (delta & 1)
    {
-      uint8_t x = bps_read(bps);
-      data += (x & 0x7f) * shift;
-      if (x & 0x80)
-         break;
-      shift <<= 7;
-      data += shift;
+      if (magnitude > *offset)
+         return false;
+      *offset -= magnitude;
+   }
+   else
+   {
+      if (magnitude >= limit - *offset)
+         return false;
+      *offset += magnitude;
    }
 
-   return data;
+   return *offset < limit;
 }
 
-static void bps_write(struct bps_data *bps, uint8_t data)
+patch_error_t bps_get_target_size(
+      const uint8_t *modify_data, size_t modify_length,
+      size_t source_length, size_t *target_length)
 {
-   bps->target_data[bps->output_offset++] = data;
-   bps->target_checksum = crc32_adjust(bps->target_checksum, data);
+   uint64_t modify_source_size, modify_target_size;
+   struct bps_data bps = {0};
+   patch_error_t err;
+
+   (void)source_length;
+
+   bps.modify_data   = modify_data;
+   bps.modify_length = modify_length;
+
+   err = bps_read_header(&bps, &modify_source_size, &modify_target_size);
+   if (err != PATCH_SUCCESS)
+      return err;
+   if (modify_target_size > (size_t)-1)
+      return PATCH_TARGET_TOO_SMALL;
+
+   *target_length = modify_target_size;
+   return PATCH_SUCCESS;
 }
 
 patch_error_t bps_apply_patch(
@@ -78,104 +232,139 @@ patch_error_t bps_apply_patch(
       const uint8_t *source_data, size_t source_length,
       uint8_t *target_data, size_t *target_length)
 {
-   size_t i;
-   size_t modify_source_size, modify_target_size,
-          modify_markup_size;
+   size_t end;
+   uint64_t modify_source_size, modify_target_size;
    struct bps_data bps = {0};
-   uint32_t modify_source_checksum = 0, modify_target_checksum = 0,
-            modify_modify_checksum = 0, checksum;
+   struct patch_crc_job source_crc;
+   uint32_t source_checksum, target_checksum, modify_checksum;
+   patch_error_t err;
 
-   if (modify_length < 19)
-      return PATCH_PATCH_TOO_SMALL;
-
-   bps.modify_data = modify_data;
+   bps.modify_data   = modify_data;
    bps.modify_length = modify_length;
-   bps.target_data = target_data;
+   bps.target_data   = target_data;
    bps.target_length = *target_length;
-   bps.source_data = source_data;
+   bps.source_data   = source_data;
    bps.source_length = source_length;
-   bps.modify_checksum = ~0;
-   bps.target_checksum = ~0;
 
-   if ((bps_read(&bps) != 'B') || (bps_read(&bps) != 'P') ||
-         (bps_read(&bps) != 'S') || (bps_read(&bps) != '1'))
-      return PATCH_PATCH_INVALID_HEADER;
-
-   modify_source_size = bps_decode(&bps);
-   modify_target_size = bps_decode(&bps);
-   modify_markup_size = bps_decode(&bps);
-   for (i = 0; i < modify_markup_size; i++)
-      bps_read(&bps);
+   err = bps_read_header(&bps, &modify_source_size, &modify_target_size);
+   if (err != PATCH_SUCCESS)
+      return err;
 
    if (modify_source_size > bps.source_length)
       return PATCH_SOURCE_TOO_SMALL;
    if (modify_target_size > bps.target_length)
       return PATCH_TARGET_TOO_SMALL;
 
-   while (bps.modify_offset < bps.modify_length - 12)
+   /* Writes past the size announced by the header are invalid. */
+   bps.target_length = modify_target_size;
+   end = modify_length - 12;
+
+   patch_crc_start(&source_crc, source_data, source_length);
+
+   while (bps.modify_offset < end)
    {
-      size_t length = bps_decode(&bps);
-      unsigned mode = length & 3;
+      uint64_t data, delta;
+      size_t length;
+      unsigned mode;
 
-      length = (length >> 2) + 1;
+      if (!patch_decode(modify_data, &bps.modify_offset, end, &data)
+            || (data >> 2) >= bps.target_length - bps.output_offset)
+      {
+         err = PATCH_PATCH_INVALID;
+         break;
+      }
+
+      mode   = data & 3;
+      length = (data >> 2) + 1;
 
       switch (mode)
       {
          case SOURCE_READ:
-            while (length--)
-               bps_write(&bps, bps.source_data[bps.output_offset]);
+            if (bps.output_offset > bps.source_length
+                  || length > bps.source_length - bps.output_offset)
+            {
+               err = PATCH_PATCH_INVALID;
+               break;
+            }
+            memcpy(target_data + bps.output_offset,
+                  source_data + bps.output_offset, length);
             break;
 
          case TARGET_READ:
-            while (length--)
-               bps_write(&bps, bps_read(&bps));
+            if (length > end - bps.modify_offset)
+            {
+               err = PATCH_PATCH_INVALID;
+               break;
+            }
+            memcpy(target_data + bps.output_offset,
+                  modify_data + bps.modify_offset, length);
+            bps.modify_offset += length;
             break;
 
          case SOURCE_COPY:
+            if (!patch_decode(modify_data, &bps.modify_offset, end, &delta)
+                  || !bps_adjust_offset(&bps.source_offset, delta,
+                     bps.source_length)
+                  || length > bps.source_length - bps.source_offset)
+            {
+               err = PATCH_PATCH_INVALID;
+               break;
+            }
+            memcpy(target_data + bps.output_offset,
+                  source_data + bps.source_offset, length);
+            bps.source_offset += length;
+            break;
+
          case TARGET_COPY:
          {
-            int offset = bps_decode(&bps);
-            bool negative = offset & 1;
-            offset >>= 1;
-            if (negative)
-               offset = -offset;
+            size_t from, copied;
 
-            if (mode == SOURCE_COPY)
+            if (!patch_decode(modify_data, &bps.modify_offset, end, &delta)
+                  || !bps_adjust_offset(&bps.target_offset, delta,
+                     bps.output_offset))
             {
-               bps.source_offset += offset;
-               while (length--)
-                  bps_write(&bps, bps.source_data[bps.source_offset++]);
+               err = PATCH_PATCH_INVALID;
+               break;
             }
-            else
+
+            /* The run may overlap its own output, repeating the
+             * last (output - from) bytes. Every chunk copied from
+             * the start of the run keeps the repeated pattern
+             * aligned, so the chunks double in size. */
+            from = bps.target_offset;
+            for (copied = 0; copied < length; )
             {
-               bps.target_offset += offset;
-               while (length--)
-                  bps_write(&bps, bps.target_data[bps.target_offset++]);
-               break;
+               size_t chunk = bps.output_offset + copied - from;
+
+               if (chunk > length - copied)
+                  chunk = length - copied;
+               memcpy(target_data + bps.output_offset + copied,
+                     target_data + from, chunk);
+               copied += chunk;
             }
+            bps.target_offset += length;
             break;
          }
       }
-   }
 
+      if (err != PATCH_SUCCESS)
+         break;
 
-   for (i = 0; i < 32; i += 8)
-      modify_source_checksum |= bps_read(&bps) << i;
-   for (i = 0; i < 32; i += 8)
-      modify_target_checksum |= bps_read(&bps) << i;
+      bps.output_offset += length;
+   }
 
-   checksum = ~bps.modify_checksum;
-   for (i = 0; i < 32; i += 8)
-      modify_modify_checksum |= bps_read(&bps) << i;
+   source_checksum = patch_crc_finish(&source_crc);
+   if (err != PATCH_SUCCESS)
+      return err;
 
-   bps.source_checksum = crc32_calculate(bps.source_data, bps.source_length);
-   bps.target_checksum = ~bps.target_checksum;
+   target_checksum = crc32_calculate(target_data, bps.output_offset);
+   modify_checksum = crc32_calculate(modify_data, modify_length - 4);
 
-   if (bps.source_checksum != modify_source_checksum)
+   if (source_checksum != patch_read_le32(modify_data + end))
       return PATCH_SOURCE_CHECKSUM_INVALID;
-   if (bps.target_checksum != modify_target_checksum)
+   if (target_checksum != patch_read_le32(modify_data + end + 4))
       return PATCH_TARGET_CHECKSUM_INVALID;
-   if (checksum != modify_modify_checksum)
+   if (modify_checksum != patch_read_le32(modify_data + end + 8))
       return PATCH_PATCH_CHECKSUM_INVALID;
 
    *target_length = modify_target_size;
@@ -185,59 +374,101 @@ patch_error_t bps_apply_patch(
 
 struct ups_data
 {
-   const uint8_t *patch_data, *source_data; 
+   const uint8_t *patch_data, *source_data;
    uint8_t *target_data;
-   unsigned patch_length, source_length, target_length;
-   unsigned patch_offset, source_offset, target_offset;
-   unsigned patch_checksum, source_checksum, target_checksum;
+   size_t patch_length, source_length, target_length;
+   size_t patch_offset, source_offset, target_offset;
 };
 
-static uint8_t ups_patch_read(struct ups_data *data) 
+static uint8_t ups_source_read(struct ups_data *data)
 {
-   if (data->patch_offset < data->patch_length) 
-   {
-      uint8_t n = data->patch_data[data->patch_offset++];
-      data->patch_checksum = crc32_adjust(data->patch_checksum, n);
-      return n;
-   }
+   if (data->source_offset < data->source_length)
+      return data->source_data[data->source_offset++];
    return 0x00;
 }
 
-static uint8_t ups_source_read(struct ups_data *data) 
+static void ups_target_write(struct ups_data *data, uint8_t n)
 {
-   if (data->source_offset < data->source_length) 
-   {
-      uint8_t n = data->source_data[data->source_offset++];
-      data->source_checksum = crc32_adjust(data->source_checksum, n);
-      return n;
-   }
-   return 0x00;
+   /* Patches are reversible, so the records may extend past
+    * the target. Those writes are dropped. */
+   if (data->target_offset < data->target_length)
+      data->target_data[data->target_offset++] = n;
 }
 
-static void ups_target_write(struct ups_data *data, uint8_t n) 
+/**
+ * ups_copy:
+ * @data         : UPS state.
+ * @length       : number of bytes to copy.
+ *
+ * Copies @length unchanged bytes from the source to the target.
+ * Reads past the end of the source yield zeroes.
+ **/
+static void ups_copy(struct ups_data *data, uint64_t length)
 {
-   if (data->target_offset < data->target_length) 
-   {
-      data->target_data[data->target_offset] = n;
-      data->target_checksum = crc32_adjust(data->target_checksum, n);
-   }
+   size_t source_left = data->source_length - data->source_offset;
+   size_t target_left = data->target_length - data->target_offset;
+   size_t count       = length < target_left ? length : target_left;
+   size_t copied      = count < source_left ? count : source_left;
+
+   memcpy(data->target_data + data->target_offset,
+         data->source_data + data->source_offset, copied);
+   memset(data->target_data + data->target_offset + copied, 0,
+         count - copied);
+
+   data->source_offset += length < source_left ? length : source_left;
+   data->target_offset += count;
+}
+
+static patch_error_t ups_read_header(struct ups_data *data,
+      uint64_t *source_read_length, uint64_t *target_read_length)
+{
+   size_t end;
+
+   if (data->patch_length < 18)
+      return PATCH_PATCH_INVALID;
+   if (memcmp(data->patch_data, "UPS1", 4) != 0)
+      return PATCH_PATCH_INVALID;
 
-   data->target_offset++;
+   end = data->patch_length - 12;
+   data->patch_offset = 4;
+
+   if (!patch_decode(data->patch_data, &data->patch_offset, end,
+            source_read_length)
+         || !patch_decode(data->patch_data, &data->patch_offset, end,
+            target_read_length))
+      return PATCH_PATCH_INVALID;
+
+   /* The patch applies in either direction. */
+   if (data->source_length != *source_read_length
+         && data->source_length != *target_read_length)
+      return PATCH_SOURCE_INVALID;
+
+   return PATCH_SUCCESS;
 }
 
-static uint64_t ups_decode(struct ups_data *data) 
+patch_error_t ups_get_target_size(
+      const uint8_t *patchdata, size_t patchlength,
+      size_t sourcelength, size_t *targetlength)
 {
-   uint64_t offset = 0, shift = 1;
-   while (true) 
-   {
-      uint8_t x = ups_patch_read(data);
-      offset += (x & 0x7f) * shift;
-      if (x & 0x80) 
-         break;
-      shift <<= 7;
-      offset += shift;
-   }
-   return offset;
+   uint64_t source_read_length, target_read_length, size;
+   struct ups_data data = {0};
+   patch_error_t err;
+
+   data.patch_data    = patchdata;
+   data.patch_length  = patchlength;
+   data.source_length = sourcelength;
+
+   err = ups_read_header(&data, &source_read_length, &target_read_length);
+   if (err != PATCH_SUCCESS)
+      return err;
+
+   size = (data.source_length == source_read_length ?
+         target_read_length : source_read_length);
+   if (size > (size_t)-1)
+      return PATCH_TARGET_TOO_SMALL;
+
+   *targetlength = size;
+   return PATCH_SUCCESS;
 }
 
 patch_error_t ups_apply_patch(
@@ -245,11 +476,13 @@ patch_error_t ups_apply_patch(
       const uint8_t *sourcedata, size_t sourcelength,
       uint8_t *targetdata, size_t *targetlength)
 {
-   size_t i;
-   unsigned source_read_length, target_read_length;
-   uint32_t patch_read_checksum = 0, source_read_checksum = 0,
-            target_read_checksum = 0, patch_result_checksum;
+   size_t end;
+   uint64_t source_read_length, target_read_length, size;
+   uint32_t source_read_checksum, target_read_checksum,
+            source_checksum, target_checksum, patch_checksum;
    struct ups_data data = {0};
+   struct patch_crc_job source_crc;
+   patch_error_t err;
 
    data.patch_data = patchdata;
    data.source_data = sourcedata;
@@ -257,111 +490,119 @@ patch_error_t ups_apply_patch(
    data.patch_length = patchlength;
    data.source_length = sourcelength;
    data.target_length = *targetlength;
-   data.patch_checksum = ~0;
-   data.source_checksum = ~0;
-   data.target_checksum = ~0;
 
-   if (data.patch_length < 18) 
-      return PATCH_PATCH_INVALID;
-   if (ups_patch_read(&data) != 'U') 
-      return PATCH_PATCH_INVALID;
-   if (ups_patch_read(&data) != 'P') 
-      return PATCH_PATCH_INVALID;
-   if (ups_patch_read(&data) != 'S') 
-      return PATCH_PATCH_INVALID;
-   if (ups_patch_read(&data) != '1') 
-      return PATCH_PATCH_INVALID;
-
-   source_read_length = ups_decode(&data);
-   target_read_length = ups_decode(&data);
+   err = ups_read_header(&data, &source_read_length, &target_read_length);
+   if (err != PATCH_SUCCESS)
+      return err;
 
-   if (data.source_length != source_read_length
-         && data.source_length != target_read_length) 
-      return PATCH_SOURCE_INVALID;
-   *targetlength = (data.source_length == source_read_length ?
+   size = (data.source_length == source_read_length ?
          target_read_length : source_read_length);
-   if (data.target_length < *targetlength) 
+   if (data.target_length < size)
       return PATCH_TARGET_TOO_SMALL;
-   data.target_length = *targetlength;
+   *targetlength = size;
+   data.target_length = size;
+   end = patchlength - 12;
+
+   patch_crc_start(&source_crc, sourcedata, sourcelength);
 
-   while (data.patch_offset < data.patch_length - 12) 
+   while (data.patch_offset < end)
    {
-      unsigned length = ups_decode(&data);
-      while (length--) 
-         ups_target_write(&data, ups_source_read(&data));
-      while (true) 
+      uint64_t length;
+
+      if (!patch_decode(patchdata, &data.patch_offset, end, &length))
+      {
+         err = PATCH_PATCH_INVALID;
+         break;
+      }
+      ups_copy(&data, length);
+
+      for (;;)
       {
-         uint8_t patch_xor = ups_patch_read(&data);
+         uint8_t patch_xor;
+
+         if (data.patch_offset >= end)
+         {
+            err = PATCH_PATCH_INVALID;
+            break;
+         }
+
+         patch_xor = patchdata[data.patch_offset++];
          ups_target_write(&data, patch_xor ^ ups_source_read(&data));
          if (patch_xor == 0)
             break;
       }
-   }
 
-   while (data.source_offset < data.source_length) 
-      ups_target_write(&data, ups_source_read(&data));
-   while (data.target_offset < data.target_length) 
-      ups_target_write(&data, ups_source_read(&data));
+      if (err != PATCH_SUCCESS)
+         break;
+   }
 
+   /* The rest of the source is unchanged, anything past it is zero. */
+   ups_copy(&data, data.source_length - data.source_offset);
+   ups_copy(&data, data.target_length - data.target_offset);
 
-   for (i = 0; i < 4; i++) 
-      source_read_checksum |= ups_patch_read(&data) << (i * 8);
-   for (i = 0; i < 4; i++) 
-      target_read_checksum |= ups_patch_read(&data) << (i * 8);
+   source_checksum = patch_crc_finish(&source_crc);
+   if (err != PATCH_SUCCESS)
+      return err;
 
-   patch_result_checksum = ~data.patch_checksum;
-   data.source_checksum  = ~data.source_checksum;
-   data.target_checksum  = ~data.target_checksum;
+   target_checksum = crc32_calculate(targetdata, data.target_length);
+   patch_checksum  = crc32_calculate(patchdata, patchlength - 4);
 
-   for (i = 0; i < 4; i++) 
-      patch_read_checksum |= ups_patch_read(&data) << (i * 8);
+   source_read_checksum = patch_read_le32(patchdata + end);
+   target_read_checksum = patch_read_le32(patchdata + end + 4);
 
-   if (patch_result_checksum != patch_read_checksum) 
+   if (patch_checksum != patch_read_le32(patchdata + end + 8))
       return PATCH_PATCH_INVALID;
 
-   if (data.source_checksum == source_read_checksum
-         && data.source_length == source_read_length) 
+   if (source_checksum == source_read_checksum
+         && data.source_length == source_read_length)
    {
-      if (data.target_checksum == target_read_checksum
-            && data.target_length == target_read_length) 
+      if (target_checksum == target_read_checksum
+            && data.target_length == target_read_length)
          return PATCH_SUCCESS;
       return PATCH_TARGET_INVALID;
-   } 
-   else if (data.source_checksum == target_read_checksum
-         && data.source_length == target_read_length) 
+   }
+   else if (source_checksum == target_read_checksum
+         && data.source_length == target_read_length)
    {
-      if (data.target_checksum == source_read_checksum
-            && data.target_length == source_read_length) 
+      if (target_checksum == source_read_checksum
+            && data.target_length == source_read_length)
          return PATCH_SUCCESS;
       return PATCH_TARGET_INVALID;
-   } 
+   }
 
    return PATCH_SOURCE_INVALID;
 }
 
-patch_error_t ips_apply_patch(
+/**
+ * ips_process:
+ * @patchdata    : IPS patch.
+ * @patchlen     : size of @patchdata.
+ * @targetdata   : target holding a copy of the source, or NULL
+ *                 to only measure the patch.
+ * @capacity     : size of @targetdata.
+ * @targetlength : holds the source size on entry, and the patched
+ *                 size on return.
+ * @required     : holds the source size on entry, raised to the
+ *                 buffer size the records need.
+ *
+ * Walks the records of an IPS patch, applying them to @targetdata.
+ *
+ * Returns: PATCH_SUCCESS if the patch is well-formed and fits.
+ **/
+static patch_error_t ips_process(
       const uint8_t *patchdata, size_t patchlen,
-      const uint8_t *sourcedata, size_t sourcelength,
-      uint8_t *targetdata, size_t *targetlength)
+      uint8_t *targetdata, size_t capacity,
+      size_t *targetlength, size_t *required)
 {
-   uint32_t offset = 5;
-
-   if (patchlen < 8 ||
-         patchdata[0] != 'P' ||
-         patchdata[1] != 'A' ||
-         patchdata[2] != 'T' ||
-         patchdata[3] != 'C' ||
-         patchdata[4] != 'H')
-      return PATCH_PATCH_INVALID;
-
-   memcpy(targetdata, sourcedata, sourcelength);
+   size_t offset = 5;
 
-   *targetlength = sourcelength;
+   if (patchlen < 8 || memcmp(patchdata, "PATCH", 5) != 0)
+      return PATCH_PATCH_INVALID;
 
    for (;;)
    {
-      uint32_t address;
-      unsigned length;
+      size_t address;
+      size_t length;
 
       if (offset > patchlen - 3)
          break;
@@ -376,10 +617,14 @@ patch_error_t ips_apply_patch(
             return PATCH_SUCCESS;
          else if (offset == patchlen - 3)
          {
-            uint32_t size = patchdata[offset++] << 16;
+            size_t size = patchdata[offset++] << 16;
             size |= patchdata[offset++] << 8;
             size |= patchdata[offset++] << 0;
+            if (targetdata && size > capacity)
+               return PATCH_TARGET_TOO_SMALL;
             *targetlength = size;
+            if (size > *required)
+               *required = size;
             return PATCH_SUCCESS;
          }
       }
@@ -392,11 +637,16 @@ patch_error_t ips_apply_patch(
 
       if (length) /* Copy */
       {
-         if (offset > patchlen - length)
+         if (length > patchlen - offset)
             break;
 
-         while (length--)
-            targetdata[address++] = patchdata[offset++];
+         if (targetdata)
+         {
+            if (address + length > capacity)
+               return PATCH_TARGET_TOO_SMALL;
+            memcpy(targetdata + address, patchdata + offset, length);
+         }
+         offset += length;
       }
       else /* RLE */
       {
@@ -409,16 +659,59 @@ patch_error_t ips_apply_patch(
          if (length == 0) /* Illegal */
             break;
 
-         while (length--)
-            targetdata[address++] = patchdata[offset];
-
+         if (targetdata)
+         {
+            if (address + length > capacity)
+               return PATCH_TARGET_TOO_SMALL;
+            memset(targetdata + address, patchdata[offset], length);
+         }
          offset++;
       }
 
+      address += length;
       if (address > *targetlength)
          *targetlength = address;
+      if (address > *required)
+         *required = address;
    }
 
    return PATCH_PATCH_INVALID;
 }
 
+patch_error_t ips_get_target_size(
+      const uint8_t *patchdata, size_t patchlen,
+      size_t sourcelength, size_t *targetlength)
+{
+   size_t length   = sourcelength;
+   size_t required = sourcelength;
+   patch_error_t err = ips_process(patchdata, patchlen,
+         NULL, 0, &length, &required);
+
+   if (err != PATCH_SUCCESS)
+      return err;
+
+   *targetlength = required;
+   return PATCH_SUCCESS;
+}
+
+patch_error_t ips_apply_patch(
+      const uint8_t *patchdata, size_t patchlen,
+      const uint8_t *sourcedata, size_t sourcelength,
+      uint8_t *targetdata, size_t *targetlength)
+{
+   size_t capacity = *targetlength;
+   size_t required = sourcelength;
+
+   if (capacity < sourcelength)
+      return PATCH_TARGET_TOO_SMALL;
+
+   /* Records may start past the end of the source,
+    * the gap reads as zeroes. */
+   memcpy(targetdata, sourcedata, sourcelength);
+   memset(targetdata + sourcelength, 0, capacity - sourcelength);
+
+   *targetlength = sourcelength;
+
+   return ips_process(patchdata, patchlen, targetdata, capacity,
+         targetlength, &required);
+}
@@ -25,10 +25,12 @@
 #include "dynamic.h"
 #include "content.h"
 #include "file_ops.h"
+#include "file_extract.h"
 #include <file/file_path.h>
 #include <file/dir_list.h>
 #include "general.h"
 #include "retroarch.h"
+#include "runloop.h"
 #include "settings.h"
 #include <compat/strl.h>
 #include "screenshot.h"
@@ -536,6 +538,8 @@ static void print_help(void)
    puts("\t-P/--bsvplay: Playback a BSV movie file.");
    puts("\t-R/--bsvrecord: Start recording a BSV movie file from the beginning.");
    puts("\t--eof-exit: Exit upon reaching the end of the BSV movie file.");
+   puts("\t--bsvbench: Play back BSV movie (-P) headless and unthrottled, then report");
+   puts("\t\tframes per second, frame time percentiles and final state hash.");
    puts("\t-M/--sram-mode: Takes an argument telling how SRAM should be handled in the session.");
    puts("\t\t{no,}load-{no,}save describes if SRAM should be loaded, and if SRAM should be saved.");
    puts("\t\tDo note that noload-save implies that save files will be deleted and overwritten.");
@@ -548,6 +552,9 @@ static void print_help(void)
    puts("\t--spectate: Netplay will become spectating mode.");
    puts("\t\tHost can live stream the game content to users that connect.");
    puts("\t\tHowever, the client will not be able to play. Multiple clients can connect to the host.");
+   puts("\t--netplay-sim-delay: Delays outgoing netplay input by given milliseconds.");
+   puts("\t--netplay-sim-loss: Drops given percentage of outgoing netplay input packets.");
+   puts("\t\tUseful for benchmarking netplay over loopback.");
 #endif
    puts("\t--nick: Picks a username (for use with netplay). Not mandatory.");
 #if defined(HAVE_NETWORK_CMD) && defined(HAVE_NETPLAY)
@@ -764,6 +771,8 @@ static void parse_input(int argc, char *argv[])
       { "frames", 1, NULL, 'F' },
       { "port", 1, &val, 'p' },
       { "spectate", 0, &val, 'S' },
+      { "netplay-sim-delay", 1, &val, 'y' },
+      { "netplay-sim-loss", 1, &val, 'l' },
 #endif
       { "nick", 1, &val, 'N' },
 #if defined(HAVE_NETWORK_CMD) && defined(HAVE_NETPLAY)
@@ -778,6 +787,7 @@ static void parse_input(int argc, char *argv[])
       { "subsystem", 1, NULL, 'Z' },
       { "max-frames", 1, NULL, 'm' },
       { "eof-exit", 0, &val, 'e' },
+      { "bsvbench", 0, &val, 'b' },
       { NULL, 0, NULL, 0 }
    };
 
@@ -998,6 +1008,14 @@ static void parse_input(int argc, char *argv[])
                   g_extern.netplay_is_spectate = true;
                   break;
 
+               case 'y':
+                  g_extern.netplay_sim_delay_ms = strtoul(optarg, NULL, 0);
+                  break;
+
+               case 'l':
+                  g_extern.netplay_sim_loss = strtoul(optarg, NULL, 0);
+                  break;
+
 #endif
                case 'N':
                   g_extern.has_set_username = true;
@@ -1061,6 +1079,11 @@ static void parse_input(int argc, char *argv[])
                   g_extern.bsv.eof_exit = true;
                   break;
 
+               case 'b':
+                  g_extern.bsv.benchmark = true;
+                  g_extern.bsv.eof_exit  = true;
+                  break;
+
                default:
                   break;
             }
@@ -1251,6 +1274,40 @@ static void init_rewind(void)
    state_manager_push_do(g_extern.state_manager);
 }
 
+/**
+ * init_benchmark:
+ *
+ * Overrides settings for headless movie benchmarking,
+ * so that only the core is measured.
+ **/
+static void init_benchmark(void)
+{
+   if (!g_extern.bsv.benchmark)
+      return;
+
+   if (!g_extern.bsv.movie_start_playback)
+   {
+      RARCH_ERR("--bsvbench requires a movie to play back (-P).\n");
+      rarch_fail(1, "init_benchmark()");
+   }
+
+   strlcpy(g_settings.video.driver, "null", sizeof(g_settings.video.driver));
+   strlcpy(g_settings.audio.driver, "null", sizeof(g_settings.audio.driver));
+   strlcpy(g_settings.input.driver, "null", sizeof(g_settings.input.driver));
+#ifdef HAVE_MENU
+   strlcpy(g_settings.menu.driver, "rgui", sizeof(g_settings.menu.driver));
+#endif
+   g_settings.audio.enable                     = false;
+   g_settings.video.vsync                      = false;
+   g_settings.video.threaded                   = false;
+   g_settings.video.frame_delay                = 0;
+   g_settings.rewind_enable                    = false;
+   g_settings.fastforward_ratio_throttle_enable = false;
+   g_settings.history_list_enable              = false;
+   /* Don't persist the overridden drivers. */
+   g_settings.config_save_on_exit              = false;
+}
+
 static void init_movie(void)
 {
    if (g_extern.bsv.movie_start_playback)
@@ -1982,6 +2039,9 @@ void rarch_main_state_new(void)
 {
    main_clear_state(g_extern.main_is_init);
    rarch_main_command(RARCH_CMD_MSG_QUEUE_INIT);
+#ifdef HAVE_7ZIP
+   compressed_7zip_cache_init();
+#endif
 }
 
 void rarch_main_state_free(void)
@@ -1991,6 +2051,9 @@ void rarch_main_state_free(void)
 
    main_clear_state(false);
 
+#ifdef HAVE_7ZIP
+   compressed_7zip_cache_free();
+#endif
 }
 
 #ifdef HAVE_ZLIB
@@ -2180,6 +2243,8 @@ int rarch_main_init(int argc, char *argv[])
 
    validate_cpu_features();
    config_load();
+   init_benchmark();
+   rarch_main_startup_begin();
 
    init_libretro_sym(g_extern.libretro_dummy);
    init_system_info();
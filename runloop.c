@@ -23,6 +23,7 @@
 #include "intl/intl.h"
 #include "retroarch.h"
 #include "runloop.h"
+#include "hash.h"
 
 #ifdef HAVE_MENU
 #include "menu/menu.h"
@@ -843,6 +844,88 @@ static bool input_flush(retro_input_t *input)
    return true;
 }
 
+static int bsv_benchmark_compare(const void *a, const void *b)
+{
+   uint32_t x = *(const uint32_t*)a;
+   uint32_t y = *(const uint32_t*)b;
+   return (x > y) - (x < y);
+}
+
+/**
+ * bsv_benchmark_frame:
+ * @usec                 : time spent in retro_run() this frame.
+ *
+ * Records frame time of a --bsvbench run.
+ **/
+static void bsv_benchmark_frame(retro_time_t usec)
+{
+   if (g_extern.bsv.benchmark_frames >= g_extern.bsv.benchmark_frames_size)
+   {
+      size_t new_size = g_extern.bsv.benchmark_frames_size * 2 + 4096;
+      uint32_t *frames = (uint32_t*)realloc(g_extern.bsv.benchmark_frame_usec,
+            new_size * sizeof(uint32_t));
+
+      if (!frames)
+         return;
+
+      g_extern.bsv.benchmark_frame_usec  = frames;
+      g_extern.bsv.benchmark_frames_size = new_size;
+   }
+
+   g_extern.bsv.benchmark_frame_usec[g_extern.bsv.benchmark_frames++] = usec;
+}
+
+/**
+ * bsv_benchmark_report:
+ *
+ * Reports throughput, frame time percentiles and the hash of 
+ * the final state of a --bsvbench run.
+ **/
+static void bsv_benchmark_report(void)
+{
+   size_t i, frames   = g_extern.bsv.benchmark_frames;
+   uint32_t *usec     = g_extern.bsv.benchmark_frame_usec;
+   retro_time_t wall  = rarch_get_time_usec() - g_extern.bsv.benchmark_start;
+   uint64_t total     = 0;
+   size_t state_size  = pretro_serialize_size();
+
+   if (!frames)
+   {
+      RARCH_ERR("Benchmark: No frames were run.\n");
+      return;
+   }
+
+   for (i = 0; i < frames; i++)
+      total += usec[i];
+
+   qsort(usec, frames, sizeof(uint32_t), bsv_benchmark_compare);
+
+   RARCH_LOG_OUTPUT("Benchmark: %u frames in %.3f s, %.2f FPS (core only: %.2f FPS).\n",
+         (unsigned)frames, wall / 1000000.0,
+         wall ? frames * 1000000.0 / wall : 0.0,
+         total ? frames * 1000000.0 / total : 0.0);
+   RARCH_LOG_OUTPUT("Benchmark: Frame time p50 %u us, p90 %u us, p99 %u us, max %u us.\n",
+         usec[frames * 50 / 100], usec[frames * 90 / 100],
+         usec[frames * 99 / 100], usec[frames - 1]);
+
+   if (state_size)
+   {
+      uint8_t *state = (uint8_t*)malloc(state_size);
+
+      if (state && pretro_serialize(state, state_size))
+         RARCH_LOG_OUTPUT("Benchmark: Final state CRC32 0x%08x (%u bytes).\n",
+               crc32_calculate(state, state_size), (unsigned)state_size);
+      free(state);
+   }
+   else
+      RARCH_LOG_OUTPUT("Benchmark: Core does not support savestates, no state hash.\n");
+
+   free(g_extern.bsv.benchmark_frame_usec);
+   g_extern.bsv.benchmark_frame_usec  = NULL;
+   g_extern.bsv.benchmark_frames      = 0;
+   g_extern.bsv.benchmark_frames_size = 0;
+}
+
 /**
  * rarch_main_load_dummy_core:
  *
@@ -856,6 +939,12 @@ static bool input_flush(retro_input_t *input)
  **/
 static int rarch_main_iterate_quit(void)
 {
+   if (g_extern.bsv.benchmark)
+   {
+      bsv_benchmark_report();
+      g_extern.bsv.benchmark = false;
+   }
+
    if (g_extern.core_shutdown_initiated
          && g_settings.load_dummy_on_core_shutdown)
    {
@@ -969,6 +1058,36 @@ static int rarch_main_iterate_http_poll(void)
 }
 #endif
 
+/* Time from startup to the end of the first frame. */
+static struct retro_perf_counter startup_first_frame = {
+   "startup_first_frame"
+};
+static retro_time_t startup_time;
+static bool startup_pending;
+
+/**
+ * rarch_main_startup_begin:
+ *
+ * Starts the startup_first_frame performance counter, which
+ * stops when rarch_main_iterate has run the first frame.
+ **/
+void rarch_main_startup_begin(void)
+{
+   rarch_perf_register(&startup_first_frame);
+   RARCH_PERFORMANCE_START(startup_first_frame);
+   startup_time    = rarch_get_time_usec();
+   startup_pending = true;
+}
+
+static void rarch_main_startup_end(void)
+{
+   RARCH_PERFORMANCE_STOP(startup_first_frame);
+   startup_pending = false;
+
+   RARCH_LOG("Startup to first frame: %.1f ms.\n",
+         (rarch_get_time_usec() - startup_time) / 1000.0);
+}
+
 /**
  * rarch_main_iterate:
  *
@@ -1070,7 +1189,21 @@ int rarch_main_iterate(void)
 
 
    /* Run libretro for one frame. */
-   pretro_run();
+   if (g_extern.bsv.benchmark)
+   {
+      retro_time_t start = rarch_get_time_usec();
+
+      if (!g_extern.bsv.benchmark_start)
+         g_extern.bsv.benchmark_start = start;
+
+      pretro_run();
+      bsv_benchmark_frame(rarch_get_time_usec() - start);
+   }
+   else
+      pretro_run();
+
+   if (startup_pending)
+      rarch_main_startup_end();
 
    for (i = 0; i < g_settings.input.max_users; i++)
    {
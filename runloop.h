@@ -31,6 +31,14 @@ extern "C" {
  **/
 int rarch_main_iterate(void);
 
+/**
+ * rarch_main_startup_begin:
+ *
+ * Starts the startup_first_frame performance counter, which
+ * stops when rarch_main_iterate has run the first frame.
+ **/
+void rarch_main_startup_begin(void);
+
 #ifdef __cplusplus
 }
 #endif
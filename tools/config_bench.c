@@ -0,0 +1,243 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2015 - Daniel De Matteis
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Times parsing, lookups and writes of a config file shaped like
+ * retroarch.cfg, and checks the results against the generated keys.
+ *
+ * Usage: config_bench [key count] [scratch config path] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <file/config_file.h>
+
+#define CONFIG_BENCH_ROUNDS 20
+
+static const char *config_bench_prefixes[] = {
+   "video_", "audio_", "input_player1_", "input_player2_",
+   "input_player3_", "input_player4_", "menu_", "savestate_",
+   "network_", "core_",
+};
+
+static double config_bench_time(void)
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void config_bench_report(const char *what, double start,
+      unsigned long ops)
+{
+   double elapsed = config_bench_time() - start;
+
+   printf("  %-32s %10.3f ms", what, elapsed * 1000.0);
+   if (ops)
+      printf(" %10.1f ns/op", elapsed * 1e9 / ops);
+   printf("\n");
+}
+
+static void config_bench_key(char *buf, size_t size, unsigned i)
+{
+   snprintf(buf, size, "%ssetting_%u", config_bench_prefixes[i %
+         (sizeof(config_bench_prefixes) / sizeof(config_bench_prefixes[0]))],
+         i);
+}
+
+static void config_bench_value(char *buf, size_t size, unsigned i,
+      unsigned round)
+{
+   snprintf(buf, size, "value %u.%u", i, round);
+}
+
+static int config_bench_generate(const char *path, unsigned count)
+{
+   unsigned i;
+   char key[64], value[64];
+   FILE *file = fopen(path, "w");
+
+   if (!file)
+   {
+      perror(path);
+      return 1;
+   }
+
+   fprintf(file, "# Generated by config_bench\n");
+   for (i = 0; i < count; i++)
+   {
+      config_bench_key(key, sizeof(key), i);
+      config_bench_value(value, sizeof(value), i, 0);
+      fprintf(file, "%s = \"%s\"\n", key, value);
+   }
+
+   /* Later duplicates must not shadow the first definition. */
+   config_bench_key(key, sizeof(key), 0);
+   fprintf(file, "%s = \"shadowed\"\n", key);
+
+   fclose(file);
+   return 0;
+}
+
+static int config_bench_verify(config_file_t *conf, unsigned count,
+      unsigned round)
+{
+   unsigned i;
+   char key[64], value[64], got[64];
+
+   for (i = 0; i < count; i++)
+   {
+      config_bench_key(key, sizeof(key), i);
+      config_bench_value(value, sizeof(value), i, round);
+
+      if (!config_get_array(conf, key, got, sizeof(got))
+            || strcmp(got, value))
+      {
+         fprintf(stderr, "%s: expected \"%s\"\n", key, value);
+         return 1;
+      }
+   }
+
+   if (config_entry_exists(conf, "not_a_setting"))
+   {
+      fprintf(stderr, "not_a_setting: unexpectedly found\n");
+      return 1;
+   }
+
+   return 0;
+}
+
+static int config_bench_run(const char *path, unsigned count)
+{
+   unsigned i, round;
+   char key[64], value[64];
+   unsigned long ops = 0;
+   double start;
+   config_file_t *conf;
+   int rv = 1;
+
+   printf("%u keys:\n", count);
+
+   if (config_bench_generate(path, count))
+      return 1;
+
+   start = config_bench_time();
+   for (round = 0; round < CONFIG_BENCH_ROUNDS; round++)
+   {
+      conf = config_file_new(path);
+      if (!conf)
+         return 1;
+      if (round + 1 < CONFIG_BENCH_ROUNDS)
+         config_file_free(conf);
+   }
+   config_bench_report("config_file_new", start, CONFIG_BENCH_ROUNDS);
+
+   if (config_bench_verify(conf, count, 0))
+      goto end;
+
+   start = config_bench_time();
+   for (round = 0; round < CONFIG_BENCH_ROUNDS; round++)
+   {
+      for (i = 0; i < count; i++)
+      {
+         config_bench_key(key, sizeof(key), i);
+         ops += config_get_array(conf, key, value, sizeof(value));
+      }
+   }
+   config_bench_report("config_get_array (hit)", start, ops);
+
+   ops   = 0;
+   start = config_bench_time();
+   for (round = 0; round < CONFIG_BENCH_ROUNDS; round++)
+   {
+      for (i = 0; i < count; i++)
+      {
+         snprintf(key, sizeof(key), "missing_setting_%u", i);
+         ops += !config_entry_exists(conf, key);
+      }
+   }
+   config_bench_report("config_entry_exists (miss)", start, ops);
+
+   start = config_bench_time();
+   for (i = 0; i < count; i++)
+   {
+      config_bench_key(key, sizeof(key), i);
+      config_bench_value(value, sizeof(value), i, 1);
+      config_set_string(conf, key, value);
+   }
+   config_bench_report("config_set_string (update)", start, count);
+
+   if (config_bench_verify(conf, count, 1))
+      goto end;
+
+   start = config_bench_time();
+   for (i = 0; i < count; i++)
+   {
+      snprintf(key, sizeof(key), "new_setting_%u", i);
+      config_set_int(conf, key, i);
+   }
+   config_bench_report("config_set_int (insert)", start, count);
+
+   for (i = 0; i < count; i++)
+   {
+      int val = -1;
+
+      snprintf(key, sizeof(key), "new_setting_%u", i);
+      if (!config_get_int(conf, key, &val) || val != (int)i)
+      {
+         fprintf(stderr, "%s: expected %u\n", key, i);
+         goto end;
+      }
+   }
+
+   start = config_bench_time();
+   if (!config_file_write(conf, path))
+      goto end;
+   config_bench_report("config_file_write", start, 0);
+
+   config_file_free(conf);
+   conf = config_file_new(path);
+   if (!conf || config_bench_verify(conf, count, 1))
+      goto end;
+
+   rv = 0;
+
+end:
+   config_file_free(conf);
+   return rv;
+}
+
+int main(int argc, char *argv[])
+{
+   unsigned i;
+   static const unsigned counts[] = { 100, 1000, 10000 };
+   const char *path = "config_bench.cfg";
+   int rv = 0;
+
+   if (argc > 2)
+      path = argv[2];
+
+   if (argc > 1)
+      rv = config_bench_run(path, strtoul(argv[1], NULL, 0));
+   else
+      for (i = 0; i < sizeof(counts) / sizeof(counts[0]) && !rv; i++)
+         rv = config_bench_run(path, counts[i]);
+
+   remove(path);
+
+   if (rv)
+      fprintf(stderr, "Benchmark failed.\n");
+   return rv;
+}
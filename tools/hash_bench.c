@@ -0,0 +1,136 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2015 - Daniel De Matteis
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Checks the hash functions against known vectors and reports
+ * their throughput.
+ *
+ * Usage: hash_bench [size in MB] */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include "../hash.h"
+
+static double hash_bench_time(void)
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static int hash_bench_check(const char *name,
+      const char *got, const char *expected)
+{
+   if (!strcmp(got, expected))
+      return 0;
+
+   fprintf(stderr, "%s: got %s, expected %s\n", name, got, expected);
+   return 1;
+}
+
+static int hash_bench_vectors(void)
+{
+   static const char quick[] = "The quick brown fox jumps over the lazy dog";
+   static const char abc[]   =
+      "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+   uint8_t block[1000];
+   char out[65];
+   int failed = 0;
+   unsigned i;
+   uint32_t crc;
+
+   for (i = 0; i < sizeof(block); i++)
+      block[i] = (uint8_t)(i * 7 + 3);
+
+   snprintf(out, sizeof(out), "%08x",
+         (unsigned)crc32_calculate((const uint8_t*)quick, strlen(quick)));
+   failed |= hash_bench_check("crc32", out, "414fa339");
+
+   /* Split updates must agree with a single pass. */
+   crc = crc32_update(0, block, 333);
+   crc = crc32_update(crc, block + 333, sizeof(block) - 333);
+   if (crc != crc32_calculate(block, sizeof(block)))
+   {
+      fprintf(stderr, "crc32: chunked update mismatch\n");
+      failed = 1;
+   }
+
+   sha1_hash(out, (const uint8_t*)"", 0);
+   failed |= hash_bench_check("sha1", out,
+         "DA39A3EE5E6B4B0D3255BFEF95601890AFD80709");
+   sha1_hash(out, (const uint8_t*)abc, strlen(abc));
+   failed |= hash_bench_check("sha1", out,
+         "84983E441C3BD26EBAAE4AA1F95129E5E54670F1");
+
+   sha256_hash(out, (const uint8_t*)"", 0);
+   failed |= hash_bench_check("sha256", out,
+         "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+   sha256_hash(out, (const uint8_t*)abc, strlen(abc));
+   failed |= hash_bench_check("sha256", out,
+         "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+
+   return failed;
+}
+
+int main(int argc, char *argv[])
+{
+   char out[65];
+   double start, elapsed;
+   size_t i, size = 64;
+   volatile uint32_t crc;
+   uint8_t *data;
+
+   if (argc > 1)
+      size = strtoul(argv[1], NULL, 0);
+   if (!size)
+      size = 1;
+   size <<= 20;
+
+   if (hash_bench_vectors())
+      return 1;
+
+   data = (uint8_t*)malloc(size);
+   if (!data)
+      return 1;
+
+   srand(time(NULL));
+   for (i = 0; i < size; i++)
+      data[i] = rand();
+
+   start   = hash_bench_time();
+   crc     = crc32_calculate(data, size);
+   elapsed = hash_bench_time() - start;
+   printf("crc32:  %8.3f GB/s (%08x)\n",
+         size / elapsed / 1e9, (unsigned)crc);
+
+   start   = hash_bench_time();
+   sha1_hash(out, data, size);
+   elapsed = hash_bench_time() - start;
+   printf("sha1:   %8.3f GB/s (%s)\n", size / elapsed / 1e9, out);
+
+   start   = hash_bench_time();
+   sha256_hash(out, data, size);
+   elapsed = hash_bench_time() - start;
+   printf("sha256: %8.3f GB/s (%s)\n", size / elapsed / 1e9, out);
+
+   free(data);
+   return 0;
+}